@@ -22,6 +22,7 @@
 
 #include "ATA.h"
 #include "Frame.h"
+#include "State.h"
 
 // ToDo:
 //  - add ATA interface layer to allow chaining of a slave device
@@ -57,6 +58,42 @@ void CATADevice::Reset ()
 }
 
 
+// Save the registers and any transfer in progress (the identity and geometry come from the disk)
+void CATADevice::SaveState () const
+{
+    int nBuffer = m_pbBuffer ? static_cast<int>(m_pbBuffer - m_abSectorData) : -1;
+
+    State::Write(&m_sRegs, sizeof m_sRegs);
+    State::Write(m_abSectorData, sizeof m_abSectorData);
+    State::Write(m_abVendorBytes, sizeof m_abVendorBytes);
+    State::Write(&m_uBuffer, sizeof m_uBuffer);
+    State::Write(&nBuffer, sizeof nBuffer);
+    State::Write(&m_fAsleep, sizeof m_fAsleep);
+    State::Write(&m_nMultiples, sizeof m_nMultiples);
+}
+
+bool CATADevice::LoadState ()
+{
+    int nBuffer;
+
+    if (!State::Read(&m_sRegs, sizeof m_sRegs) ||
+        !State::Read(m_abSectorData, sizeof m_abSectorData) ||
+        !State::Read(m_abVendorBytes, sizeof m_abVendorBytes) ||
+        !State::Read(&m_uBuffer, sizeof m_uBuffer) ||
+        !State::Read(&nBuffer, sizeof nBuffer) ||
+        !State::Read(&m_fAsleep, sizeof m_fAsleep) ||
+        !State::Read(&m_nMultiples, sizeof m_nMultiples))
+        return false;
+
+    // Transfers only ever use the sector buffer
+    if (nBuffer < -1 || nBuffer > static_cast<int>(sizeof m_abSectorData) || m_uBuffer > sizeof m_abSectorData - max(nBuffer, 0))
+        return false;
+
+    m_pbBuffer = (nBuffer < 0) ? NULL : m_abSectorData + nBuffer;
+    return true;
+}
+
+
 WORD CATADevice::In (WORD wPort_)
 {
     WORD wRet = 0xffff;
@@ -107,7 +144,7 @@ WORD CATADevice::In (WORD wPort_)
 //                  TRACE("ATA: READ status\n");
 
                     // Toggle the index bit in the status to make it look like the disk is spinning
-                    static int nPulse = 0;
+                    static MACHINE_LOCAL int nPulse = 0;
                     if (!m_fAsleep && !(++nPulse %= 10))
                         m_sRegs.bStatus ^= ATA_STATUS_INDEX;
 
@@ -155,6 +155,9 @@ class CATADevice
         void Out (WORD wPort_, WORD wVal_);
 
         void Reset ();
+        void SaveState () const;
+        bool LoadState ();
+
         const ATA_GEOMETRY* GetGeometry() const { return &m_sGeometry; };
 
     public:
@@ -29,6 +29,7 @@
 #include "Input.h"
 #include "Options.h"
 #include "Parallel.h"
+#include "Rewind.h"
 #include "UI.h"
 #include "Video.h"
 
@@ -39,7 +40,7 @@ const char* Action::aszActions[MAX_ACTION] =
     "Reset button", "NMI button", "Pause", "Step single frame", "Toggle turbo speed", "Turbo speed (when held)",
     "Toggle frame sync", "Toggle fullscreen", "Change window size", "Change border size", "Toggle 5:4 display",
     "Change frame-skip mode", "Toggle scanlines", "Toggle greyscale", "Mute sound", "Release mouse capture",
-    "Toggle printer online", "Flush printer", "About SimCoupe", "Minimise window"
+    "Toggle printer online", "Flush printer", "About SimCoupe", "Minimise window", "Rewind 1 second"
 };
 
 bool g_fFrameStep;
@@ -178,6 +179,16 @@ bool Action::Do (int nAction_, bool fPressed_/*=true*/)
                 GUI::Start(new CAboutDialog);
                 break;
 
+            case actRewind:
+            {
+                int nFrames = Rewind::Back(EMULATED_FRAMES_PER_SECOND);
+                if (!nFrames)
+                    Frame::SetStatus("Nothing to rewind");
+                else
+                    Frame::SetStatus("Rewound %d frame%s", nFrames, (nFrames == 1) ? "" : "s");
+                break;
+            }
+
             case actToggleTurbo:
             {
                 g_fTurbo = !g_fTurbo;
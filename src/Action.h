@@ -28,7 +28,7 @@ enum eActions
     actResetButton, actNmiButton, actPause, actFrameStep, actToggleTurbo, actTempTurbo,
     actToggleSync, actToggleFullscreen, actChangeWindowSize, actChangeBorders, actToggle5_4,
     actChangeFrameSkip, actToggleScanlines, actToggleGreyscale, actToggleMute, actReleaseMouse,
-    actPrinterOnline, actFlushPrinter, actAbout, actMinimise, MAX_ACTION
+    actPrinterOnline, actFlushPrinter, actAbout, actMinimise, actRewind, MAX_ACTION
 };
 
 class Action
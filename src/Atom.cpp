@@ -23,6 +23,7 @@
 
 #include "SimCoupe.h"
 #include "Atom.h"
+#include "State.h"
 
 const unsigned int ATOM_LIGHT_DELAY = 2;    // Number of frames the hard disk LED remains on for after a command
 
@@ -46,6 +47,26 @@ void CAtomDiskDevice::Reset ()
         m_pDisk->Reset();
 }
 
+void CAtomDiskDevice::SaveState () const
+{
+    State::Write(&m_bAddressLatch, sizeof m_bAddressLatch);
+    State::Write(&m_bDataLatch, sizeof m_bDataLatch);
+    State::Write(&m_uLightDelay, sizeof m_uLightDelay);
+
+    if (m_pDisk)
+        m_pDisk->SaveState();
+}
+
+bool CAtomDiskDevice::LoadState ()
+{
+    if (!State::Read(&m_bAddressLatch, sizeof m_bAddressLatch) ||
+        !State::Read(&m_bDataLatch, sizeof m_bDataLatch) ||
+        !State::Read(&m_uLightDelay, sizeof m_uLightDelay))
+        return false;
+
+    return !m_pDisk || m_pDisk->LoadState();
+}
+
 BYTE CAtomDiskDevice::In (WORD wPort_)
 {
     BYTE bRet = 0xff;
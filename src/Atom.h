@@ -42,6 +42,9 @@ class CAtomDiskDevice : public CDiskDevice
         void Reset ();
         void FrameEnd ();
 
+        void SaveState () const;
+        bool LoadState ();
+
         bool IsLightOn () const { return m_uLightDelay != 0; }
         const char* GetPath() const { return m_pDisk->GetPath(); }
 
@@ -0,0 +1,307 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Batch.cpp: Disk image smoke tests run across a pool of worker processes
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  The list file names one image per line, with blank lines and lines
+//  starting with '#' ignored.  Each image is run in a process of its own,
+//  forked from this one, with no more than nWorkers_ running at once.  A
+//  fresh process per image means an image that crashes the emulator (or
+//  exits through a fatal message) takes nothing else with it, and there's
+//  no machine state to clear between them.
+//
+//  Each worker passes its result back through a pipe before exiting, and
+//  the exit status shows whether it got that far.  The report is written
+//  once everything has finished, as tab-separated columns with a heading
+//  line, in the same order as the list:
+//
+//    image  status  frames  frame_hash  tstates_per_sec  screenshot  detail
+//
+//  The status is ok, failed (the image couldn't be used, or the worker
+//  exited with an error) or crashed (the worker was killed by a signal).
+
+#include "SimCoupe.h"
+#include "Batch.h"
+
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+enum { BATCH_OK, BATCH_FAILED, BATCH_CRASHED };
+static const char* const aszStatus[] = { "ok", "failed", "crashed" };
+
+typedef struct
+{
+    char*   pszImage;
+    int     nStatus;
+    int     nDetail;                // Exit code or signal number
+    char    szShot[MAX_PATH];       // Screenshot path, if one was requested
+    BATCH_RESULT sResult;
+}
+BATCH_IMAGE;
+
+typedef struct
+{
+    pid_t   pid;                    // Running worker process, or 0 if the slot is free
+    int     hPipe;                  // Read end of the pipe its result comes back through
+    int     nImage;
+}
+BATCH_WORKER;
+
+
+static double GetSeconds ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Read the list of images, returning the number found
+static int ReadList (const char* pcszList_, BATCH_IMAGE** ppasImages_)
+{
+    FILE* hFile = fopen(pcszList_, "r");
+    if (!hFile)
+        return -1;
+
+    int nImages = 0, nAlloc = 0;
+    BATCH_IMAGE* pasImages = NULL;
+    char sz[MAX_PATH];
+
+    while (fgets(sz, sizeof sz, hFile))
+    {
+        // Strip the line ending and any other trailing white space
+        size_t uLen = strlen(sz);
+        while (uLen && isspace(static_cast<BYTE>(sz[uLen-1])))
+            sz[--uLen] = '\0';
+
+        if (!uLen || sz[0] == '#')
+            continue;
+
+        if (nImages == nAlloc)
+        {
+            nAlloc = nAlloc ? nAlloc*2 : 64;
+            pasImages = reinterpret_cast<BATCH_IMAGE*>(realloc(pasImages, nAlloc * sizeof(BATCH_IMAGE)));
+        }
+
+        memset(&pasImages[nImages], 0, sizeof pasImages[nImages]);
+        pasImages[nImages++].pszImage = strdup(sz);
+    }
+
+    fclose(hFile);
+
+    *ppasImages_ = pasImages;
+    return nImages;
+}
+
+// Screenshots are numbered from the list position, as different directories may hold images of the same name
+static void GetShotPath (const char* pcszShotDir_, int nImage_, const char* pcszImage_, char* psz_)
+{
+    const char* pcszName = strrchr(pcszImage_, PATH_SEPARATOR);
+    pcszName = pcszName ? pcszName+1 : pcszImage_;
+
+    snprintf(psz_, MAX_PATH, "%s%c%04d-%s.png", pcszShotDir_, PATH_SEPARATOR, nImage_+1, pcszName);
+}
+
+// Start a worker process for an image, which runs it and passes the result back through a pipe
+static bool StartWorker (BATCH_WORKER* pWorker_, int nImage_, BATCH_IMAGE* pImage_, PFNRUNIMAGE pfnRun_)
+{
+    int ahPipe[2];
+    if (pipe(ahPipe))
+        return false;
+
+    // Anything still buffered would be written again by the worker
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(ahPipe[0]);
+        close(ahPipe[1]);
+        return false;
+    }
+    else if (!pid)
+    {
+        close(ahPipe[0]);
+
+        BATCH_RESULT sResult;
+        memset(&sResult, 0, sizeof sResult);
+        sResult.fOK = pfnRun_(pImage_->pszImage, *pImage_->szShot ? pImage_->szShot : NULL, &sResult);
+
+        // The result is small enough for the pipe to hold it all, so this never waits for the parent
+        bool fWritten = write(ahPipe[1], &sResult, sizeof sResult) == sizeof sResult;
+        close(ahPipe[1]);
+
+        fflush(NULL);
+        _exit((sResult.fOK && fWritten) ? 0 : 1);
+    }
+
+    close(ahPipe[1]);
+
+    pWorker_->pid = pid;
+    pWorker_->hPipe = ahPipe[0];
+    pWorker_->nImage = nImage_;
+    return true;
+}
+
+// Collect the result of a finished worker, and free its slot
+static void FinishWorker (BATCH_WORKER* pWorker_, int nStatus_, BATCH_IMAGE* pImage_)
+{
+    bool fResult = read(pWorker_->hPipe, &pImage_->sResult, sizeof pImage_->sResult) == sizeof pImage_->sResult;
+    close(pWorker_->hPipe);
+    pWorker_->pid = 0;
+
+    if (WIFSIGNALED(nStatus_))
+    {
+        pImage_->nStatus = BATCH_CRASHED;
+        pImage_->nDetail = WTERMSIG(nStatus_);
+    }
+    else
+    {
+        pImage_->nDetail = WIFEXITED(nStatus_) ? WEXITSTATUS(nStatus_) : -1;
+        pImage_->nStatus = (fResult && pImage_->sResult.fOK && !pImage_->nDetail) ? BATCH_OK : BATCH_FAILED;
+    }
+
+    // Don't report anything from a worker that didn't finish
+    if (!fResult)
+        memset(&pImage_->sResult, 0, sizeof pImage_->sResult);
+}
+
+static bool WriteReport (const char* pcszReport_, BATCH_IMAGE* pasImages_, int nImages_)
+{
+    FILE* hFile = pcszReport_ ? fopen(pcszReport_, "w") : stdout;
+    if (!hFile)
+        return false;
+
+    fprintf(hFile, "image\tstatus\tframes\tframe_hash\ttstates_per_sec\tscreenshot\tdetail\n");
+
+    for (int i = 0 ; i < nImages_ ; i++)
+    {
+        BATCH_IMAGE* p = &pasImages_[i];
+
+        char szDetail[32] = "";
+        if (p->nStatus == BATCH_CRASHED)
+            snprintf(szDetail, sizeof szDetail, "signal %d", p->nDetail);
+        else if (p->nDetail)
+            snprintf(szDetail, sizeof szDetail, "exit %d", p->nDetail);
+
+        fprintf(hFile, "%s\t%s\t%d\t%08lx\t%.0f\t%s\t%s\n", p->pszImage, aszStatus[p->nStatus],
+                p->sResult.nFrames, static_cast<unsigned long>(p->sResult.dwFrameHash), p->sResult.dTstatesPerSec,
+                p->sResult.fScreenshot ? p->szShot : "", szDetail);
+    }
+
+    bool fOK = !ferror(hFile);
+    if (hFile != stdout)
+        fOK &= !fclose(hFile);
+
+    return fOK;
+}
+
+
+// Run every image in the list, returning true only if they all ran without failing or crashing
+bool Batch::Run (const char* pcszList_, const char* pcszReport_, const char* pcszShotDir_, int nWorkers_, PFNRUNIMAGE pfnRun_)
+{
+    BATCH_IMAGE* pasImages = NULL;
+    int nImages = ReadList(pcszList_, &pasImages);
+    if (nImages < 0)
+    {
+        fprintf(stderr, "Can't open %s\n", pcszList_);
+        return false;
+    }
+
+    if (nWorkers_ < 1)
+        nWorkers_ = 1;
+
+    BATCH_WORKER* pasWorkers = new BATCH_WORKER[nWorkers_];
+    memset(pasWorkers, 0, sizeof(BATCH_WORKER) * nWorkers_);
+
+    double dStart = GetSeconds();
+    int nNext = 0, nRunning = 0;
+    bool fStarted = true;
+
+    while (nRunning || (fStarted && nNext < nImages))
+    {
+        // Fill any free slots
+        for (int i = 0 ; i < nWorkers_ && nNext < nImages ; i++)
+        {
+            if (pasWorkers[i].pid)
+                continue;
+
+            if (pcszShotDir_)
+                GetShotPath(pcszShotDir_, nNext, pasImages[nNext].pszImage, pasImages[nNext].szShot);
+
+            if (!(fStarted = StartWorker(&pasWorkers[i], nNext, &pasImages[nNext], pfnRun_)))
+            {
+                fprintf(stderr, "Failed to start a worker process\n");
+                break;
+            }
+
+            nNext++;
+            nRunning++;
+        }
+
+        if (!nRunning)
+            break;
+
+        // Wait for any worker to finish
+        int nStatus;
+        pid_t pid = waitpid(-1, &nStatus, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0 ; i < nWorkers_ ; i++)
+        {
+            if (pasWorkers[i].pid == pid)
+            {
+                FinishWorker(&pasWorkers[i], nStatus, &pasImages[pasWorkers[i].nImage]);
+                nRunning--;
+                break;
+            }
+        }
+    }
+
+    double dElapsed = GetSeconds() - dStart;
+
+    // Anything left unrun counts as a failure
+    int anCounts[3] = { 0, 0, 0 };
+    for (int i = 0 ; i < nImages ; i++)
+    {
+        if (i >= nNext)
+            pasImages[i].nStatus = BATCH_FAILED;
+
+        anCounts[pasImages[i].nStatus]++;
+    }
+
+    bool fReported = WriteReport(pcszReport_, pasImages, nImages);
+    if (!fReported)
+        fprintf(stderr, "Failed to write report to %s\n", pcszReport_);
+
+    fprintf(stderr, "batch:      %d images in %.3fs with %d workers: %d ok, %d failed, %d crashed\n",
+            nImages, dElapsed, nWorkers_, anCounts[BATCH_OK], anCounts[BATCH_FAILED], anCounts[BATCH_CRASHED]);
+
+    for (int i = 0 ; i < nImages ; i++)
+        free(pasImages[i].pszImage);
+    free(pasImages);
+    delete[] pasWorkers;
+
+    return fReported && anCounts[BATCH_OK] == nImages;
+}
@@ -0,0 +1,43 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Batch.h: Disk image smoke tests run across a pool of worker processes
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+typedef struct
+{
+    bool    fOK;                // Image opened and the machine ran to the end
+    int     nFrames;            // Frames run after inserting the image
+    DWORD   dwFrameHash;        // Checksum of the final frame (see Frame::GetChecksum)
+    double  dTstatesPerSec;     // Emulation rate while running them
+    bool    fScreenshot;        // Final frame saved to the requested file
+}
+BATCH_RESULT;
+
+// Runs the image on a fresh machine, saving the final frame to pcszShot_ if it's not NULL
+typedef bool (*PFNRUNIMAGE)(const char* pcszImage_, const char* pcszShot_, BATCH_RESULT* pResult_);
+
+class Batch
+{
+    public:
+        static bool Run (const char* pcszList_, const char* pcszReport_, const char* pcszShotDir_, int nWorkers_, PFNRUNIMAGE pfnRun_);
+};
+
+#endif
@@ -778,7 +778,7 @@ BYTE CEDSKDisk::ReadData (BYTE *pbData_, UINT* puSize_)
         UINT uCopies = uDataSize/uRealSize;
 
         // Rotate between the copies returned
-        static UINT uCopy = 0U-1;
+        static MACHINE_LOCAL UINT uCopy = 0U-1;
         uCopy = (uCopy+1) % uCopies;
 
         memcpy(pbData_, m_pbFind + (uCopy*uRealSize), uRealSize);
@@ -1572,15 +1572,15 @@ WORD CTD0Disk::CrcBlock (const void* pv_, UINT uLen_, WORD wCRC_/*=0*/)
 #define MAX_FREQ    0x8000                // updates tree when root frequency reached this value
 
 
-short LZSS::parent[T + N_CHAR];           // parent nodes (0..T-1) and leaf positions (rest)
-short LZSS::son[T];                       // pointers to child nodes (son[], son[] + 1)
-WORD LZSS::freq[T + 1];                   // frequency table
+MACHINE_LOCAL short LZSS::parent[T + N_CHAR];           // parent nodes (0..T-1) and leaf positions (rest)
+MACHINE_LOCAL short LZSS::son[T];                       // pointers to child nodes (son[], son[] + 1)
+MACHINE_LOCAL WORD LZSS::freq[T + 1];                   // frequency table
 
-BYTE LZSS::ring_buff[N + F - 1];          // text buffer for match strings
-UINT LZSS::r;                             // Ring buffer position
+MACHINE_LOCAL BYTE LZSS::ring_buff[N + F - 1];          // text buffer for match strings
+MACHINE_LOCAL UINT LZSS::r;                             // Ring buffer position
 
-BYTE *LZSS::pIn, *LZSS::pEnd;             // current and end input pointers
-UINT LZSS::uBits, LZSS::uBitBuff;         // buffered bit count and left-aligned bit buffer
+MACHINE_LOCAL BYTE *LZSS::pIn, *LZSS::pEnd;             // current and end input pointers
+MACHINE_LOCAL UINT LZSS::uBits, LZSS::uBitBuff;         // buffered bit count and left-aligned bit buffer
 
 
 BYTE LZSS::d_len[] = { 3,3,4,4,4,5,5,5,5,6,6,6,7,7,7,8 };
@@ -442,12 +442,13 @@ class LZSS
         static UINT DecodePosition ();
 
     protected:
-        static BYTE ring_buff[], d_code[], d_len[];
-        static WORD freq[];
-        static short parent[], son[];
+        static BYTE d_code[], d_len[];
+        static MACHINE_LOCAL BYTE ring_buff[];
+        static MACHINE_LOCAL WORD freq[];
+        static MACHINE_LOCAL short parent[], son[];
 
-        static BYTE *pIn, *pEnd;
-        static UINT uBits, uBitBuff, r;
+        static MACHINE_LOCAL BYTE *pIn, *pEnd;
+        static MACHINE_LOCAL UINT uBits, uBitBuff, r;
 };
 
 #endif  // CDISK_H
@@ -27,6 +27,7 @@
 
 #include "CDrive.h"
 #include "CPU.h"
+#include "State.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -71,6 +72,50 @@ bool CDrive::Insert (const char* pcszSource_, bool fReadOnly_/*=false*/)
     return m_pDisk != NULL;
 }
 
+// Save the controller state, with the path of the inserted disk but not its contents
+void CDrive::SaveState () const
+{
+    int nBuffer = m_pbBuffer ? static_cast<int>(m_pbBuffer - m_abBuffer) : -1;
+
+    State::WriteString(GetPath());
+    State::Write(&m_sRegs, sizeof m_sRegs);
+    State::Write(&m_nHeadPos, sizeof m_nHeadPos);
+    State::Write(&m_nState, sizeof m_nState);
+    State::Write(&m_nMotorDelay, sizeof m_nMotorDelay);
+    State::Write(&m_bDataStatus, sizeof m_bDataStatus);
+    State::Write(&m_uBuffer, sizeof m_uBuffer);
+    State::Write(&nBuffer, sizeof nBuffer);
+    State::Write(m_abBuffer, sizeof m_abBuffer);
+}
+
+bool CDrive::LoadState ()
+{
+    char szPath[MAX_PATH];
+    int nBuffer;
+
+    if (!State::ReadString(szPath, sizeof szPath) ||
+        !State::Read(&m_sRegs, sizeof m_sRegs) ||
+        !State::Read(&m_nHeadPos, sizeof m_nHeadPos) ||
+        !State::Read(&m_nState, sizeof m_nState) ||
+        !State::Read(&m_nMotorDelay, sizeof m_nMotorDelay) ||
+        !State::Read(&m_bDataStatus, sizeof m_bDataStatus) ||
+        !State::Read(&m_uBuffer, sizeof m_uBuffer) ||
+        !State::Read(&nBuffer, sizeof nBuffer) ||
+        !State::Read(m_abBuffer, sizeof m_abBuffer))
+        return false;
+
+    if (nBuffer < -1 || nBuffer > static_cast<int>(sizeof m_abBuffer) || m_uBuffer > sizeof m_abBuffer - max(nBuffer, 0))
+        return false;
+
+    m_pbBuffer = (nBuffer < 0) ? NULL : m_abBuffer + nBuffer;
+
+    // Re-insert the saved disk if it's not already in the drive, but carry on without it if it's gone
+    if (strcmp(szPath, GetPath()) && !Insert(szPath))
+        Message(msgWarning, "Failed to re-insert disk:\n%s", szPath);
+
+    return true;
+}
+
 // Eject any inserted disk
 void CDrive::Eject ()
 {
@@ -277,7 +322,7 @@ BYTE CDrive::In (WORD wPort_)
             // SAM DICE relies on a strange error condition, which requires special handling
             else if (m_sRegs.bCommand == READ_ADDRESS)
             {
-                static int nBusyTimeout = 0;
+                static MACHINE_LOCAL int nBusyTimeout = 0;
 
                 // Clear busy after 16 polls of the status port
                 if (!(bRet & BUSY))
@@ -627,7 +672,7 @@ BYTE CDrive::ReadAddress (UINT uSide_, UINT uTrack_, IDFIELD* pIdField_)
 // CRC-CCITT for id/data checksums, with bit and byte order swapped
 WORD CDrive::CrcBlock (const void* pcv_, size_t uLen_, WORD wCRC_/*=0xffff*/)
 {
-    static WORD awCRC[256];
+    static MACHINE_LOCAL WORD awCRC[256];
 
     // Build the table if not already built
     if (!awCRC[1])
@@ -55,6 +55,9 @@ class CDrive : public CDiskDevice
         bool Save () { return (m_pDisk && m_pDisk->IsModified()) ? m_pDisk->Save() : true; }
         void Reset ();
 
+        void SaveState () const;
+        bool LoadState ();
+
     public:
         int GetDiskType () const { return m_pDisk ? m_pDisk->GetType() : dtNone; }
         const char* GetPath () const { return m_pDisk ? m_pDisk->GetPath() : ""; }
@@ -32,11 +32,11 @@
 
 // ToDo:
 //  - tidy things up a bit, particularly the register macros
-//  - general state saving (CPU registers already in a structure for it)
 
 #include "SimCoupe.h"
 
 #include "CPU.h"
+#include "Debug.h"
 #include "Display.h"
 #include "Frame.h"
 #include "GUI.h"
@@ -45,34 +45,58 @@
 #include "Memory.h"
 #include "Options.h"
 #include "Profile.h"
+#include "Rewind.h"
+#include "State.h"
+#include "Trap.h"
 #include "UI.h"
 #include "Util.h"
 
+#ifdef USE_HEADLESS
+#include "Z80Test.h"
+#endif
+
 
-#undef USE_FLAG_TABLES      // Experimental - disabled for now
+// USE_FLAG_TABLES (set by the makefile) looks up the arithmetic flags in about 320K of tables instead of
+// computing them.  That only pays off if the host's data cache can hold the hot parts, so measure first.
+// USE_BLOCK_CACHE (also set by the makefile) builds in the experimental decoded block cache described below,
+// which is slower than the interpreter, so it's left out by default.
+
+// The flag tables never change once built, so they're shared by every machine (see CPU::InitTables)
 
 // Look up table for the parity (and other common flags) for logical operations
 BYTE g_abParity[256];
 #define parity(a) (g_abParity[a])
 
 #ifdef USE_FLAG_TABLES
+// Flags for 8-bit arithmetic, indexed by (carry << 16) | (a << 8) | operand.  DAA gives the new AF,
+// indexed by (n << 10) | (h << 9) | (c << 8) | a.  Rotates and logical operations use the parity table.
 BYTE g_abInc[256], g_abDec[256];
+BYTE g_abAdd[2*0x10000], g_abSub[2*0x10000], g_abCp[0x10000];
+WORD g_awDaa[8*0x100];
 #endif
 
+static bool fTablesBuilt;
+
 
-#define a       regs.AF.B.h_
-#define f       regs.AF.B.l_
+// The hottest registers are reached through REG_xx, so ExecuteChunk can redirect them to locals
+#define REG_AF  regs.AF
+#define REG_HL  regs.HL
+#define REG_SP  regs.SP
+#define REG_PC  regs.PC
+
+#define a       REG_AF.B.h_
+#define f       REG_AF.B.l_
 #define b       regs.BC.B.h_
 #define c       regs.BC.B.l_
 #define d       regs.DE.B.h_
 #define e       regs.DE.B.l_
-#define h       regs.HL.B.h_
-#define l       regs.HL.B.l_
+#define h       REG_HL.B.h_
+#define l       REG_HL.B.l_
 
-#define af      regs.AF.W
+#define af      REG_AF.W
 #define bc      regs.BC.W
 #define de      regs.DE.W
-#define hl      regs.HL.W
+#define hl      REG_HL.W
 
 #define a1      regs.AF_.B.h_
 #define f1      regs.AF_.B.l_
@@ -90,15 +114,15 @@ BYTE g_abInc[256], g_abDec[256];
 
 #define ix      regs.IX.W
 #define iy      regs.IY.W
-#define sp      regs.SP.W
-#define pc      regs.PC.W
+#define sp      REG_SP.W
+#define pc      REG_PC.W
 
 #define ixh     regs.IX.B.h_
 #define ixl     regs.IX.B.l_
 #define iyh     regs.IY.B.h_
 #define iyl     regs.IY.B.l_
-#define sp_h    regs.SP.B.h_
-#define sp_l    regs.SP.B.l_
+#define sp_h    REG_SP.B.h_
+#define sp_l    REG_SP.B.l_
 
 #define r       regs.R
 #define i       regs.I          // This daft one means we can't use 'i' as a 'for' variable in this module!
@@ -127,7 +151,9 @@ inline void Mode2Interrupt ();
 //                  CPU can only access memory 1 out of every 8 T-States
 //              else
 //                  CPU can only access memory 1 out of every 4 T-States
-#define MEM_ACCESS(a)   ((g_nLineCycle += 3) |= (afContendedPages[VPAGE(a)]) ? pMemAccess[g_nLineCycle >> 6] : 0)
+// The contention is skipped entirely when the fContend_ template parameter in scope is false
+#define MEM_ACCESS(a)   MEM_ACCESS_AT(g_nLineCycle, a)
+#define MEM_ACCESS_AT(n,a)  (((n) += 3) |= (fContend_ && asSections[VPAGE(a)].fContended) ? pMemAccess[(n) >> 6] : 0)
 
 // Update g_nLineCycle for one port access
 // This is the basic four T-State CPU I/O access
@@ -137,60 +163,384 @@ inline void Mode2Interrupt ();
 #define PORT_ACCESS(a)  ((g_nLineCycle += 4) |= ((a) >= BASE_ASIC_PORT) ? 7 : 0)
 
 
-BYTE g_bOpcode;             // The currently executing or previously executed instruction
-int g_nLine;                // Scan line being generated (0 is the top of the generated display, not the main screen)
-int g_nLineCycle;           // Cycles so far in the current scanline
-int g_nPrevLineCycle;       // Cycles before current instruction began
+MACHINE_LOCAL BYTE g_bOpcode;             // The currently executing or previously executed instruction
+MACHINE_LOCAL int g_nLine;                // Scan line being generated (0 is the top of the generated display, not the main screen)
+MACHINE_LOCAL int g_nLineCycle;           // Cycles so far in the current scanline
+MACHINE_LOCAL int g_nPrevLineCycle;       // Cycles before current instruction began
 
-bool fReset, g_fBreak, g_fPaused, g_fTurbo;
-int g_nFastBooting;
+MACHINE_LOCAL bool fReset, g_fBreak, g_fPaused, g_fTurbo;
+MACHINE_LOCAL int g_nFastBooting;
 
-DWORD g_dwCycleCounter;     // Global cycle counter used for various timings
+MACHINE_LOCAL DWORD g_dwCycleCounter;     // Global cycle counter used for various timings
 
-bool fDelayedEI;            // Flag and counter to carry out a delayed EI
+MACHINE_LOCAL bool fDelayedEI;            // Flag and counter to carry out a delayed EI
 
 #ifdef _DEBUG
-bool g_fDebug;              // Debug only helper variable, to trigger the debugger when set
+MACHINE_LOCAL bool g_fDebug;              // Debug only helper variable, to trigger the debugger when set
 #endif
 
 // Memory access contention table
 const int MEM_ACCESS_LINE = TSTATES_PER_LINE >> 6;
-int aMemAccesses[10 * MEM_ACCESS_LINE], *pMemAccessBase, *pMemAccess, nMemAccessIndex;
-bool fMemContention;
+MACHINE_LOCAL int aMemAccesses[10 * MEM_ACCESS_LINE], *pMemAccessBase, *pMemAccess, nMemAccessIndex;
+MACHINE_LOCAL bool fMemContention;
 
 // Memory access tracking for the debugger
-BYTE *pbMemRead1, *pbMemRead2, *pbMemWrite1, *pbMemWrite2;
+MACHINE_LOCAL BYTE *pbMemRead1, *pbMemRead2, *pbMemWrite1, *pbMemWrite2;
 
-Z80Regs regs;
-DWORD radjust;
+MACHINE_LOCAL Z80Regs regs;
+MACHINE_LOCAL DWORD radjust;
 
-WORD* pHlIxIy, *pNewHlIxIy;
-CPU_EVENT   asCpuEvents[MAX_EVENTS], *psNextEvent, *psFreeEvent;
-DWORD dwLastTime, dwFPSTime;
+MACHINE_LOCAL WORD* pNewHlIxIy;
+MACHINE_LOCAL CPU_EVENT   asCpuEvents[evtCount], *psNextEvent;
+MACHINE_LOCAL DWORD dwNextEventTime, dwEventOrder;
+MACHINE_LOCAL DWORD dwLastTime, dwFPSTime;
 
 
-bool CPU::Init (bool fFirstInit_/*=false*/)
+#ifdef USE_BLOCK_CACHE
+// Straight-line runs of code are decoded once and kept, keyed on the physical address of their first
+// opcode, so the fetch can skip the memory read and the handler look-up.  Operands are still read as
+// normal by the instruction implementations, so only writes over the opcodes need to invalidate them.
+// Paging needs no special handling: the physical key selects the right blocks for whatever is paged in,
+// and port writes end a block so a paging change takes effect from the next instruction.
+//
+// Decoding is only a table look-up here and the contended fetch timing must still be applied to every
+// opcode, so the saving per instruction is small and the hash look-up at every branch outweighs it.
+// Measured on the headless benchmark: 10-20% slower at the idle startup screen, and no faster running BASIC.
+const int MAX_BLOCK_INSTRS = 32;    // Longest run of instructions in one block
+const int MAX_BLOCKS = 2048;        // Blocks cached before everything is flushed
+const int BLOCK_HASH_SIZE = 4096;   // Hash chains, indexed by the low bits of the code address
+
+typedef struct
 {
-    bool fRet = true;
+    const void* pvHandler;          // Implementation for the opcode
+    BYTE bOpcode;                   // Opcode byte, as the fetch would have seen it
+    BYTE bLength;                   // Full instruction length, to locate the next one
+}
+DECODED_INSTR;
 
-    // Power on initialisation requires some extra initialisation
-    if (fFirstInit_)
+typedef struct _DECODED_BLOCK
+{
+    const BYTE* pbCode;             // Physical address of the first opcode
+    int nInstrs;                    // Number of instructions, or zero once invalidated
+    struct _DECODED_BLOCK* psNext;  // Next block in the same hash chain
+
+    DECODED_INSTR asInstrs[MAX_BLOCK_INSTRS];
+}
+DECODED_BLOCK;
+
+MACHINE_LOCAL DECODED_BLOCK asBlocks[MAX_BLOCKS], *apsBlockHash[BLOCK_HASH_SIZE];
+MACHINE_LOCAL int nBlocks;
+
+// Bitmap of cached opcode locations for each physical page, with pages holding no code sharing an empty map
+MACHINE_LOCAL BYTE abNoCode[MEM_PAGE_SIZE >> 3], *apbCodeMaps[TOTAL_PAGES];
+
+
+// Discard all decoded blocks
+void CPU::InvalidateCode ()
+{
+    for (int n = 0 ; n < nBlocks ; n++)
+        asBlocks[n].nInstrs = 0;
+
+    nBlocks = 0;
+    memset(apsBlockHash, 0, sizeof apsBlockHash);
+
+    for (int n = 0 ; n < TOTAL_PAGES ; n++)
+    {
+        if (!apbCodeMaps[n])
+            apbCodeMaps[n] = abNoCode;
+        else if (apbCodeMaps[n] != abNoCode)
+            memset(apbCodeMaps[n], 0, MEM_PAGE_SIZE >> 3);
+    }
+}
+
+// Writes over a decoded opcode must discard the cached copy (ignoring writes to ROM or protected RAM)
+inline void check_code_write (WORD addr)
+{
+    UINT uOffset = addr & (MEM_PAGE_SIZE-1);
+
+    if ((apbCodeMaps[RPAGE(addr)][uOffset >> 3] & (1 << (uOffset & 7))) && phys_write_addr(addr) == phys_read_addr(addr))
+        CPU::InvalidateCode();
+}
+
+// Return the length of the instruction at pb_ (after any index prefix), and whether it must end a block
+static UINT DecodeLength (const BYTE* pb_, bool fIndexed_, bool& rfEnd_)
+{
+    BYTE bOp = pb_[0];
+
+    switch (bOp)
     {
-        // Build the parity lookup table (including other flags for logical operations)
-        for (int n = 0x00 ; n <= 0xff ; n++)
+        // Relative jumps, HALT, and the interrupt enable/disable look-back instructions
+        case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            rfEnd_ = true;
+            return 2;
+
+        case OP_HALT: case OP_DI: case OP_EI:
+            rfEnd_ = true;
+            return 1;
+
+        // Absolute jumps, calls and returns, and port access (which may change the paging)
+        case OP_JP: case OP_CALL:
+            rfEnd_ = true;
+            return 3;
+
+        case OP_RET: case OP_JPHL:
+            rfEnd_ = true;
+            return 1;
+
+        case 0xd3: case 0xdb:
+            rfEnd_ = true;
+            return 2;
+
+        // CB instructions have the index offset before the final opcode
+        case 0xcb:
+            return fIndexed_ ? 3 : 2;
+
+        case 0xed:
         {
-            BYTE b2 = n ^ (n >> 4);
-            b2 ^= (b2 << 2);
-            b2 = ~(b2 ^ (b2 >> 1)) & F_PARITY;
-            g_abParity[n] = (n & 0xa8) |    // S, 5, 3
-                            ((!n) << 6) |   // Z
-                            b2;             // P
+            BYTE bOp2 = pb_[1];
 
-#ifdef USE_FLAG_TABLES
-            g_abInc[n] = (n & 0xa8) | ((!n) << 6) | ((!( n & 0xf)) << 4) | ((n == 0x80) << 2);
-            g_abDec[n] = (n & 0xa8) | ((!n) << 6) | ((!(~n & 0xf)) << 4) | ((n == 0x7f) << 2) | F_NADD;
+            // Block instructions, port access and returns end the block
+            rfEnd_ = (bOp2 >= 0xa0) || ((bOp2 & 0xc6) == 0x40) || ((bOp2 & 0xc7) == 0x45);
+            return ((bOp2 & 0xc7) == 0x43) ? 4 : 2;
+        }
+
+        // (ix+d) forms of the INC/DEC/LD (hl) instructions
+        case 0x34: case 0x35:
+            return fIndexed_ ? 2 : 1;
+
+        case 0x36:
+            return fIndexed_ ? 3 : 2;
+
+        case 0x22: case 0x2a: case 0x32: case 0x3a:
+            return 3;
+    }
+
+    switch (bOp & 0xc7)
+    {
+        // Conditional returns, jumps, calls and restarts
+        case 0xc0: case 0xc7:
+            rfEnd_ = true;
+            return 1;
+
+        case 0xc2: case 0xc4:
+            rfEnd_ = true;
+            return 3;
+
+        // LD r,n and ALU n
+        case 0x06: case 0xc6:
+            return 2;
+
+        // ALU (hl)
+        case 0x86:
+            return fIndexed_ ? 2 : 1;
+    }
+
+    // LD rr,nn
+    if ((bOp & 0xcf) == 0x01)
+        return 3;
+
+    // LD r,(hl) and LD (hl),r
+    if ((bOp & 0xc0) == 0x40 && (((bOp & 0x07) == 0x06) || ((bOp & 0x38) == 0x30)))
+        return fIndexed_ ? 2 : 1;
+
+    return 1;
+}
+
+// Decode a block starting at the given physical code address, returning NULL if nothing could be decoded.
+// Instructions after an index prefix take their handlers from the IX or IY table.
+static DECODED_BLOCK* DecodeBlock (WORD wAddr_, const void* const* ppvHandlers_, const void* const* ppvIxHandlers_,
+                                   const void* const* ppvIyHandlers_)
+{
+    if (nBlocks == MAX_BLOCKS)
+        CPU::InvalidateCode();
+
+    const BYTE* pbPage = asSections[VPAGE(wAddr_)].pbRead;
+    BYTE*& rpbMap = apbCodeMaps[RPAGE(wAddr_)];
+    UINT uOffset = wAddr_ & (MEM_PAGE_SIZE-1);
+
+    DECODED_BLOCK* ps = &asBlocks[nBlocks];
+    ps->pbCode = pbPage + uOffset;
+    ps->nInstrs = 0;
+
+    // Blocks are limited to a single page, as the next page may not be contiguous
+    const void* const* ppvTable = ppvHandlers_;
+    for (bool fIndexed = false, fEnd = false ; !fEnd && ps->nInstrs < MAX_BLOCK_INSTRS && uOffset < MEM_PAGE_SIZE-1 ; )
+    {
+        BYTE bOp = pbPage[uOffset];
+        bool fPrefix = (bOp == IX_PREFIX || bOp == IY_PREFIX);
+        UINT uLen = fPrefix ? 1 : DecodeLength(pbPage + uOffset, fIndexed, fEnd);
+
+        if (uOffset + uLen > MEM_PAGE_SIZE)
+            break;
+
+        // Pages without code share an empty map until their first block is decoded
+        if (rpbMap == abNoCode)
+            memset(rpbMap = new BYTE[MEM_PAGE_SIZE >> 3], 0, MEM_PAGE_SIZE >> 3);
+
+        DECODED_INSTR* psInstr = &ps->asInstrs[ps->nInstrs++];
+        psInstr->pvHandler = ppvTable[bOp];
+        psInstr->bOpcode = bOp;
+        psInstr->bLength = uLen;
+
+        // Flag the opcode byte, and the second opcode byte of CB and ED instructions
+        rpbMap[uOffset >> 3] |= 1 << (uOffset & 7);
+        if (bOp == 0xed || (bOp == 0xcb && !fIndexed))
+            rpbMap[(uOffset+1) >> 3] |= 1 << ((uOffset+1) & 7);
+        else if (bOp == 0xcb)
+            rpbMap[(uOffset+2) >> 3] |= 1 << ((uOffset+2) & 7);
+
+        uOffset += uLen;
+        fIndexed = fPrefix;
+        ppvTable = (bOp == IX_PREFIX) ? ppvIxHandlers_ : (bOp == IY_PREFIX) ? ppvIyHandlers_ : ppvHandlers_;
+    }
+
+    if (!ps->nInstrs)
+        return NULL;
+
+    UINT uHash = static_cast<UINT>(reinterpret_cast<size_t>(ps->pbCode)) & (BLOCK_HASH_SIZE-1);
+    ps->psNext = apsBlockHash[uHash];
+    apsBlockHash[uHash] = ps;
+    nBlocks++;
+
+    return ps;
+}
+
+// Find the decoded block for the given address, decoding it if it's not already cached
+inline DECODED_BLOCK* LookupBlock (WORD wAddr_, const void* const* ppvHandlers_, const void* const* ppvIxHandlers_,
+                                   const void* const* ppvIyHandlers_)
+{
+    const BYTE* pbCode = phys_read_addr(wAddr_);
+    DECODED_BLOCK* ps = apsBlockHash[static_cast<UINT>(reinterpret_cast<size_t>(pbCode)) & (BLOCK_HASH_SIZE-1)];
+
+    while (ps && ps->pbCode != pbCode)
+        ps = ps->psNext;
+
+    return ps ? ps : DecodeBlock(wAddr_, ppvHandlers_, ppvIxHandlers_, ppvIyHandlers_);
+}
+#else
+void CPU::InvalidateCode () { }
+inline void check_code_write (WORD addr) { }
 #endif
+
+
+#ifdef USE_FLAG_TABLES
+static void BuildFlagTables ()
+{
+    for (int nA = 0x00 ; nA <= 0xff ; nA++)
+    {
+        for (int nZ = 0x00 ; nZ <= 0xff ; nZ++)
+        {
+            for (int nC = 0 ; nC <= 1 ; nC++)
+            {
+                int nIndex = (nC << 16) | (nA << 8) | nZ;
+
+                WORD y = nA + nZ + nC;
+                g_abAdd[nIndex] = ((y & 0xb8) ^ ((nA ^ nZ) & 0x10)) |      // S, 5, H, 3
+                                  (y >> 8) |                                // C
+                                  (((nA ^ ~nZ) & (nA ^ y) & 0x80) >> 5) |   // V
+                                  ((!(y & 0xff)) << 6);                     // Z
+
+                y = nA - nZ - nC;
+                g_abSub[nIndex] = ((y & 0xb8) ^ ((nA ^ nZ) & 0x10)) |      // S, 5, H, 3
+                                  ((y >> 8) & 1) |                          // C
+                                  (((nA ^ nZ) & (nA ^ y) & 0x80) >> 5) |    // V
+                                  F_NADD |                                  // N
+                                  ((!(y & 0xff)) << 6);                     // Z
+            }
+
+            WORD y = nA - nZ;
+            g_abCp[(nA << 8) | nZ] = ((y & 0x90) ^ ((nA ^ nZ) & 0x10)) |   // S, H
+                                     (nZ & 0x28) |                          // 5, 3
+                                     ((y >> 8) & 1) |                       // C
+                                     (((nA ^ nZ) & (nA ^ y) & 0x80) >> 5) | // V
+                                     F_NADD |                               // N
+                                     ((!y) << 6);                           // Z
+        }
+
+        // DAA for each combination of the N, H and C flags it depends on
+        for (int nFlags = 0 ; nFlags < 8 ; nFlags++)
+        {
+            BYTE bF = ((nFlags & 4) ? F_NADD : 0) | ((nFlags & 2) ? F_HCARRY : 0) | ((nFlags & 1) ? F_CARRY : 0);
+            BYTE bCarry = bF & F_CARRY, bIncr = 0;
+            WORD wAcc = nA;
+
+            if ((bF & F_HCARRY) || (nA & 0x0f) > 9)
+                bIncr = 6;
+
+            if (bF & F_NADD)
+            {
+                int hd = bCarry || nA > 0x99;
+
+                if (bIncr)
+                {
+                    wAcc = (wAcc - bIncr) & 0xff;
+
+                    if ((nA & 0x0f) > 5)
+                        bF &= ~F_HCARRY;
+                }
+
+                if (hd)
+                    wAcc -= 0x160;
+            }
+            else
+            {
+                if (bIncr)
+                {
+                    bF = (bF & ~F_HCARRY) | (((nA & 0x0f) > 9) ? F_HCARRY : 0);
+                    wAcc += bIncr;
+                }
+
+                if (bCarry || ((wAcc & 0x1f0) > 0x90))
+                    wAcc += 0x60;
+            }
+
+            BYTE bA = wAcc;
+            bF = (bA & 0xa8) | (!bA << 6) | (bF & 0x12) | (parity(bA) & F_PARITY) | bCarry | !!(wAcc & 0x100);
+            g_awDaa[(nFlags << 8) | nA] = (bA << 8) | bF;
         }
+    }
+}
+#endif
+
+// Build the lookup tables shared by all machines, which must be done before a second machine thread starts
+void CPU::InitTables ()
+{
+    if (fTablesBuilt)
+        return;
+
+    // Build the parity lookup table (including other flags for logical operations)
+    for (int n = 0x00 ; n <= 0xff ; n++)
+    {
+        BYTE b2 = n ^ (n >> 4);
+        b2 ^= (b2 << 2);
+        b2 = ~(b2 ^ (b2 >> 1)) & F_PARITY;
+        g_abParity[n] = (n & 0xa8) |    // S, 5, 3
+                        ((!n) << 6) |   // Z
+                        b2;             // P
+
+#ifdef USE_FLAG_TABLES
+        g_abInc[n] = (n & 0xa8) | ((!n) << 6) | ((!( n & 0xf)) << 4) | ((n == 0x80) << 2);
+        g_abDec[n] = (n & 0xa8) | ((!n) << 6) | ((!(~n & 0xf)) << 4) | ((n == 0x7f) << 2) | F_NADD;
+#endif
+    }
+
+#ifdef USE_FLAG_TABLES
+    // The remaining tables use the same calculations as the computed versions in Z80ops.h
+    BuildFlagTables();
+#endif
+
+    fTablesBuilt = true;
+}
+
+bool CPU::Init (bool fFirstInit_/*=false*/)
+{
+    bool fRet = true;
+
+    // Power on initialisation requires some extra initialisation
+    if (fFirstInit_)
+    {
+        // The first machine builds the shared tables
+        InitTables();
 
         // Perform some initial tests to confirm the emulator is functioning correctly!
         InitTests();
@@ -241,6 +591,17 @@ bool CPU::Init (bool fFirstInit_/*=false*/)
 
 void CPU::Exit (bool fReInit_/*=false*/)
 {
+#ifdef USE_BLOCK_CACHE
+    // Free the opcode maps for pages that have held decoded code
+    for (int n = 0 ; n < TOTAL_PAGES ; n++)
+    {
+        if (apbCodeMaps[n] != abNoCode)
+            delete[] apbCodeMaps[n];
+
+        apbCodeMaps[n] = NULL;
+    }
+#endif
+
     IO::Exit(fReInit_);
     Memory::Exit(fReInit_);
 }
@@ -261,190 +622,1060 @@ void CPU::UpdateContention ()
 }
 
 
+
+// The timed memory helpers take the line cycle counter by reference, so they work
+// on the cached copy inside ExecuteChunk and the global one everywhere else.  They're
+// instantiated with and without recording the accesses for the debugger (fTrack_), and
+// with and without memory contention (fContend_), to match the core using them.
+#define TRACK_ACCESS(p,v)   (fTrack_ ? ((p) = (v)) : (v))
+
 // Read an instruction byte and update timing
-inline BYTE timed_read_code_byte (WORD addr)
+template <bool fTrack_, bool fContend_>
+inline BYTE timed_read_code_byte_ (WORD addr, int& rnLineCycle_)
 {
-    MEM_ACCESS(addr);
+    MEM_ACCESS_AT(rnLineCycle_, addr);
     return read_byte(addr);
 }
 
 // Read a data byte and update timing
-inline BYTE timed_read_byte (WORD addr)
+template <bool fTrack_, bool fContend_>
+inline BYTE timed_read_byte_ (WORD addr, int& rnLineCycle_)
 {
-    MEM_ACCESS(addr);
-    return *(pbMemRead1 = phys_read_addr(addr));
+    MEM_ACCESS_AT(rnLineCycle_, addr);
+    return *TRACK_ACCESS(pbMemRead1, phys_read_addr(addr));
 }
 
 // Read an instruction word and update timing
-inline WORD timed_read_code_word (WORD addr)
+template <bool fTrack_, bool fContend_>
+inline WORD timed_read_code_word_ (WORD addr, int& rnLineCycle_)
 {
-    MEM_ACCESS(addr);
-    MEM_ACCESS(addr + 1);
+    MEM_ACCESS_AT(rnLineCycle_, addr);
+    MEM_ACCESS_AT(rnLineCycle_, addr + 1);
     return read_word(addr);
 }
 
 // Read a data word and update timing
-inline WORD timed_read_word (WORD addr)
+template <bool fTrack_, bool fContend_>
+inline WORD timed_read_word_ (WORD addr, int& rnLineCycle_)
 {
-    MEM_ACCESS(addr);
-    MEM_ACCESS(addr + 1);
-    return *(pbMemRead1 = phys_read_addr(addr)) | (*(pbMemRead2 = phys_read_addr(addr + 1)) << 8);
+    MEM_ACCESS_AT(rnLineCycle_, addr);
+    MEM_ACCESS_AT(rnLineCycle_, addr + 1);
+    return *TRACK_ACCESS(pbMemRead1, phys_read_addr(addr)) | (*TRACK_ACCESS(pbMemRead2, phys_read_addr(addr + 1)) << 8);
 }
 
-// Write a byte and update timing
-inline void timed_write_byte (WORD addr, BYTE contents)
+// Check for a display write, which may need the frame drawn up to the current raster position
+inline void timed_video_write (WORD addr, int nLineCycle_)
 {
-    MEM_ACCESS(addr);
+    g_nLineCycle = nLineCycle_;
     check_video_write(addr);
-    *(pbMemWrite1 = phys_write_addr(addr)) = contents;
+}
+
+// Write a byte and update timing
+template <bool fTrack_, bool fContend_>
+inline void timed_write_byte_ (WORD addr, BYTE contents, int& rnLineCycle_)
+{
+    MEM_ACCESS_AT(rnLineCycle_, addr);
+    timed_video_write(addr, rnLineCycle_);
+    check_code_write(addr);
+    track_write(addr);
+    *TRACK_ACCESS(pbMemWrite1, phys_write_addr(addr)) = contents;
 }
 
 // Write a word and update timing
-inline void timed_write_word (WORD addr, WORD contents)
+template <bool fTrack_, bool fContend_>
+inline void timed_write_word_ (WORD addr, WORD contents, int& rnLineCycle_)
 {
-    MEM_ACCESS(addr);
-    check_video_write(addr);
-    *(pbMemWrite1 = phys_write_addr(addr)) = contents & 0xff;
-    MEM_ACCESS(addr + 1);
-    check_video_write(addr + 1);
-    *(pbMemWrite2 = phys_write_addr(addr + 1)) = contents >> 8;
+    MEM_ACCESS_AT(rnLineCycle_, addr);
+    timed_video_write(addr, rnLineCycle_);
+    check_code_write(addr);
+    track_write(addr);
+    *TRACK_ACCESS(pbMemWrite1, phys_write_addr(addr)) = contents & 0xff;
+    MEM_ACCESS_AT(rnLineCycle_, addr + 1);
+    timed_video_write(addr + 1, rnLineCycle_);
+    check_code_write(addr + 1);
+    track_write(addr + 1);
+    *TRACK_ACCESS(pbMemWrite2, phys_write_addr(addr + 1)) = contents >> 8;
 }
 
 // Write a word and update timing (high-byte first - used by stack functions)
-inline void timed_write_word_reversed (WORD addr, WORD contents)
+template <bool fTrack_, bool fContend_>
+inline void timed_write_word_reversed_ (WORD addr, WORD contents, int& rnLineCycle_)
 {
-    MEM_ACCESS(addr + 1);
-    check_video_write(addr + 1);
-    *(pbMemWrite2 = phys_write_addr(addr + 1)) = contents >> 8;
-    MEM_ACCESS(addr);
-    check_video_write(addr);
-    *(pbMemWrite1 = phys_write_addr(addr)) = contents & 0xff;
+    MEM_ACCESS_AT(rnLineCycle_, addr + 1);
+    timed_video_write(addr + 1, rnLineCycle_);
+    check_code_write(addr + 1);
+    track_write(addr + 1);
+    *TRACK_ACCESS(pbMemWrite2, phys_write_addr(addr + 1)) = contents >> 8;
+    MEM_ACCESS_AT(rnLineCycle_, addr);
+    timed_video_write(addr, rnLineCycle_);
+    check_code_write(addr);
+    track_write(addr);
+    *TRACK_ACCESS(pbMemWrite1, phys_write_addr(addr)) = contents & 0xff;
 }
 
+// Code outside the core always tracks accesses and applies contention
+#define ACCESS_MODE     true, true
+
+#define timed_read_code_byte(addr)      timed_read_code_byte_<ACCESS_MODE>((addr), g_nLineCycle)
+#define timed_read_byte(addr)           timed_read_byte_<ACCESS_MODE>((addr), g_nLineCycle)
+#define timed_read_code_word(addr)      timed_read_code_word_<ACCESS_MODE>((addr), g_nLineCycle)
+#define timed_read_word(addr)           timed_read_word_<ACCESS_MODE>((addr), g_nLineCycle)
+#define timed_write_byte(addr,val)      timed_write_byte_<ACCESS_MODE>((addr), (val), g_nLineCycle)
+#define timed_write_word(addr,val)      timed_write_word_<ACCESS_MODE>((addr), (val), g_nLineCycle)
+#define timed_write_word_reversed(addr,val) timed_write_word_reversed_<ACCESS_MODE>((addr), (val), g_nLineCycle)
+
 // 16-bit push and pop
 #define push(val)   ( sp -= 2, timed_write_word_reversed(sp,val) )
 #define pop(var)    ( var = timed_read_word(sp), sp += 2 )
 
 
-// Execute the CPU event specified
-void CPU::ExecuteEvent (CPU_EVENT sThisEvent)
+// Fast-forward through repeats of a HALT or a recognised memory polling loop starting at wLoop_, up to just
+// short of the next event.  The loops only read memory, and A and the flags are set from what's read, so
+// nothing can change what they see before an event runs.  The caller gives the number of instructions run
+// since the previous pass began, which must be exactly one pass: an interrupt part way through may have
+// changed the memory after it was read, so the following pass could leave a different state.
+// Each skipped pass still applies the same memory accesses, so contention and the R register are exact.
+template <bool fContend_>
+void SkipIdleLoop (WORD wLoop_, WORD wHL_, DWORD dwPassInstrs_, int& rnLineCycle_, int nEventCycle_, DWORD& rdwRadjust_)
 {
-    switch (sThisEvent.nEvent)
+    WORD awAccesses[8];     // Address of each memory access made by a single pass
+    BYTE abExtra[8];        // T-states added after each access
+    int nAccesses = 0, nInstrs;
+
+#define IDLE_ACCESS(addr,extra)     ( awAccesses[nAccesses] = (addr), abExtra[nAccesses++] = (extra) )
+
+    BYTE bOp = read_byte(wLoop_), bOp2 = read_byte(wLoop_+1), bOp3 = read_byte(wLoop_+2);
+
+    // halt
+    if (bOp == OP_HALT)
     {
-        case evtStdIntStart :
-            // Check for a LINE interrupt on the following line
-            if ((line_int < SCREEN_LINES) && (g_nLine == (line_int + TOP_BORDER_LINES - 1)))
-            {
-                // Signal the LINE interrupt, and start the interrupt counter
-                status_reg &= ~STATUS_INT_LINE;
-                AddCpuEvent(evtStdIntEnd, sThisEvent.dwTime + INT_ACTIVE_TIME);
-            }
-            // Check for a FRAME interrupt on the last line
-            else if (g_nLine == (HEIGHT_LINES - 1))
-            {
-                // Signal a FRAME interrupt, and start the interrupt counter
-                status_reg &= ~STATUS_INT_FRAME;
-                AddCpuEvent(evtStdIntEnd, sThisEvent.dwTime + INT_ACTIVE_TIME);
-            }
-            break;
+        IDLE_ACCESS(wLoop_, 1);
+        nInstrs = 1;
+    }
 
-        case evtStdIntEnd :
-            // Reset the interrupt as we're done
-            status_reg |= (STATUS_INT_FRAME | STATUS_INT_LINE);
-            break;
+    // loop: jr z|nz,loop
+    else if ((bOp == 0x20 || bOp == 0x28) && bOp2 == 0xfe)
+    {
+        IDLE_ACCESS(wLoop_, 1);
+        IDLE_ACCESS(wLoop_+1, 5);
+        nInstrs = 1;
+    }
 
-        case evtMidiOutIntStart :
-            // Begin the MIDI_OUT interrupt and add an event to end it
-            status_reg &= ~STATUS_INT_MIDIOUT;
-            AddCpuEvent(evtMidiOutIntEnd, sThisEvent.dwTime + MIDI_INT_ACTIVE_TIME);
-            break;
+    // loop: cp (hl) ; jr z|nz,loop
+    else if (bOp == 0xbe && (bOp2 == 0x20 || bOp2 == 0x28) && bOp3 == 0xfd)
+    {
+        IDLE_ACCESS(wLoop_, 1);
+        IDLE_ACCESS(wHL_, 0);
+        IDLE_ACCESS(wLoop_+1, 1);
+        IDLE_ACCESS(wLoop_+2, 5);
+        nInstrs = 2;
+    }
 
-        case evtMidiOutIntEnd :
-            // Reset the interrupt and clear the 'transmitting' bit in LPEN as we're done
-            status_reg |= STATUS_INT_MIDIOUT;
-            lpen &= ~LPEN_TXFMST;
-            break;
+    // loop: ld a,(hl) ; and a|or a ; jr z|nz,loop
+    else if (bOp == 0x7e && (bOp2 == 0xa7 || bOp2 == 0xb7) && (bOp3 == 0x20 || bOp3 == 0x28) && read_byte(wLoop_+3) == 0xfc)
+    {
+        IDLE_ACCESS(wLoop_, 1);
+        IDLE_ACCESS(wHL_, 0);
+        IDLE_ACCESS(wLoop_+1, 1);
+        IDLE_ACCESS(wLoop_+2, 1);
+        IDLE_ACCESS(wLoop_+3, 5);
+        nInstrs = 3;
+    }
 
-        case evtEndOfLine :
-            // Subtract a line's worth of cycles and move to the next line down
-            g_nPrevLineCycle -= TSTATES_PER_LINE;
-            g_nLineCycle -= TSTATES_PER_LINE;
-            g_nLine++;
-            // Add an event for the next line
-            AddCpuEvent(evtEndOfLine, sThisEvent.dwTime + TSTATES_PER_LINE);
+    // loop: ld a,(nn) ; and a|or a ; jr z|nz,loop
+    else if (bOp == 0x3a && (read_byte(wLoop_+3) == 0xa7 || read_byte(wLoop_+3) == 0xb7) &&
+            (read_byte(wLoop_+4) == 0x20 || read_byte(wLoop_+4) == 0x28) && read_byte(wLoop_+5) == 0xfa)
+    {
+        IDLE_ACCESS(wLoop_, 1);
+        IDLE_ACCESS(wLoop_+1, 0);
+        IDLE_ACCESS(wLoop_+2, 0);
+        IDLE_ACCESS(bOp2 | (bOp3 << 8), 0);
+        IDLE_ACCESS(wLoop_+3, 1);
+        IDLE_ACCESS(wLoop_+4, 1);
+        IDLE_ACCESS(wLoop_+5, 5);
+        nInstrs = 3;
+    }
 
-            // If we're at the end of the frame, signal it
-            if (g_nLine >= HEIGHT_LINES)
-                g_fBreak = true;
-            else
-            {
-                // Work out if we're in a vertical part of the screen that may be affected by contention
-                nMemAccessIndex = MEM_ACCESS_LINE * (
-                    (((g_nLine >= TOP_BORDER_LINES) && (g_nLine < TOP_BORDER_LINES + SCREEN_LINES)) ? 2 : 0) +
-                    ((g_nLine == TOP_BORDER_LINES - 1) || (g_nLine == TOP_BORDER_LINES + SCREEN_LINES - 1))
-                );
-                SetContention();
+    // Anything else must run normally
+    else
+        return;
 
-                // Are we on a line that may potentially require an interrupt at the start of the right border?
-                if (((g_nLine >= (TOP_BORDER_LINES - 1)) && (g_nLine < (TOP_BORDER_LINES - 1 + SCREEN_LINES))) ||
-                    (g_nLine == (HEIGHT_LINES - 1)))
-                {
-                    // Add an event to check for LINE/FRAME interrupts
-                    AddCpuEvent(evtStdIntStart, sThisEvent.dwTime + INT_START_TIME);
-                }
-            }
+#undef IDLE_ACCESS
 
-            break;
+    // Only skip if the last pass ran uninterrupted
+    if (dwPassInstrs_ != static_cast<DWORD>(nInstrs))
+        return;
 
-        case evtInputUpdate :
-            // Update the input in the centre of the screen (well away from the frame boundary) to avoid the ROM
-            // keyboard scanner discarding key presses when it thinks keys have bounced.  In old versions this was
-            // the cause of the first key press on the boot screen only clearing it (took AGES to track down!)
-            IO::UpdateInput();
+    // Skip whole passes that finish before the next event is due, leaving the interpreter to run the last
+    for (int nLineCycle ; ; rnLineCycle_ = nLineCycle, rdwRadjust_ += nInstrs)
+    {
+        nLineCycle = rnLineCycle_;
 
-            // Schedule the next input check at the same time in the next frame
-            AddCpuEvent(evtInputUpdate, sThisEvent.dwTime + TSTATES_PER_FRAME);
+        for (int n = 0 ; n < nAccesses ; n++)
+        {
+            MEM_ACCESS_AT(nLineCycle, awAccesses[n]);
+            nLineCycle += abExtra[n];
+        }
+
+        if (nLineCycle >= nEventCycle_)
             break;
     }
 }
 
 
-// Execute until the end of a frame, or a breakpoint, whichever comes first
-void CPU::ExecuteChunk ()
+
+
+// Run further passes of a repeating LDIR (nStep_=1) or LDDR (nStep_=-1) in one go, for those starting before the
+// next event.  Each pass has the same fetch and memory timings as the interpreter, but the bytes are moved as a
+// block, and only checked for display changes one at a time if the raster is in the area they could affect.
+// The caller has run the first pass normally, leaving PC on the instruction, and no interrupt can be taken.
+template <bool fContend_>
+void BlockLoad (int nStep_, WORD& rwPC_, WORD& rwHL_, int& rnLineCycle_, int nEventCycle_, DWORD& rdwRadjust_, BYTE bA_, BYTE& rbF_)
 {
-    __label__ 
-op_0000,
-op_0001,
-op_0002,
-op_0003,
-op_0004,
-op_0005,
-op_0006,
-op_0007,
-op_0010,
-op_0011,
-op_0012,
-op_0013,
-op_0014,
-op_0015,
-op_0016,
-op_0017,
-op_0020,
-op_0021,
-op_0022,
-op_0023,
-op_0024,
-op_0025,
-op_0026,
-op_0027,
-op_0030,
-op_0031,
-op_0032,
-op_0033,
-op_0034,
-op_0035,
-op_0036,
-op_0037,
+    WORD wPC = rwPC_, wSrc = rwHL_, wDst = de;
+    UINT uSrc = wSrc & (MEM_PAGE_SIZE-1), uDst = wDst & (MEM_PAGE_SIZE-1), uMax = bc;
+
+    // Stay within the current sections, so the source and destination are contiguous
+    if (nStep_ > 0)
+        uMax = min(uMax, min(MEM_PAGE_SIZE - uSrc, MEM_PAGE_SIZE - uDst));
+    else
+        uMax = min(uMax, min(uSrc + 1, uDst + 1));
+
+    BYTE *pbSrc = phys_read_addr(wSrc), *pbDst = phys_write_addr(wDst);
+
+    // Stop short of overwriting the instruction itself, which would change what the next pass runs
+    for (int n = 0 ; n < 2 ; n++)
+    {
+        BYTE* pbCode = phys_read_addr(wPC + n);
+        UINT uOffset = static_cast<UINT>((pbCode - pbDst) * nStep_);
+
+        if (uOffset < uMax)
+            uMax = uOffset;
+    }
+
+    if (!uMax)
+        return;
+
+    // Display writes only need checking individually if the frame may need drawing part way through
+    WORD wLow = (nStep_ > 0) ? wDst : wDst - (uMax - 1);
+    bool fVideo = check_video_range(wLow, uMax);
+
+    // Blocks that might be written are noted for the rewind buffer up front, which is harmless if they aren't
+    track_write_range(wLow, uMax);
+
+    int nLineCycle = rnLineCycle_;
+    UINT uPasses = 0;
+
+    // Each pass is the ED and opcode fetches (one extra T-state each), the read and write, then 2 more, with
+    // the 5 T-states for the repeat unless it's the last pass of the instruction
+    while (uPasses < uMax && nLineCycle < nEventCycle_)
+    {
+        MEM_ACCESS_AT(nLineCycle, wPC);
+        nLineCycle++;
+        MEM_ACCESS_AT(nLineCycle, wPC + 1);
+        nLineCycle++;
+        MEM_ACCESS_AT(nLineCycle, wSrc);
+        MEM_ACCESS_AT(nLineCycle, wDst);
+
+        if (fVideo)
+        {
+            int nOffset = static_cast<int>(uPasses) * nStep_;
+            timed_video_write(wDst + nOffset, nLineCycle);
+            pbDst[nOffset] = pbSrc[nOffset];
+        }
+
+        nLineCycle += (++uPasses == bc) ? 2 : 7;
+    }
+
+    int nLast = static_cast<int>(uPasses - 1) * nStep_;
+
+    if (!fVideo)
+    {
+        // Work from the lowest address of each range
+        BYTE *pbFrom = pbSrc + min(nLast, 0), *pbTo = pbDst + min(nLast, 0);
+
+        // A destination one byte on from the source fills with the first byte, as used for clearing memory
+        if (pbDst == pbSrc + nStep_)
+            memset(pbTo, *pbSrc, uPasses);
+        else if (pbTo + uPasses <= pbFrom || pbFrom + uPasses <= pbTo)
+            memcpy(pbTo, pbFrom, uPasses);
+        else
+        {
+            for (int n = 0 ; n != nLast + nStep_ ; n += nStep_)
+                pbDst[n] = pbSrc[n];
+        }
+    }
+
+    for (UINT u = 0 ; u < uPasses ; u++)
+        check_code_write(wDst + static_cast<int>(u) * nStep_);
+
+    // Leave the state as the last pass would have done
+    BYTE bX = pbDst[nLast] + bA_;
+
+    rwHL_ = wSrc + static_cast<int>(uPasses) * nStep_;
+    de = wDst + static_cast<int>(uPasses) * nStep_;
+    bc -= uPasses;
+    rbF_ = (rbF_ & 0xc1) | (bX & 0x08) | ((bX & 0x02) << 4) | ((bc != 0) << 2);
+
+    rnLineCycle_ = nLineCycle;
+    rdwRadjust_ += uPasses << 1;
+
+    // Move past the instruction if it completed
+    if (!bc)
+        rwPC_ += 2;
+}
+
+// Run further passes of a repeating CPIR (nStep_=1) or CPDR (nStep_=-1) in one go, on the same terms as BlockLoad
+template <bool fContend_>
+void BlockCompare (int nStep_, WORD& rwPC_, WORD& rwHL_, int& rnLineCycle_, int nEventCycle_, DWORD& rdwRadjust_, BYTE bA_, BYTE& rbF_)
+{
+    WORD wPC = rwPC_, wSrc = rwHL_;
+    UINT uSrc = wSrc & (MEM_PAGE_SIZE-1), uMax = min(static_cast<UINT>(bc), (nStep_ > 0) ? MEM_PAGE_SIZE - uSrc : uSrc + 1);
+    BYTE* pbSrc = phys_read_addr(wSrc);
+
+    // The search ends on the first match
+    if (nStep_ > 0)
+    {
+        BYTE* pbMatch = reinterpret_cast<BYTE*>(memchr(pbSrc, bA_, uMax));
+        if (pbMatch)
+            uMax = pbMatch - pbSrc + 1;
+    }
+    else
+    {
+        for (UINT u = 0 ; u < uMax ; u++)
+        {
+            if (pbSrc[-static_cast<int>(u)] == bA_)
+            {
+                uMax = u + 1;
+                break;
+            }
+        }
+    }
+
+    int nLineCycle = rnLineCycle_;
+    UINT uPasses = 0;
+    BYTE bX = 0;
+
+    // Each pass is the ED and opcode fetches (one extra T-state each), the read and 2 more, then 5 if it repeats
+    while (uPasses < uMax && nLineCycle < nEventCycle_)
+    {
+        MEM_ACCESS_AT(nLineCycle, wPC);
+        nLineCycle++;
+        MEM_ACCESS_AT(nLineCycle, wPC + 1);
+        nLineCycle++;
+        MEM_ACCESS_AT(nLineCycle, wSrc);
+
+        bX = pbSrc[static_cast<int>(uPasses) * nStep_];
+        nLineCycle += (++uPasses == bc || bX == bA_) ? 2 : 7;
+    }
+
+    rwHL_ = wSrc + static_cast<int>(uPasses) * nStep_;
+    bc -= uPasses;
+
+    // Flags as for cpi/cpd on the last pass
+    BYTE bSum = bA_ - bX, bZ = bA_ ^ bX ^ bSum;
+    rbF_ = (bSum & 0x80) | (!bSum << 6) | (((bSum - ((bZ&0x10)>>4)) & 2) << 4) | (bZ & 0x10) | ((bSum - ((bZ >> 4) & 1)) & 8) |
+           ((bc != 0) << 2) | F_NADD | (rbF_ & F_CARRY);
+    if ((bSum & 15) == 8 && (bZ & 16) != 0)
+        rbF_ &= ~8;
+
+    rnLineCycle_ = nLineCycle;
+    rdwRadjust_ += uPasses << 1;
+
+    // Move past the instruction if it completed
+    if (!bc || bX == bA_)
+        rwPC_ += 2;
+}
+
+
+// Native versions of the ROM routines found by Trap.cpp.  Each takes over at the head of a loop and runs the
+// same instructions with the same memory and port accesses and timings, stopping after the first instruction
+// that reaches the next event, just as the main loop would check it, or when the loop is left.  The state is
+// live in the globals, and the ROM code itself is never contended, so each instruction's fetches and internal
+// cycles are added as a fixed amount before its data accesses.  Native runs are only started when no interrupt
+// can be taken, and nothing here can raise one, except events run by port reads which are stopped on too.
+
+// Flags for 8-bit increment and decrement, as given by the core
+inline BYTE IncFlags (BYTE bVal_) { return (bVal_ & 0xa8) | ((!bVal_) << 6) | ((!(bVal_ & 0xf)) << 4) | ((bVal_ == 0x80) << 2); }
+inline BYTE DecFlags (BYTE bVal_) { return (bVal_ & 0xa8) | ((!bVal_) << 6) | ((!(~bVal_ & 0xf)) << 4) | ((bVal_ == 0x7f) << 2) | F_NADD; }
+
+// Complete an instruction that advanced R by nR_, stopping at the next one (wNext_) if an event is due
+#define trap_next(nR_,wNext_)   do { \
+                                    radjust += (nR_); \
+                                    if (nLineCycle >= nEventCycle_) { pc = (wNext_); goto lab_stop; } \
+                                } while (0)
+
+// The same after a port read, which may have run events that ended the frame or raised an interrupt.  A run
+// being checked never stops here, as the port read in the ROM code would run the check part way through it.
+#define trap_next_in(nR_,wNext_) do { \
+                                    if (g_fBreak || (status_reg != STATUS_INT_NONE && iff1)) \
+                                        nEventCycle_ = nLineCycle; \
+                                    if (fChecking_) \
+                                        radjust += (nR_); \
+                                    else \
+                                        trap_next(nR_, wNext_); \
+                                } while (0)
+
+#define trap_exx()              ( swap(bc,alt_bc), swap(de,alt_de), swap(hl,alt_hl) )
+
+// Read a port with the globals as the core would have them, picking up any events that were run or added.
+// The stopping point moves with the next event, keeping any margin the caller gave it.
+static BYTE TrapIn (WORD wPort_, int nStart_, int& rnLineCycle_, int& rnEventCycle_)
+{
+    DWORD dwBase = g_dwCycleCounter - g_nPrevLineCycle;
+    int nNextEvent = static_cast<int>(dwNextEventTime - dwBase);
+
+    g_nLineCycle = rnLineCycle_;
+    g_nPrevLineCycle = nStart_;
+    g_dwCycleCounter = dwBase + nStart_;
+
+    BYTE bIn = IO::In(wPort_);
+
+    rnLineCycle_ = g_nLineCycle;
+    rnEventCycle_ += static_cast<int>(dwNextEventTime - (g_dwCycleCounter - g_nPrevLineCycle)) - nNextEvent;
+    return bIn;
+}
+
+// CLS at ROM0 078E, pushing DE down through the display until BC runs out
+template <bool fContend_>
+void TrapClearScreen (int nEventCycle_)
+{
+    int nLineCycle = g_nLineCycle;
+
+    for (;;)
+    {
+        // 8x push de
+        for (int n = 1 ; n <= 8 ; n++)
+        {
+            nLineCycle += 5;
+            sp -= 2;
+            timed_write_word_reversed_<false, fContend_>(sp, de, nLineCycle);
+            trap_next(1, 0x078e + n);
+        }
+
+        // djnz 078e
+        if (--b)
+        {
+            nLineCycle += 13;
+            trap_next(1, 0x078e);
+            continue;
+        }
+
+        nLineCycle += 8;
+        trap_next(1, 0x0798);
+
+        // dec c ; jr nz,078e
+        nLineCycle += 4;
+        c--;
+        f = (f & F_CARRY) | DecFlags(c);
+        trap_next(1, 0x0799);
+
+        if (c)
+        {
+            nLineCycle += 12;
+            trap_next(1, 0x078e);
+            continue;
+        }
+
+        nLineCycle += 7;
+        radjust++;
+        pc = 0x079b;
+        break;
+    }
+
+lab_stop:
+    g_nLineCycle = nLineCycle;
+}
+
+// Mode 4 character printing at ROM0 3D59, with the font row in the main registers and the display in the
+// alternates.  Each row is 4 display bytes, masked by B' and merged with pixel pairs from the table at HL'.
+template <bool fContend_>
+void TrapPrintChar (int nEventCycle_)
+{
+    int nLineCycle = g_nLineCycle;
+
+// ld a,(de) ; and b ; xor (hl) ; ld (de),a
+#define trap_merge(wAddr_)  do { \
+                                nLineCycle += 4; \
+                                a = timed_read_byte_<false, fContend_>(de, nLineCycle); \
+                                trap_next(1, (wAddr_) + 1); \
+                                nLineCycle += 4; \
+                                a &= b; \
+                                f = parity(a) | F_HCARRY; \
+                                trap_next(1, (wAddr_) + 2); \
+                                nLineCycle += 4; \
+                                a ^= timed_read_byte_<false, fContend_>(hl, nLineCycle); \
+                                f = parity(a); \
+                                trap_next(1, (wAddr_) + 3); \
+                                nLineCycle += 4; \
+                                timed_write_byte_<false, fContend_>(de, a, nLineCycle); \
+                                trap_next(1, (wAddr_) + 4); \
+                            } while (0)
+
+    for (;;)
+    {
+        // ld a,(de) ; xor c ; inc de ; exx
+        nLineCycle += 4;
+        a = timed_read_byte_<false, fContend_>(de, nLineCycle);
+        trap_next(1, 0x3d5a);
+        nLineCycle += 4;
+        a ^= c;
+        f = parity(a);
+        trap_next(1, 0x3d5b);
+        nLineCycle += 6;
+        de++;
+        trap_next(1, 0x3d5c);
+        nLineCycle += 4;
+        trap_exx();
+        trap_next(1, 0x3d5d);
+
+        // ld c,a ; rra ; rra ; rra ; and 1e ; ld l,a
+        nLineCycle += 4;
+        c = a;
+        trap_next(1, 0x3d5e);
+
+        for (int n = 1 ; n <= 3 ; n++)
+        {
+            nLineCycle += 4;
+            BYTE bCarry = a & F_CARRY;
+            a = (a >> 1) | (f << 7);
+            f = (f & 0xc4) | (a & 0x28) | bCarry;
+            trap_next(1, 0x3d5e + n);
+        }
+
+        nLineCycle += 7;
+        a &= 0x1e;
+        f = parity(a) | F_HCARRY;
+        trap_next(1, 0x3d63);
+        nLineCycle += 4;
+        l = a;
+        trap_next(1, 0x3d64);
+
+        // Left pixel pair, then inc l ; inc e ; the right pair, then inc e
+        trap_merge(0x3d64);
+        nLineCycle += 4;
+        l++;
+        f = (f & F_CARRY) | IncFlags(l);
+        trap_next(1, 0x3d69);
+        nLineCycle += 4;
+        e++;
+        f = (f & F_CARRY) | IncFlags(e);
+        trap_next(1, 0x3d6a);
+        trap_merge(0x3d6a);
+        nLineCycle += 4;
+        e++;
+        f = (f & F_CARRY) | IncFlags(e);
+        trap_next(1, 0x3d6f);
+
+        // ld a,c ; rla ; and 1e ; ld l,a
+        nLineCycle += 4;
+        a = c;
+        trap_next(1, 0x3d70);
+        nLineCycle += 4;
+        BYTE bCarry = a >> 7;
+        a = (a << 1) | (f & F_CARRY);
+        f = (f & 0xc4) | (a & 0x28) | bCarry;
+        trap_next(1, 0x3d71);
+        nLineCycle += 7;
+        a &= 0x1e;
+        f = parity(a) | F_HCARRY;
+        trap_next(1, 0x3d73);
+        nLineCycle += 4;
+        l = a;
+        trap_next(1, 0x3d74);
+
+        // The same for the second half of the row
+        trap_merge(0x3d74);
+        nLineCycle += 4;
+        l++;
+        f = (f & F_CARRY) | IncFlags(l);
+        trap_next(1, 0x3d79);
+        nLineCycle += 4;
+        e++;
+        f = (f & F_CARRY) | IncFlags(e);
+        trap_next(1, 0x3d7a);
+        trap_merge(0x3d7a);
+
+        // ld a,e ; add a,7d ; ld e,a ; jr nc,3d85 ; inc d, moving down to the next display line
+        nLineCycle += 4;
+        a = e;
+        trap_next(1, 0x3d7f);
+        nLineCycle += 7;
+        WORD wSum = a + 0x7d;
+        f = ((wSum & 0xb8) ^ ((a ^ 0x7d) & 0x10)) | (wSum >> 8) | (((a ^ ~0x7d) & (a ^ wSum) & 0x80) >> 5);
+        a = wSum;
+        f |= (!a) << 6;
+        trap_next(1, 0x3d81);
+        nLineCycle += 4;
+        e = a;
+        trap_next(1, 0x3d82);
+
+        if (!(f & F_CARRY))
+        {
+            nLineCycle += 12;
+            trap_next(1, 0x3d85);
+        }
+        else
+        {
+            nLineCycle += 7;
+            trap_next(1, 0x3d84);
+            nLineCycle += 4;
+            d++;
+            f = (f & F_CARRY) | IncFlags(d);
+            trap_next(1, 0x3d85);
+        }
+
+        // exx ; djnz 3d59
+        nLineCycle += 4;
+        trap_exx();
+        trap_next(1, 0x3d86);
+
+        if (--b)
+        {
+            nLineCycle += 13;
+            trap_next(1, 0x3d59);
+            continue;
+        }
+
+        nLineCycle += 8;
+        radjust++;
+        pc = 0x3d88;
+        break;
+    }
+
+#undef trap_merge
+
+lab_stop:
+    g_nLineCycle = nLineCycle;
+}
+
+// Keyboard scan at ROM1 D5C5, storing the rows from ports FE and F9 at HL as B walks a zero bit through
+// them, then reading the last row at FFFE and leaving at D5DB with the value unstored
+template <bool fContend_>
+void TrapKeyScan (int nEventCycle_, bool fChecking_)
+{
+    int nLineCycle = g_nLineCycle;
+
+    for (;;)
+    {
+        // in e,(c)
+        int nStart = nLineCycle;
+        nLineCycle += 8;
+        (nLineCycle += 4) |= (c >= BASE_ASIC_PORT) ? 7 : 0;
+        pc = 0xd5c7;
+        e = TrapIn(bc, nStart, nLineCycle, nEventCycle_);
+        f = (f & F_CARRY) | parity(e);
+        trap_next_in(2, 0xd5c7);
+
+        // ld a,b ; in a,(f9)
+        nLineCycle += 4;
+        a = b;
+        trap_next(1, 0xd5c8);
+        nStart = nLineCycle;
+        nLineCycle += 7;
+        (nLineCycle += 4) |= (STATUS_PORT >= BASE_ASIC_PORT) ? 7 : 0;
+        pc = 0xd5ca;
+        a = TrapIn((a << 8) | STATUS_PORT, nStart, nLineCycle, nEventCycle_);
+        trap_next_in(1, 0xd5ca);
+
+        // xor e ; and d ; xor e ; inc b ; jr z,d5db
+        nLineCycle += 4;
+        a ^= e;
+        f = parity(a);
+        trap_next(1, 0xd5cb);
+        nLineCycle += 4;
+        a &= d;
+        f = parity(a) | F_HCARRY;
+        trap_next(1, 0xd5cc);
+        nLineCycle += 4;
+        a ^= e;
+        f = parity(a);
+        trap_next(1, 0xd5cd);
+        nLineCycle += 4;
+        b++;
+        f = (f & F_CARRY) | IncFlags(b);
+        trap_next(1, 0xd5ce);
+
+        if (!b)
+        {
+            nLineCycle += 12;
+            radjust++;
+            pc = 0xd5db;
+            break;
+        }
+
+        nLineCycle += 7;
+        trap_next(1, 0xd5d0);
+
+        // ld (hl),a ; dec b ; inc hl ; rlc b ; jr c,d5c5
+        nLineCycle += 4;
+        timed_write_byte_<false, fContend_>(hl, a, nLineCycle);
+        trap_next(1, 0xd5d1);
+        nLineCycle += 4;
+        b--;
+        f = (f & F_CARRY) | DecFlags(b);
+        trap_next(1, 0xd5d2);
+        nLineCycle += 6;
+        hl++;
+        trap_next(1, 0xd5d3);
+        nLineCycle += 8;
+        b = (b << 1) | (b >> 7);
+        f = (b & F_CARRY) | parity(b);
+        trap_next(2, 0xd5d5);
+
+        if (f & F_CARRY)
+        {
+            nLineCycle += 12;
+            trap_next(1, 0xd5c5);
+            continue;
+        }
+
+        // ld b,ff ; jr d5c5
+        nLineCycle += 7;
+        trap_next(1, 0xd5d7);
+        nLineCycle += 7;
+        b = 0xff;
+        trap_next(1, 0xd5d9);
+        nLineCycle += 12;
+        trap_next(1, 0xd5c5);
+    }
+
+lab_stop:
+    g_nLineCycle = nLineCycle;
+}
+
+// Floating-point multiply loop at ROM1 CC4B, adding DE':DE to HL':HL for each bit shifted out of A, and
+// shifting the 33-bit result right, with the bit shifted out of L going back into the top of A
+template <bool fContend_>
+void TrapMultiply (int nEventCycle_)
+{
+    int nLineCycle = g_nLineCycle;
+
+    for (;;)
+    {
+        // rra ; jr nc,cc53
+        nLineCycle += 4;
+        BYTE bCarry = a & F_CARRY;
+        a = (a >> 1) | (f << 7);
+        f = (f & 0xc4) | (a & 0x28) | bCarry;
+        trap_next(1, 0xcc4c);
+
+        if (!(f & F_CARRY))
+        {
+            nLineCycle += 12;
+            trap_next(1, 0xcc53);
+        }
+        else
+        {
+            nLineCycle += 7;
+            trap_next(1, 0xcc4e);
+
+            // add hl,de ; exx ; adc hl,de ; exx
+            nLineCycle += 11;
+            DWORD dwSum = hl + de;
+            f = (f & 0xc4) | (((dwSum & 0x3800) ^ ((hl ^ de) & 0x1000)) >> 8) | (dwSum >> 16);
+            hl = dwSum;
+            trap_next(1, 0xcc4f);
+            nLineCycle += 4;
+            trap_exx();
+            trap_next(1, 0xcc50);
+            nLineCycle += 15;
+            dwSum = hl + de + (f & F_CARRY);
+            f = (((dwSum & 0xb800) ^ ((hl ^ de) & 0x1000)) >> 8) | (dwSum >> 16) | (((hl ^ ~de) & (hl ^ dwSum) & 0x8000) >> 13);
+            hl = dwSum;
+            f |= (!hl) << 6;
+            trap_next(2, 0xcc52);
+            nLineCycle += 4;
+            trap_exx();
+            trap_next(1, 0xcc53);
+        }
+
+        // exx ; rr h ; rr l ; exx ; rr h ; rr l
+        for (int n = 0 ; n < 2 ; n++)
+        {
+            WORD wAddr = 0xcc53 + n*5;
+
+            nLineCycle += 4;
+            trap_exx();
+            trap_next(1, wAddr + 1);
+            nLineCycle += 8;
+            bCarry = h & F_CARRY;
+            h = (h >> 1) | (f << 7);
+            f = bCarry | parity(h);
+            trap_next(2, wAddr + 3);
+            nLineCycle += 8;
+            bCarry = l & F_CARRY;
+            l = (l >> 1) | (f << 7);
+            f = bCarry | parity(l);
+            trap_next(2, wAddr + 5);
+        }
+
+        // djnz cc4b
+        if (--b)
+        {
+            nLineCycle += 13;
+            trap_next(1, 0xcc4b);
+            continue;
+        }
+
+        nLineCycle += 8;
+        radjust++;
+        pc = 0xcc5f;
+        break;
+    }
+
+lab_stop:
+    g_nLineCycle = nLineCycle;
+}
+
+#undef trap_next
+#undef trap_next_in
+#undef trap_exx
+
+// Run a trapped ROM routine natively, with the core's state saved, returning true if it was run.  When they're
+// being checked, the native version is run only to find its result, and undone for the ROM code to be compared.
+template <bool fContend_>
+bool RunTrap (int nTrap_)
+{
+    if (status_reg != STATUS_INT_NONE && iff1)
+        return false;
+
+    int nEventCycle = static_cast<int>(dwNextEventTime - (g_dwCycleCounter - g_nPrevLineCycle));
+    bool fChecking = Trap::IsChecking();
+
+    // A run that's undone mustn't have run events from its port reads, so it stops well short of the next one,
+    // leaving room for the instruction after a port read too, and isn't started at all if that's too close
+    if (fChecking && ((nEventCycle -= 32) <= g_nLineCycle || !Trap::Save()))
+        return false;
+
+    switch (nTrap_)
+    {
+        case trapClearScreen:   TrapClearScreen<fContend_>(nEventCycle);    break;
+        case trapPrintChar:     TrapPrintChar<fContend_>(nEventCycle);      break;
+        case trapKeyScan:       TrapKeyScan<fContend_>(nEventCycle, fChecking); break;
+        case trapMultiply:      TrapMultiply<fContend_>(nEventCycle);       break;
+    }
+
+    if (!fChecking)
+        return true;
+
+    Trap::Expect(nTrap_);
+    return false;
+}
+
+// Find the pending event due first, and cache its time for the single compare in the main loop
+void UpdateNextEvent ()
+{
+    psNextEvent = NULL;
+
+    for (CPU_EVENT* pEvent = asCpuEvents ; pEvent < asCpuEvents+evtCount ; pEvent++)
+    {
+        if (!pEvent->fPending)
+            continue;
+
+        // Events due at the same time are run in the reverse order they were added
+        int nDiff = psNextEvent ? static_cast<int>(pEvent->dwTime - psNextEvent->dwTime) : -1;
+        if (nDiff < 0 || (!nDiff && static_cast<int>(pEvent->dwOrder - psNextEvent->dwOrder) > 0))
+            psNextEvent = pEvent;
+    }
+
+    // Note - the end of line event is always pending, so psNextEvent will never be NULL after reset
+    if (psNextEvent)
+        dwNextEventTime = psNextEvent->dwTime;
+}
+
+// Execute the CPU event specified
+void CPU::ExecuteEvent (CPU_EVENT sThisEvent)
+{
+    switch (sThisEvent.nEvent)
+    {
+        case evtStdIntStart :
+            // Check for a LINE interrupt on the following line
+            if ((line_int < SCREEN_LINES) && (g_nLine == (line_int + TOP_BORDER_LINES - 1)))
+            {
+                // Signal the LINE interrupt, and start the interrupt counter
+                status_reg &= ~STATUS_INT_LINE;
+                AddCpuEvent(evtStdIntEnd, sThisEvent.dwTime + INT_ACTIVE_TIME);
+            }
+            // Check for a FRAME interrupt on the last line
+            else if (g_nLine == (HEIGHT_LINES - 1))
+            {
+                // Signal a FRAME interrupt, and start the interrupt counter
+                status_reg &= ~STATUS_INT_FRAME;
+                AddCpuEvent(evtStdIntEnd, sThisEvent.dwTime + INT_ACTIVE_TIME);
+            }
+            break;
+
+        case evtStdIntEnd :
+            // Reset the interrupt as we're done
+            status_reg |= (STATUS_INT_FRAME | STATUS_INT_LINE);
+            break;
+
+        case evtMidiOutIntStart :
+            // Begin the MIDI_OUT interrupt and add an event to end it
+            status_reg &= ~STATUS_INT_MIDIOUT;
+            AddCpuEvent(evtMidiOutIntEnd, sThisEvent.dwTime + MIDI_INT_ACTIVE_TIME);
+            break;
+
+        case evtMidiOutIntEnd :
+            // Reset the interrupt and clear the 'transmitting' bit in LPEN as we're done
+            status_reg |= STATUS_INT_MIDIOUT;
+            lpen &= ~LPEN_TXFMST;
+            break;
+
+        case evtEndOfLine :
+            // Subtract a line's worth of cycles and move to the next line down
+            g_nPrevLineCycle -= TSTATES_PER_LINE;
+            g_nLineCycle -= TSTATES_PER_LINE;
+            g_nLine++;
+            // Add an event for the next line
+            AddCpuEvent(evtEndOfLine, sThisEvent.dwTime + TSTATES_PER_LINE);
+
+            // If we're at the end of the frame, signal it
+            if (g_nLine >= HEIGHT_LINES)
+                g_fBreak = true;
+            else
+            {
+                // Work out if we're in a vertical part of the screen that may be affected by contention
+                nMemAccessIndex = MEM_ACCESS_LINE * (
+                    (((g_nLine >= TOP_BORDER_LINES) && (g_nLine < TOP_BORDER_LINES + SCREEN_LINES)) ? 2 : 0) +
+                    ((g_nLine == TOP_BORDER_LINES - 1) || (g_nLine == TOP_BORDER_LINES + SCREEN_LINES - 1))
+                );
+                SetContention();
+
+                // Are we on a line that may potentially require an interrupt at the start of the right border?
+                if (((g_nLine >= (TOP_BORDER_LINES - 1)) && (g_nLine < (TOP_BORDER_LINES - 1 + SCREEN_LINES))) ||
+                    (g_nLine == (HEIGHT_LINES - 1)))
+                {
+                    // Add an event to check for LINE/FRAME interrupts
+                    AddCpuEvent(evtStdIntStart, sThisEvent.dwTime + INT_START_TIME);
+                }
+            }
+
+            break;
+
+        case evtInputUpdate :
+            // Update the input in the centre of the screen (well away from the frame boundary) to avoid the ROM
+            // keyboard scanner discarding key presses when it thinks keys have bounced.  In old versions this was
+            // the cause of the first key press on the boot screen only clearing it (took AGES to track down!)
+            IO::UpdateInput();
+
+            // Schedule the next input check at the same time in the next frame
+            AddCpuEvent(evtInputUpdate, sThisEvent.dwTime + TSTATES_PER_FRAME);
+            break;
+
+        case evtTrapCheck :
+            // Compare the interpreted ROM code with its native version
+            Trap::Check();
+            break;
+    }
+}
+
+
+// Inside ExecuteChunk the hottest state is cached in locals, which the compiler can keep in host
+// registers instead of reloading and storing the globals around every memory and function access.
+// The locals for the line cycle, R counter and index pointers deliberately shadow the globals of the
+// same name, so the instruction implementations are unchanged.  Anything outside the core sees the
+// cached state only after SAVE_CACHED_STATE, and changes it makes are picked up by LOAD_CACHED_STATE.
+#undef REG_AF
+#undef REG_HL
+#undef REG_SP
+#undef REG_PC
+#define REG_AF  rAF
+#define REG_HL  rHL
+#define REG_SP  rSP
+#define REG_PC  rPC
+
+// The global cycle counter is only brought up to date when needed, from the base value it had at the
+// start of the current line cycle count.  Events are checked by comparing against a line cycle deadline.
+#define SAVE_CACHED_STATE() \
+    ( regs.AF = rAF, regs.HL = rHL, regs.SP = rSP, regs.PC = rPC, ::radjust = radjust, \
+      ::g_nLineCycle = g_nLineCycle, ::g_nPrevLineCycle = nPrevLineCycle, \
+      g_dwCycleCounter = dwCycleBase + nPrevLineCycle )
+
+#define LOAD_CACHED_STATE() \
+    ( rAF = regs.AF, rHL = regs.HL, rSP = regs.SP, rPC = regs.PC, radjust = ::radjust, \
+      g_nLineCycle = ::g_nLineCycle, nPrevLineCycle = ::g_nPrevLineCycle, \
+      dwCycleBase = g_dwCycleCounter - nPrevLineCycle, \
+      nEventCycle = static_cast<int>(dwNextEventTime - dwCycleBase) )
+
+// The core's memory accesses use its own tracking and contention settings
+#undef ACCESS_MODE
+#define ACCESS_MODE     fDebug_, fContend_
+
+// Idle loops are only skipped when no interrupt is waiting, as it would be taken at the next instruction.
+// Shortcuts that run several instructions at once are not used when breakpoints need checking after each.
+#define skip_idle(addr,instrs)  do { \
+                                    if (!fDebug_ && (status_reg == STATUS_INT_NONE || !iff1)) \
+                                        SkipIdleLoop<fContend_>((addr), hl, (instrs), g_nLineCycle, nEventCycle, radjust); \
+                                } while (0)
+
+// A repeating block instruction can carry on without returning to the main loop if nothing would happen between
+// passes: no event is due, no interrupt would be taken, and the instruction is still there to be fetched again
+#define repeat_ok(op)           (!fDebug_ && g_nLineCycle < nEventCycle && (status_reg == STATUS_INT_NONE || !iff1) && \
+                                 read_byte(pc) == OP_ED && read_byte(pc+1) == (op))
+#define block_load(step)        do { \
+                                    if (repeat_ok(op)) \
+                                        BlockLoad<fContend_>((step), pc, hl, g_nLineCycle, nEventCycle, radjust, a, f); \
+                                } while (0)
+#define block_compare(step)     do { \
+                                    if (repeat_ok(op)) \
+                                        BlockCompare<fContend_>((step), pc, hl, g_nLineCycle, nEventCycle, radjust, a, f); \
+                                } while (0)
+
+// Block I/O must still access the port for each byte, but a pass can start again without a dispatch, as
+// if the instruction had been fetched again.  Port handlers may run events, and those may end the frame.
+#define repeat_io(m1states)     (repeat_ok(op) && !g_fBreak && \
+                                 (nPrevLineCycle = g_nLineCycle, MEM_ACCESS(pc), g_nLineCycle++, \
+                                  MEM_ACCESS(pc+1), g_nLineCycle += (m1states) - 3, radjust += 2, pc += 2, true))
+
+// Port access needs the real state, as the I/O handlers may draw the display or process events
+#undef in_byte
+#undef out_byte
+#define in_byte(port)       ({ SAVE_CACHED_STATE(); BYTE bIn = IO::In(port); LOAD_CACHED_STATE(); bIn; })
+#define out_byte(port,val)  ({ SAVE_CACHED_STATE(); IO::Out((port), (val)); LOAD_CACHED_STATE(); })
+
+
+// Execute until the end of a frame, or a breakpoint, whichever comes first.  The core is compiled once for
+// each mode, so debugger tracking and contention cost nothing when they're not wanted:
+//  fDebug_   - record memory accesses and check for breakpoints after every instruction
+//  fContend_ - apply memory contention, which only turbo mode goes without
+template <bool fDebug_, bool fContend_>
+void CPU::ExecuteCore ()
+{
+    __label__ 
+op_0000,
+op_0001,
+op_0002,
+op_0003,
+op_0004,
+op_0005,
+op_0006,
+op_0007,
+op_0010,
+op_0011,
+op_0012,
+op_0013,
+op_0014,
+op_0015,
+op_0016,
+op_0017,
+op_0020,
+op_0021,
+op_0022,
+op_0023,
+op_0024,
+op_0025,
+op_0026,
+op_0027,
+op_0030,
+op_0031,
+op_0032,
+op_0033,
+op_0034,
+op_0035,
+op_0036,
+op_0037,
 op_0040,
 op_0041,
 op_0042,
@@ -668,7 +1899,175 @@ op_0373,
 op_0374,
 op_0375,
 op_0376,
-op_0377
+op_0377,
+ix_0011,
+ix_0031,
+ix_0041,
+ix_0042,
+ix_0043,
+ix_0044,
+ix_0045,
+ix_0046,
+ix_0051,
+ix_0052,
+ix_0053,
+ix_0054,
+ix_0055,
+ix_0056,
+ix_0064,
+ix_0065,
+ix_0066,
+ix_0071,
+ix_0104,
+ix_0105,
+ix_0106,
+ix_0114,
+ix_0115,
+ix_0116,
+ix_0124,
+ix_0125,
+ix_0126,
+ix_0134,
+ix_0135,
+ix_0136,
+ix_0140,
+ix_0141,
+ix_0142,
+ix_0143,
+ix_0145,
+ix_0146,
+ix_0147,
+ix_0150,
+ix_0151,
+ix_0152,
+ix_0153,
+ix_0154,
+ix_0156,
+ix_0157,
+ix_0160,
+ix_0161,
+ix_0162,
+ix_0163,
+ix_0164,
+ix_0165,
+ix_0167,
+ix_0174,
+ix_0175,
+ix_0176,
+ix_0204,
+ix_0205,
+ix_0206,
+ix_0214,
+ix_0215,
+ix_0216,
+ix_0224,
+ix_0225,
+ix_0226,
+ix_0234,
+ix_0235,
+ix_0236,
+ix_0244,
+ix_0245,
+ix_0246,
+ix_0254,
+ix_0255,
+ix_0256,
+ix_0264,
+ix_0265,
+ix_0266,
+ix_0274,
+ix_0275,
+ix_0276,
+ix_0313,
+ix_0341,
+ix_0343,
+ix_0345,
+ix_0351,
+ix_0371,
+iy_0011,
+iy_0031,
+iy_0041,
+iy_0042,
+iy_0043,
+iy_0044,
+iy_0045,
+iy_0046,
+iy_0051,
+iy_0052,
+iy_0053,
+iy_0054,
+iy_0055,
+iy_0056,
+iy_0064,
+iy_0065,
+iy_0066,
+iy_0071,
+iy_0104,
+iy_0105,
+iy_0106,
+iy_0114,
+iy_0115,
+iy_0116,
+iy_0124,
+iy_0125,
+iy_0126,
+iy_0134,
+iy_0135,
+iy_0136,
+iy_0140,
+iy_0141,
+iy_0142,
+iy_0143,
+iy_0145,
+iy_0146,
+iy_0147,
+iy_0150,
+iy_0151,
+iy_0152,
+iy_0153,
+iy_0154,
+iy_0156,
+iy_0157,
+iy_0160,
+iy_0161,
+iy_0162,
+iy_0163,
+iy_0164,
+iy_0165,
+iy_0167,
+iy_0174,
+iy_0175,
+iy_0176,
+iy_0204,
+iy_0205,
+iy_0206,
+iy_0214,
+iy_0215,
+iy_0216,
+iy_0224,
+iy_0225,
+iy_0226,
+iy_0234,
+iy_0235,
+iy_0236,
+iy_0244,
+iy_0245,
+iy_0246,
+iy_0254,
+iy_0255,
+iy_0256,
+iy_0264,
+iy_0265,
+iy_0266,
+iy_0274,
+iy_0275,
+iy_0276,
+iy_0313,
+iy_0341,
+iy_0343,
+iy_0345,
+iy_0351,
+iy_0371
 ;
     static const void* const a_jump_table[256] = 
     {
@@ -681,7 +2080,528 @@ op_0377
 &&op_0006,
 &&op_0007,
 &&op_0010,
-&&op_0011,
+&&op_0011,
+&&op_0012,
+&&op_0013,
+&&op_0014,
+&&op_0015,
+&&op_0016,
+&&op_0017,
+&&op_0020,
+&&op_0021,
+&&op_0022,
+&&op_0023,
+&&op_0024,
+&&op_0025,
+&&op_0026,
+&&op_0027,
+&&op_0030,
+&&op_0031,
+&&op_0032,
+&&op_0033,
+&&op_0034,
+&&op_0035,
+&&op_0036,
+&&op_0037,
+&&op_0040,
+&&op_0041,
+&&op_0042,
+&&op_0043,
+&&op_0044,
+&&op_0045,
+&&op_0046,
+&&op_0047,
+&&op_0050,
+&&op_0051,
+&&op_0052,
+&&op_0053,
+&&op_0054,
+&&op_0055,
+&&op_0056,
+&&op_0057,
+&&op_0060,
+&&op_0061,
+&&op_0062,
+&&op_0063,
+&&op_0064,
+&&op_0065,
+&&op_0066,
+&&op_0067,
+&&op_0070,
+&&op_0071,
+&&op_0072,
+&&op_0073,
+&&op_0074,
+&&op_0075,
+&&op_0076,
+&&op_0077,
+&&op_0100,
+&&op_0101,
+&&op_0102,
+&&op_0103,
+&&op_0104,
+&&op_0105,
+&&op_0106,
+&&op_0107,
+&&op_0110,
+&&op_0111,
+&&op_0112,
+&&op_0113,
+&&op_0114,
+&&op_0115,
+&&op_0116,
+&&op_0117,
+&&op_0120,
+&&op_0121,
+&&op_0122,
+&&op_0123,
+&&op_0124,
+&&op_0125,
+&&op_0126,
+&&op_0127,
+&&op_0130,
+&&op_0131,
+&&op_0132,
+&&op_0133,
+&&op_0134,
+&&op_0135,
+&&op_0136,
+&&op_0137,
+&&op_0140,
+&&op_0141,
+&&op_0142,
+&&op_0143,
+&&op_0144,
+&&op_0145,
+&&op_0146,
+&&op_0147,
+&&op_0150,
+&&op_0151,
+&&op_0152,
+&&op_0153,
+&&op_0154,
+&&op_0155,
+&&op_0156,
+&&op_0157,
+&&op_0160,
+&&op_0161,
+&&op_0162,
+&&op_0163,
+&&op_0164,
+&&op_0165,
+&&op_0166,
+&&op_0167,
+&&op_0170,
+&&op_0171,
+&&op_0172,
+&&op_0173,
+&&op_0174,
+&&op_0175,
+&&op_0176,
+&&op_0177,
+&&op_0200,
+&&op_0201,
+&&op_0202,
+&&op_0203,
+&&op_0204,
+&&op_0205,
+&&op_0206,
+&&op_0207,
+&&op_0210,
+&&op_0211,
+&&op_0212,
+&&op_0213,
+&&op_0214,
+&&op_0215,
+&&op_0216,
+&&op_0217,
+&&op_0220,
+&&op_0221,
+&&op_0222,
+&&op_0223,
+&&op_0224,
+&&op_0225,
+&&op_0226,
+&&op_0227,
+&&op_0230,
+&&op_0231,
+&&op_0232,
+&&op_0233,
+&&op_0234,
+&&op_0235,
+&&op_0236,
+&&op_0237,
+&&op_0240,
+&&op_0241,
+&&op_0242,
+&&op_0243,
+&&op_0244,
+&&op_0245,
+&&op_0246,
+&&op_0247,
+&&op_0250,
+&&op_0251,
+&&op_0252,
+&&op_0253,
+&&op_0254,
+&&op_0255,
+&&op_0256,
+&&op_0257,
+&&op_0260,
+&&op_0261,
+&&op_0262,
+&&op_0263,
+&&op_0264,
+&&op_0265,
+&&op_0266,
+&&op_0267,
+&&op_0270,
+&&op_0271,
+&&op_0272,
+&&op_0273,
+&&op_0274,
+&&op_0275,
+&&op_0276,
+&&op_0277,
+&&op_0300,
+&&op_0301,
+&&op_0302,
+&&op_0303,
+&&op_0304,
+&&op_0305,
+&&op_0306,
+&&op_0307,
+&&op_0310,
+&&op_0311,
+&&op_0312,
+&&op_0313,
+&&op_0314,
+&&op_0315,
+&&op_0316,
+&&op_0317,
+&&op_0320,
+&&op_0321,
+&&op_0322,
+&&op_0323,
+&&op_0324,
+&&op_0325,
+&&op_0326,
+&&op_0327,
+&&op_0330,
+&&op_0331,
+&&op_0332,
+&&op_0333,
+&&op_0334,
+&&op_0335,
+&&op_0336,
+&&op_0337,
+&&op_0340,
+&&op_0341,
+&&op_0342,
+&&op_0343,
+&&op_0344,
+&&op_0345,
+&&op_0346,
+&&op_0347,
+&&op_0350,
+&&op_0351,
+&&op_0352,
+&&op_0353,
+&&op_0354,
+&&op_0355,
+&&op_0356,
+&&op_0357,
+&&op_0360,
+&&op_0361,
+&&op_0362,
+&&op_0363,
+&&op_0364,
+&&op_0365,
+&&op_0366,
+&&op_0367,
+&&op_0370,
+&&op_0371,
+&&op_0372,
+&&op_0373,
+&&op_0374,
+&&op_0375,
+&&op_0376,
+&&op_0377
+    };
+
+    // Index prefixed opcodes, where only those using HL differ from the main table
+    static const void* const a_ix_table[256] = 
+    {
+&&op_0000,
+&&op_0001,
+&&op_0002,
+&&op_0003,
+&&op_0004,
+&&op_0005,
+&&op_0006,
+&&op_0007,
+&&op_0010,
+&&ix_0011,
+&&op_0012,
+&&op_0013,
+&&op_0014,
+&&op_0015,
+&&op_0016,
+&&op_0017,
+&&op_0020,
+&&op_0021,
+&&op_0022,
+&&op_0023,
+&&op_0024,
+&&op_0025,
+&&op_0026,
+&&op_0027,
+&&op_0030,
+&&ix_0031,
+&&op_0032,
+&&op_0033,
+&&op_0034,
+&&op_0035,
+&&op_0036,
+&&op_0037,
+&&op_0040,
+&&ix_0041,
+&&ix_0042,
+&&ix_0043,
+&&ix_0044,
+&&ix_0045,
+&&ix_0046,
+&&op_0047,
+&&op_0050,
+&&ix_0051,
+&&ix_0052,
+&&ix_0053,
+&&ix_0054,
+&&ix_0055,
+&&ix_0056,
+&&op_0057,
+&&op_0060,
+&&op_0061,
+&&op_0062,
+&&op_0063,
+&&ix_0064,
+&&ix_0065,
+&&ix_0066,
+&&op_0067,
+&&op_0070,
+&&ix_0071,
+&&op_0072,
+&&op_0073,
+&&op_0074,
+&&op_0075,
+&&op_0076,
+&&op_0077,
+&&op_0100,
+&&op_0101,
+&&op_0102,
+&&op_0103,
+&&ix_0104,
+&&ix_0105,
+&&ix_0106,
+&&op_0107,
+&&op_0110,
+&&op_0111,
+&&op_0112,
+&&op_0113,
+&&ix_0114,
+&&ix_0115,
+&&ix_0116,
+&&op_0117,
+&&op_0120,
+&&op_0121,
+&&op_0122,
+&&op_0123,
+&&ix_0124,
+&&ix_0125,
+&&ix_0126,
+&&op_0127,
+&&op_0130,
+&&op_0131,
+&&op_0132,
+&&op_0133,
+&&ix_0134,
+&&ix_0135,
+&&ix_0136,
+&&op_0137,
+&&ix_0140,
+&&ix_0141,
+&&ix_0142,
+&&ix_0143,
+&&op_0144,
+&&ix_0145,
+&&ix_0146,
+&&ix_0147,
+&&ix_0150,
+&&ix_0151,
+&&ix_0152,
+&&ix_0153,
+&&ix_0154,
+&&op_0155,
+&&ix_0156,
+&&ix_0157,
+&&ix_0160,
+&&ix_0161,
+&&ix_0162,
+&&ix_0163,
+&&ix_0164,
+&&ix_0165,
+&&op_0166,
+&&ix_0167,
+&&op_0170,
+&&op_0171,
+&&op_0172,
+&&op_0173,
+&&ix_0174,
+&&ix_0175,
+&&ix_0176,
+&&op_0177,
+&&op_0200,
+&&op_0201,
+&&op_0202,
+&&op_0203,
+&&ix_0204,
+&&ix_0205,
+&&ix_0206,
+&&op_0207,
+&&op_0210,
+&&op_0211,
+&&op_0212,
+&&op_0213,
+&&ix_0214,
+&&ix_0215,
+&&ix_0216,
+&&op_0217,
+&&op_0220,
+&&op_0221,
+&&op_0222,
+&&op_0223,
+&&ix_0224,
+&&ix_0225,
+&&ix_0226,
+&&op_0227,
+&&op_0230,
+&&op_0231,
+&&op_0232,
+&&op_0233,
+&&ix_0234,
+&&ix_0235,
+&&ix_0236,
+&&op_0237,
+&&op_0240,
+&&op_0241,
+&&op_0242,
+&&op_0243,
+&&ix_0244,
+&&ix_0245,
+&&ix_0246,
+&&op_0247,
+&&op_0250,
+&&op_0251,
+&&op_0252,
+&&op_0253,
+&&ix_0254,
+&&ix_0255,
+&&ix_0256,
+&&op_0257,
+&&op_0260,
+&&op_0261,
+&&op_0262,
+&&op_0263,
+&&ix_0264,
+&&ix_0265,
+&&ix_0266,
+&&op_0267,
+&&op_0270,
+&&op_0271,
+&&op_0272,
+&&op_0273,
+&&ix_0274,
+&&ix_0275,
+&&ix_0276,
+&&op_0277,
+&&op_0300,
+&&op_0301,
+&&op_0302,
+&&op_0303,
+&&op_0304,
+&&op_0305,
+&&op_0306,
+&&op_0307,
+&&op_0310,
+&&op_0311,
+&&op_0312,
+&&ix_0313,
+&&op_0314,
+&&op_0315,
+&&op_0316,
+&&op_0317,
+&&op_0320,
+&&op_0321,
+&&op_0322,
+&&op_0323,
+&&op_0324,
+&&op_0325,
+&&op_0326,
+&&op_0327,
+&&op_0330,
+&&op_0331,
+&&op_0332,
+&&op_0333,
+&&op_0334,
+&&op_0335,
+&&op_0336,
+&&op_0337,
+&&op_0340,
+&&ix_0341,
+&&op_0342,
+&&ix_0343,
+&&op_0344,
+&&ix_0345,
+&&op_0346,
+&&op_0347,
+&&op_0350,
+&&ix_0351,
+&&op_0352,
+&&op_0353,
+&&op_0354,
+&&op_0355,
+&&op_0356,
+&&op_0357,
+&&op_0360,
+&&op_0361,
+&&op_0362,
+&&op_0363,
+&&op_0364,
+&&op_0365,
+&&op_0366,
+&&op_0367,
+&&op_0370,
+&&ix_0371,
+&&op_0372,
+&&op_0373,
+&&op_0374,
+&&op_0375,
+&&op_0376,
+&&op_0377
+    };
+
+    static const void* const a_iy_table[256] = 
+    {
+&&op_0000,
+&&op_0001,
+&&op_0002,
+&&op_0003,
+&&op_0004,
+&&op_0005,
+&&op_0006,
+&&op_0007,
+&&op_0010,
+&&iy_0011,
 &&op_0012,
 &&op_0013,
 &&op_0014,
@@ -697,7 +2617,7 @@ op_0377
 &&op_0026,
 &&op_0027,
 &&op_0030,
-&&op_0031,
+&&iy_0031,
 &&op_0032,
 &&op_0033,
 &&op_0034,
@@ -705,31 +2625,31 @@ op_0377
 &&op_0036,
 &&op_0037,
 &&op_0040,
-&&op_0041,
-&&op_0042,
-&&op_0043,
-&&op_0044,
-&&op_0045,
-&&op_0046,
+&&iy_0041,
+&&iy_0042,
+&&iy_0043,
+&&iy_0044,
+&&iy_0045,
+&&iy_0046,
 &&op_0047,
 &&op_0050,
-&&op_0051,
-&&op_0052,
-&&op_0053,
-&&op_0054,
-&&op_0055,
-&&op_0056,
+&&iy_0051,
+&&iy_0052,
+&&iy_0053,
+&&iy_0054,
+&&iy_0055,
+&&iy_0056,
 &&op_0057,
 &&op_0060,
 &&op_0061,
 &&op_0062,
 &&op_0063,
-&&op_0064,
-&&op_0065,
-&&op_0066,
+&&iy_0064,
+&&iy_0065,
+&&iy_0066,
 &&op_0067,
 &&op_0070,
-&&op_0071,
+&&iy_0071,
 &&op_0072,
 &&op_0073,
 &&op_0074,
@@ -740,129 +2660,129 @@ op_0377
 &&op_0101,
 &&op_0102,
 &&op_0103,
-&&op_0104,
-&&op_0105,
-&&op_0106,
+&&iy_0104,
+&&iy_0105,
+&&iy_0106,
 &&op_0107,
 &&op_0110,
 &&op_0111,
 &&op_0112,
 &&op_0113,
-&&op_0114,
-&&op_0115,
-&&op_0116,
+&&iy_0114,
+&&iy_0115,
+&&iy_0116,
 &&op_0117,
 &&op_0120,
 &&op_0121,
 &&op_0122,
 &&op_0123,
-&&op_0124,
-&&op_0125,
-&&op_0126,
+&&iy_0124,
+&&iy_0125,
+&&iy_0126,
 &&op_0127,
 &&op_0130,
 &&op_0131,
 &&op_0132,
 &&op_0133,
-&&op_0134,
-&&op_0135,
-&&op_0136,
+&&iy_0134,
+&&iy_0135,
+&&iy_0136,
 &&op_0137,
-&&op_0140,
-&&op_0141,
-&&op_0142,
-&&op_0143,
+&&iy_0140,
+&&iy_0141,
+&&iy_0142,
+&&iy_0143,
 &&op_0144,
-&&op_0145,
-&&op_0146,
-&&op_0147,
-&&op_0150,
-&&op_0151,
-&&op_0152,
-&&op_0153,
-&&op_0154,
+&&iy_0145,
+&&iy_0146,
+&&iy_0147,
+&&iy_0150,
+&&iy_0151,
+&&iy_0152,
+&&iy_0153,
+&&iy_0154,
 &&op_0155,
-&&op_0156,
-&&op_0157,
-&&op_0160,
-&&op_0161,
-&&op_0162,
-&&op_0163,
-&&op_0164,
-&&op_0165,
+&&iy_0156,
+&&iy_0157,
+&&iy_0160,
+&&iy_0161,
+&&iy_0162,
+&&iy_0163,
+&&iy_0164,
+&&iy_0165,
 &&op_0166,
-&&op_0167,
+&&iy_0167,
 &&op_0170,
 &&op_0171,
 &&op_0172,
 &&op_0173,
-&&op_0174,
-&&op_0175,
-&&op_0176,
+&&iy_0174,
+&&iy_0175,
+&&iy_0176,
 &&op_0177,
 &&op_0200,
 &&op_0201,
 &&op_0202,
 &&op_0203,
-&&op_0204,
-&&op_0205,
-&&op_0206,
+&&iy_0204,
+&&iy_0205,
+&&iy_0206,
 &&op_0207,
 &&op_0210,
 &&op_0211,
 &&op_0212,
 &&op_0213,
-&&op_0214,
-&&op_0215,
-&&op_0216,
+&&iy_0214,
+&&iy_0215,
+&&iy_0216,
 &&op_0217,
 &&op_0220,
 &&op_0221,
 &&op_0222,
 &&op_0223,
-&&op_0224,
-&&op_0225,
-&&op_0226,
+&&iy_0224,
+&&iy_0225,
+&&iy_0226,
 &&op_0227,
 &&op_0230,
 &&op_0231,
 &&op_0232,
 &&op_0233,
-&&op_0234,
-&&op_0235,
-&&op_0236,
+&&iy_0234,
+&&iy_0235,
+&&iy_0236,
 &&op_0237,
 &&op_0240,
 &&op_0241,
 &&op_0242,
 &&op_0243,
-&&op_0244,
-&&op_0245,
-&&op_0246,
+&&iy_0244,
+&&iy_0245,
+&&iy_0246,
 &&op_0247,
 &&op_0250,
 &&op_0251,
 &&op_0252,
 &&op_0253,
-&&op_0254,
-&&op_0255,
-&&op_0256,
+&&iy_0254,
+&&iy_0255,
+&&iy_0256,
 &&op_0257,
 &&op_0260,
 &&op_0261,
 &&op_0262,
 &&op_0263,
-&&op_0264,
-&&op_0265,
-&&op_0266,
+&&iy_0264,
+&&iy_0265,
+&&iy_0266,
 &&op_0267,
 &&op_0270,
 &&op_0271,
 &&op_0272,
 &&op_0273,
-&&op_0274,
-&&op_0275,
-&&op_0276,
+&&iy_0274,
+&&iy_0275,
+&&iy_0276,
 &&op_0277,
 &&op_0300,
 &&op_0301,
@@ -875,7 +2795,7 @@ op_0377
 &&op_0310,
 &&op_0311,
 &&op_0312,
-&&op_0313,
+&&iy_0313,
 &&op_0314,
 &&op_0315,
 &&op_0316,
@@ -897,15 +2817,15 @@ op_0377
 &&op_0336,
 &&op_0337,
 &&op_0340,
-&&op_0341,
+&&iy_0341,
 &&op_0342,
-&&op_0343,
+&&iy_0343,
 &&op_0344,
-&&op_0345,
+&&iy_0345,
 &&op_0346,
 &&op_0347,
 &&op_0350,
-&&op_0351,
+&&iy_0351,
 &&op_0352,
 &&op_0353,
 &&op_0354,
@@ -921,7 +2841,7 @@ op_0377
 &&op_0366,
 &&op_0367,
 &&op_0370,
-&&op_0371,
+&&iy_0371,
 &&op_0372,
 &&op_0373,
 &&op_0374,
@@ -938,33 +2858,231 @@ op_0377
       CheckCpuEvents();
     }
 
+    // Register-cached state, loaded from the globals below
+    REGPAIR rAF, rHL, rSP, rPC;
+    DWORD radjust, dwCycleBase;
+    int g_nLineCycle, nPrevLineCycle, nEventCycle;
+    LOAD_CACHED_STATE();
+
+    // Handlers for the current instruction, which index prefixes switch to the IX or IY versions
+    const void* const* ppvTable = a_jump_table;
+
+#ifdef USE_BLOCK_CACHE
+    // Current position in the decoded code, and the address the next instruction is expected at
+    DECODED_BLOCK* psBlock = NULL;
+    const DECODED_INSTR* psInstr = NULL;
+    int nNextPC = -1;
+#endif
+
+    // Start of the last polling loop seen, and the R counter when its last pass began
+    int nIdleLoop = -1;
+    DWORD dwIdleRadjust = 0;
+
+    // ROM trap at the current instruction, if any
+    int nTrap;
+
     // Loop until we've reached the end of the frame
     g_fBreak = false;
 
+    // Carry on with an index prefix that ended the last chunk
+    if (pNewHlIxIy == &ix || pNewHlIxIy == &iy)
+    {
+        ppvTable = (pNewHlIxIy == &ix) ? a_ix_table : a_iy_table;
+        pNewHlIxIy = &regs.HL.W;
+        goto lab_prefixed;
+    }
+
     goto lab_beg;
 
 lab_end:
-            // Update the line/global counters and check/process for pending events
-            CheckCpuEvents();
+            // Update the line/global counters and process any events that are due
+            if (g_nLineCycle >= nEventCycle)
+            {
+                SAVE_CACHED_STATE();
+                CheckCpuEvents();
+                LOAD_CACHED_STATE();
+            }
+
+            // The next instruction starts here
+            nPrevLineCycle = g_nLineCycle;
 
             // Are there any active interrupts?
             if (status_reg != STATUS_INT_NONE && iff1)
+            {
+                SAVE_CACHED_STATE();
                 CheckInterrupt();
+                LOAD_CACHED_STATE();
+            }
 
-            if (g_fBreak) return;
+            // Check for breakpoints against the completed instruction
+            if (fDebug_)
+            {
+                SAVE_CACHED_STATE();
+                if (Debug::BreakpointHit())
+                    g_fBreak = true;
+            }
+
+            if (g_fBreak)
+            {
+                SAVE_CACHED_STATE();
+                return;
+            }
 lab_beg: 
-            // Keep track of the current and previous state of whether we're processing an indexed instruction
-            pHlIxIy = pNewHlIxIy;
-            pNewHlIxIy = &hl;
+            // Forget the accesses of the previous instruction, so they're only matched against breakpoints once
+            if (fDebug_)
+                pbMemRead1 = pbMemRead2 = pbMemWrite1 = pbMemWrite2 = NULL;
+
+            ppvTable = a_jump_table;
+
+            // Run a trapped ROM routine natively, carrying on from wherever it stopped
+            if (!fDebug_ && (nTrap = GetTrap(pc)))
+            {
+                SAVE_CACHED_STATE();
+                bool fRan = RunTrap<fContend_>(nTrap);
+                LOAD_CACHED_STATE();
+
+                if (fRan)
+                {
+#ifdef USE_BLOCK_CACHE
+                    nNextPC = -1;
+#endif
+                    goto lab_end;
+                }
+            }
 
+#ifdef USE_BLOCK_CACHE
+            // Continue through the current block if execution is still following it, or find the block at the new PC
+            if ((pc == nNextPC && ++psInstr < psBlock->asInstrs + psBlock->nInstrs) ||
+                ((psBlock = LookupBlock(pc, a_jump_table, a_ix_table, a_iy_table)) && (psInstr = psBlock->asInstrs)))
+                goto lab_decoded;
+
+lab_fetch:
+            // Nothing decoded to follow here, so fetch the instruction normally
+            nNextPC = -1;
+#else
+lab_fetch:
+#endif
             // Fetch... (and advance PC)
             g_bOpcode = timed_read_code_byte(pc++);
             radjust++;
 
-	          goto *a_jump_table[g_bOpcode];
+	          goto *ppvTable[g_bOpcode];
+
+#ifdef USE_BLOCK_CACHE
+lab_decoded:
+            // Fetch timing still applies, but the opcode and handler come from the decoded copy
+            MEM_ACCESS(pc);
+            nNextPC = pc + psInstr->bLength;
+            pc++;
+            radjust++;
+            g_bOpcode = psInstr->bOpcode;
+            goto *psInstr->pvHandler;
+#endif
+
+lab_prefix:
+            // An index prefix is timed and has events run like any other instruction, but interrupts can't
+            // be taken until the instruction it modifies has completed
+            if (g_nLineCycle >= nEventCycle)
+            {
+                SAVE_CACHED_STATE();
+                CheckCpuEvents();
+                LOAD_CACHED_STATE();
+            }
+
+            nPrevLineCycle = g_nLineCycle;
+
+            if (fDebug_)
+            {
+                SAVE_CACHED_STATE();
+                if (Debug::BreakpointHit())
+                    g_fBreak = true;
+            }
+
+            // Remember the prefix if we stop here, so the next chunk uses the right handlers
+            if (g_fBreak)
+            {
+                SAVE_CACHED_STATE();
+                pNewHlIxIy = (ppvTable == a_ix_table) ? &ix : &iy;
+                return;
+            }
+lab_prefixed:
+            if (fDebug_)
+                pbMemRead1 = pbMemRead2 = pbMemWrite1 = pbMemWrite2 = NULL;
+
+#ifdef USE_BLOCK_CACHE
+            // The prefixed instruction is only taken from the current block, as a new one would decode it unprefixed
+            if (pc == nNextPC && ++psInstr < psBlock->asInstrs + psBlock->nInstrs)
+                goto lab_decoded;
+#endif
+            goto lab_fetch;
 
             // ... Decode ...
+#define op_label(opcode)    op_##opcode
+#define pHlIxIy             (&hl)
 #include "Z80ops.h"     // ... Execute!
+#undef op_label
+#undef pHlIxIy
+
+            // The handlers using HL again for IX and IY, with the index register fixed at compile time.
+            // The index tables use the op_ handlers for everything else, as the prefix makes no difference.
+#define HL_OPS_ONLY
+#define op_label(opcode)    ix_##opcode
+#define pHlIxIy             (&ix)
+#include "Z80ops.h"
+#undef op_label
+#undef pHlIxIy
+
+#define op_label(opcode)    iy_##opcode
+#define pHlIxIy             (&iy)
+#include "Z80ops.h"
+#undef op_label
+#undef pHlIxIy
+#undef HL_OPS_ONLY
+}
+
+#undef SAVE_CACHED_STATE
+#undef LOAD_CACHED_STATE
+#undef ACCESS_MODE
+#define ACCESS_MODE     true, true
+#undef skip_idle
+#undef repeat_ok
+#undef block_load
+#undef block_compare
+#undef repeat_io
+#undef in_byte
+#undef out_byte
+#define in_byte     IO::In
+#define out_byte    IO::Out
+
+#undef REG_AF
+#undef REG_HL
+#undef REG_SP
+#undef REG_PC
+#define REG_AF  regs.AF
+#define REG_HL  regs.HL
+#define REG_SP  regs.SP
+#define REG_PC  regs.PC
+
+
+// Execute until the end of a frame, or a breakpoint, using the core for the current mode
+void CPU::ExecuteChunk ()
+{
+    static MACHINE_LOCAL int nLastCore = -1;
+    int nCore = Debug::IsBreakpointSet() ? 0 : g_fTurbo ? 2 : 1;
+
+    // Decoded blocks hold handler addresses from the core that decoded them
+    if (nCore != nLastCore)
+    {
+        InvalidateCode();
+        nLastCore = nCore;
+    }
+
+    switch (nCore)
+    {
+        case 0:     ExecuteCore<true, true>();      break;
+        case 1:     ExecuteCore<false, true>();     break;
+        default:    ExecuteCore<false, false>();    break;
+    }
 }
 
 
@@ -984,6 +3102,7 @@ void CPU::Run ()
             // Step back up to start the next frame
             g_nLine %= HEIGHT_LINES;
             Frame::Start();
+            Rewind::FrameEnd();
         }
     }
 
@@ -1004,16 +3123,14 @@ void CPU::Reset (bool fPress_)
         pc = 0x0000;
 
         // No index prefix seen yet, and no last instruction (for EI/DI look-back)
-        pHlIxIy = pNewHlIxIy = &hl;
+        pNewHlIxIy = &hl;
         g_bOpcode = OP_NOP;
 
         // Counter used to determine when each line should be drawn
         g_nLineCycle = g_nPrevLineCycle = 0;
 
-        // Initialise the CPU events queue
-        for (int n = 0 ; n < MAX_EVENTS ; n++)
-            asCpuEvents[n].psNext = &asCpuEvents[(n+1) % MAX_EVENTS];
-        psFreeEvent = asCpuEvents;
+        // Clear the CPU event slots
+        memset(asCpuEvents, 0, sizeof asCpuEvents);
         psNextEvent = NULL;
 
         // Schedule the first end of line event, and an update check half way through the frame
@@ -1023,6 +3140,9 @@ void CPU::Reset (bool fPress_)
         // Re-initialise memory (for configuration changes) and reset I/O
         IO::Init();
         Memory::Init();
+
+        // Any previously decoded code is now stale
+        InvalidateCode();
     }
     // Set up the fast reset for first power-on, allowing UP TO 5 seconds before returning to normal mode
     else if  (GetOption(fastreset))
@@ -1030,6 +3150,84 @@ void CPU::Reset (bool fPress_)
 }
 
 
+// CPU state as saved, with the pending index prefix as 0 for none, 1 for IX or 2 for IY
+typedef struct
+{
+    Z80Regs     sRegs;
+    DWORD       dwRadjust, dwCycleCounter;
+    int         nLine, nLineCycle, nPrevLineCycle;
+    int         nMemAccessBase, nMemAccessIndex, nFastBooting;
+    BYTE        bOpcode, bPrefix;
+    bool        fReset, fMemContention;
+
+    DWORD       dwEventOrder;
+    CPU_EVENT   asEvents[evtTrapCheck];     // Everything but a ROM trap check, which is dropped on loading
+}
+CPU_STATE;
+
+void CPU::SaveState ()
+{
+    CPU_STATE sState;
+    memset(&sState, 0, sizeof sState);
+
+    sState.sRegs = regs;
+    sState.dwRadjust = radjust;
+    sState.dwCycleCounter = g_dwCycleCounter;
+    sState.nLine = g_nLine;
+    sState.nLineCycle = g_nLineCycle;
+    sState.nPrevLineCycle = g_nPrevLineCycle;
+    sState.nMemAccessBase = pMemAccessBase - aMemAccesses;
+    sState.nMemAccessIndex = nMemAccessIndex;
+    sState.nFastBooting = g_nFastBooting;
+    sState.bOpcode = g_bOpcode;
+    sState.bPrefix = (pNewHlIxIy == &ix) ? 1 : (pNewHlIxIy == &iy) ? 2 : 0;
+    sState.fReset = fReset;
+    sState.fMemContention = fMemContention;
+
+    // Event times are absolute, and stay valid as the cycle counter is saved with them
+    sState.dwEventOrder = dwEventOrder;
+    memcpy(sState.asEvents, asCpuEvents, sizeof sState.asEvents);
+
+    State::Write(&sState, sizeof sState);
+}
+
+bool CPU::LoadState ()
+{
+    CPU_STATE sState;
+    if (!State::Read(&sState, sizeof sState) ||
+        (sState.nMemAccessBase != 0 && sState.nMemAccessBase != 5 * MEM_ACCESS_LINE) ||
+        sState.nMemAccessIndex < 0 || sState.nMemAccessIndex > 3 * MEM_ACCESS_LINE)
+        return false;
+
+    regs = sState.sRegs;
+    radjust = sState.dwRadjust;
+    g_dwCycleCounter = sState.dwCycleCounter;
+    g_nLine = sState.nLine;
+    g_nLineCycle = sState.nLineCycle;
+    g_nPrevLineCycle = sState.nPrevLineCycle;
+    nMemAccessIndex = sState.nMemAccessIndex;
+    g_nFastBooting = sState.nFastBooting;
+    g_bOpcode = sState.bOpcode;
+    pNewHlIxIy = (sState.bPrefix == 1) ? &ix : (sState.bPrefix == 2) ? &iy : &hl;
+    fReset = sState.fReset;
+
+    dwEventOrder = sState.dwEventOrder;
+    memcpy(asCpuEvents, sState.asEvents, sizeof sState.asEvents);
+    Trap::Cancel();
+    UpdateNextEvent();
+
+    // The contention tables are restored as they were, rather than worked out again from the mode and border,
+    // as they're only updated on changes and may not match them yet after a reset
+    pMemAccessBase = aMemAccesses + sState.nMemAccessBase;
+    fMemContention = sState.fMemContention;
+    SetContention();
+
+    // All of memory has changed under any decoded code
+    InvalidateCode();
+
+    return true;
+}
+
 void CPU::NMI()
 {
     // Advance PC if we're stopped on a HALT
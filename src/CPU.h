@@ -23,6 +23,8 @@
 #ifndef Z80_H
 #define Z80_H
 
+#include <assert.h>
+
 #include "SAM.h"
 #include "IO.h"
 #include "Util.h"
@@ -33,6 +35,7 @@ struct _Z80Regs;
 class CPU
 {
     public:
+        static void InitTables ();
         static bool Init (bool fFirstInit_=false);
         static void Exit (bool fReInit_=false);
 
@@ -43,17 +46,24 @@ class CPU
 
         static void Reset (bool fPress_);
         static void NMI ();
+        static void InvalidateCode ();
+
+        static void SaveState ();
+        static bool LoadState ();
 
         static void InitTests ();
+
+    protected:
+        template <bool fDebug_, bool fContend_> static void ExecuteCore ();
 };
 
 
-extern struct _Z80Regs regs;
-extern DWORD g_dwCycleCounter, radjust;
-extern int g_nLine, g_nLineCycle, g_nPrevLineCycle;
-extern bool g_fBreak, g_fPaused, g_fTurbo;
-extern int g_nFastBooting;
-extern BYTE *pbMemRead1, *pbMemRead2, *pbMemWrite1, *pbMemWrite2;
+extern MACHINE_LOCAL struct _Z80Regs regs;
+extern MACHINE_LOCAL DWORD g_dwCycleCounter, radjust;
+extern MACHINE_LOCAL int g_nLine, g_nLineCycle, g_nPrevLineCycle;
+extern MACHINE_LOCAL bool g_fBreak, g_fPaused, g_fTurbo;
+extern MACHINE_LOCAL int g_nFastBooting;
+extern MACHINE_LOCAL BYTE *pbMemRead1, *pbMemRead2, *pbMemWrite1, *pbMemWrite2;
 
 const BYTE OP_NOP   = 0x00;     // Z80 opcode for NOP
 const BYTE OP_DJNZ  = 0x10;     // Z80 opcode for DJNZ
@@ -65,6 +75,7 @@ const BYTE OP_CALL  = 0xcd;     // Z80 opcode for CALL
 const BYTE OP_DI    = 0xf3;     // Z80 opcode for DI
 const BYTE OP_EI    = 0xfb;     // Z80 opcode for EI
 const BYTE OP_JPHL  = 0xe9;     // Z80 opcode for JP (HL)
+const BYTE OP_ED    = 0xed;     // Z80 prefix for ED instructions
 
 const BYTE IX_PREFIX = 0xdd;    // Opcode prefix used for IX instructions
 const BYTE IY_PREFIX = 0xfd;    // Opcode prefix used for IY instructions
@@ -98,7 +109,8 @@ typedef struct _CPU_EVENT
 {
     int     nEvent;
     DWORD   dwTime;
-    struct  _CPU_EVENT  *psNext;
+    DWORD   dwOrder;        // Scheduling order, so events due at the same time run newest first
+    bool    fPending;
 }
 CPU_EVENT;
 
@@ -132,32 +144,49 @@ typedef struct _Z80Regs
 Z80Regs;
 
 
-// CPU Event Queue data
-enum    { evtStdIntStart, evtStdIntEnd, evtMidiOutIntStart, evtMidiOutIntEnd, evtEndOfLine, evtInputUpdate };
+// CPU Event slots, one per event type.  Devices needing their own timed event add an entry before evtCount
+// and a case to CPU::ExecuteEvent, and as each type has a fixed slot there is no limit to fill up.  A slot
+// holds only one pending event, so a type mustn't be added again until it has run or been cancelled.
+enum    { evtStdIntStart, evtStdIntEnd, evtMidiOutIntStart, evtMidiOutIntEnd, evtEndOfLine, evtInputUpdate, evtTrapCheck, evtCount };
 
-const int MAX_EVENTS = 16;
+extern MACHINE_LOCAL CPU_EVENT asCpuEvents[evtCount], *psNextEvent;
+extern MACHINE_LOCAL DWORD dwNextEventTime, dwEventOrder;
 
-extern CPU_EVENT asCpuEvents[MAX_EVENTS], *psNextEvent, *psFreeEvent;
 
+void UpdateNextEvent ();
+
+inline bool IsCpuEventPending (int nEvent_)
+{
+    return asCpuEvents[nEvent_].fPending;
+}
 
-// Add a CPU event into the queue
+// Schedule a CPU event, which mustn't already be pending
 inline void AddCpuEvent (int nEvent_, DWORD dwTime_)
 {
-    CPU_EVENT *psNextFree = psFreeEvent->psNext;
-    CPU_EVENT **ppsEvent = &psNextEvent;
+    CPU_EVENT* pEvent = &asCpuEvents[nEvent_];
+    assert(!pEvent->fPending);
 
-    // Search through the queue while the events come before the new one
-    while (*ppsEvent && ((int)(dwTime_ - (*ppsEvent)->dwTime) > 0))
-        ppsEvent = &((*ppsEvent)->psNext);
+    pEvent->nEvent = nEvent_;
+    pEvent->dwTime = dwTime_;
+    pEvent->dwOrder = ++dwEventOrder;
+    pEvent->fPending = true;
 
-    // Set this event (note - psFreeEvent will never be NULL)
-    psFreeEvent->nEvent = nEvent_;
-    psFreeEvent->dwTime = dwTime_;
+    // An event due no later than the current next event replaces it, as the newest runs first at the same time
+    if (!psNextEvent || static_cast<int>(dwTime_ - dwNextEventTime) <= 0)
+    {
+        psNextEvent = pEvent;
+        dwNextEventTime = dwTime_;
+    }
+}
 
-    // Link the events
-    psFreeEvent->psNext = *ppsEvent;
-    *ppsEvent = psFreeEvent;
-    psFreeEvent = psNextFree;
+// Remove a pending CPU event, if any
+inline void CancelCpuEvent (int nEvent_)
+{
+    if (asCpuEvents[nEvent_].fPending)
+    {
+        asCpuEvents[nEvent_].fPending = false;
+        UpdateNextEvent();
+    }
 }
 
 // Update the line/global counters and check for pending events
@@ -167,14 +196,13 @@ inline void CheckCpuEvents ()
     g_dwCycleCounter += (g_nLineCycle - g_nPrevLineCycle);
     g_nPrevLineCycle = g_nLineCycle;
 
-    // Check for pending CPU events (note - psNextEvent will never be NULL *at this stage*)
-    while ((int)(g_dwCycleCounter - psNextEvent->dwTime) >= 0)
+    // Check for pending CPU events
+    while (static_cast<int>(g_dwCycleCounter - dwNextEventTime) >= 0)
     {
-        // Get the event from the queue and remove it before new events are added
+        // Take the event from its slot before new events are added
         CPU_EVENT sThisEvent = *psNextEvent;
-        psNextEvent->psNext = psFreeEvent;
-        psFreeEvent = psNextEvent;
-        psNextEvent = sThisEvent.psNext;
+        psNextEvent->fPending = false;
+        UpdateNextEvent();
         CPU::ExecuteEvent(sThisEvent);
     }
 }
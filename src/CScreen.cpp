@@ -32,10 +32,10 @@
 #include "Font.h"
 
 
-int nClipX, nClipY, nClipWidth, nClipHeight;    // Clip box for any screen drawing
+MACHINE_LOCAL int nClipX, nClipY, nClipWidth, nClipHeight;    // Clip box for any screen drawing
 
-const GUIFONT* pFont = &sOldFont;
-bool fFixedWidth = false;
+MACHINE_LOCAL const GUIFONT* pFont = &sOldFont;
+MACHINE_LOCAL bool fFixedWidth = false;
 
 CScreen::CScreen (int nWidth_, int nHeight_)
 {
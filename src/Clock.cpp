@@ -35,7 +35,7 @@
 #include "Options.h"
 
 
-time_t CClockDevice::s_tEmulated;
+MACHINE_LOCAL time_t CClockDevice::s_tEmulated;
 
 CClockDevice::CClockDevice ()
 {
@@ -120,7 +120,7 @@ void CClockDevice::Update ()
                 while (1)
                 {
                     // Table for the number of days in each month
-                    static int anDays[] = { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+                    static MACHINE_LOCAL int anDays[] = { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 
                     // The years are relative to 1900, so add that on before considering leap years
                     nYear += 1900;
@@ -181,7 +181,7 @@ int CClockDevice::GetDayOfWeek ()
 
 /*static*/ void CClockDevice::FrameUpdate ()
 {
-    static int nFrames = 0;
+    static MACHINE_LOCAL int nFrames = 0;
 
     // Every one second we advance the emulation relative time
     if (!(++nFrames %= EMULATED_FRAMES_PER_SECOND))
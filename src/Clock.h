@@ -54,7 +54,7 @@ class CClockDevice : public CIoDevice
         time_t m_tLast;
         SAMTIME m_st;
 
-        static time_t s_tEmulated;  // Holds the current time relative to the emulation speed
+        static MACHINE_LOCAL time_t s_tEmulated;  // Holds the current time relative to the emulation speed
 };
 
 
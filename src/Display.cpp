@@ -38,8 +38,17 @@
 #include "psp_danzeff.h"
 #include "psp_gu.h"
 
-bool* Display::pafDirty;
-SDL_Rect rSource, rTarget;
+MACHINE_LOCAL bool* Display::pafDirty;
+MACHINE_LOCAL BYTE *Display::pabDirtyFrom, *Display::pabDirtyTo;
+MACHINE_LOCAL SDL_Rect rSource, rTarget;
+
+// Where frame lines go on the blit surface, centred as loc_Draw_blit does, and a line for any that miss it
+static MACHINE_LOCAL int nHostTop, nHostLeftLo, nHostLeftHi;
+static MACHINE_LOCAL WORD* pwSpareLine;
+
+// Display buffers still to be given the current surface, and whether anything was drawn over the last one
+static MACHINE_LOCAL int nStaleBuffers;
+static MACHINE_LOCAL bool fLastOverlay;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -77,6 +86,14 @@ bool Display::Init (bool fFirstInit_/*=false*/)
     Exit(true);
 
     pafDirty = new bool[Frame::GetHeight()];
+    pabDirtyFrom = new BYTE[Frame::GetHeight()];
+    pabDirtyTo = new BYTE[Frame::GetHeight()];
+    pwSpareLine = new WORD[Frame::GetWidth()];
+
+    int nWidth = Frame::GetWidth();
+    nHostTop = (SIM_HEIGHT - (Frame::GetHeight() >> 1)) / 2;
+    nHostLeftHi = max(0, (SIM_WIDTH - nWidth) / 2);
+    nHostLeftLo = max(0, (SIM_WIDTH - (nWidth >> 1)) / 2);
 
     // These will be updated to the appropriate values on the first draw
     rSource.w = rTarget.w = Frame::GetWidth();
@@ -90,19 +107,40 @@ void Display::Exit (bool fReInit_/*=false*/)
     Video::Exit(fReInit_);
 
     if (pafDirty) { delete[] pafDirty; pafDirty = NULL; }
+    if (pabDirtyFrom) { delete[] pabDirtyFrom; pabDirtyFrom = NULL; }
+    if (pabDirtyTo) { delete[] pabDirtyTo; pabDirtyTo = NULL; }
+    if (pwSpareLine) { delete[] pwSpareLine; pwSpareLine = NULL; }
 }
 
 void Display::SetDirty ()
 {
     // Mark all display lines dirty
     for (int i = 0, nHeight = Frame::GetHeight() ; i < nHeight ; i++)
+    {
         pafDirty[i] = true;
+        pabDirtyFrom[i] = 0;
+        pabDirtyTo[i] = 0xff;
+    }
+}
+
+// Start of a frame line drawn straight into the blit surface, in the same place the blit would put it
+WORD* Display::GetHostLine (int nLine_, bool fHiRes_)
+{
+    int nRow = nHostTop + nLine_;
+    if (nRow < 0 || nRow >= SIM_HEIGHT)
+        return pwSpareLine;
+
+    BYTE* pbRow = reinterpret_cast<BYTE*>(blit_surface->pixels) + nRow * blit_surface->pitch;
+    return reinterpret_cast<WORD*>(pbRow) + (fHiRes_ ? nHostLeftHi : nHostLeftLo);
 }
 
 #define SIM_V_WIDTH  288
 #define SIM_V_HEIGHT 194
 
-static void
+// Convert the dirty blocks of each line, returning true if there were any.  The scanline row under each
+// line is covered by the line below, except under the last line and at the left edge of a low-res line
+// that follows a high-res one, as it doesn't reach as far left.
+static bool
 loc_Draw_blit(CScreen* pScreen_)
 {
 static int loc_draw_border = 0;
@@ -114,7 +152,6 @@ static int loc_draw_border = 0;
   bool *pfDirty = Display::pafDirty, *pfHiRes = pScreen_->GetHiRes();
 
   BYTE *pbSAM = pScreen_->GetLine(0);
-  BYTE *pb    = pbSAM;
   long lPitch = pScreen_->GetPitch();
 
   int nShift  = 1;
@@ -131,31 +168,114 @@ static int loc_draw_border = 0;
   int delta_x_lo = (SIM_WIDTH - nRightLo)  / 2;
   if (delta_x_lo < 0) delta_x_lo = 0;
 
-  int y = nBottom;
-  while (y-- > 0) {
-    short *pds = pdsScan;
-    int delta_x;
+  bool fChanged = false;
+
+  for (int y = 0 ; y < nBottom ; y++, pbSAM += lPitch, pdsScan += lPitchDW) {
+    bool fDirty = pfDirty[y];
+    int delta_x = pfHiRes[y] ? delta_x_hi : delta_x_lo;
 
-    if (*pfHiRes++) delta_x = delta_x_hi;
-    else            delta_x = delta_x_lo;
-    pds += delta_x;
+    // Pixel range of the dirty blocks, which the full line span runs past the end of
+    int nBlockShift = pfHiRes[y] ? 4 : 3, nMax = SIM_WIDTH - delta_x;
+    int nFrom = 0, nTo = 0;
 
-    int len = SIM_WIDTH - delta_x;
-    while (len-- > 0) {
-      *pds++ = aulPalette[*pb++];
+    if (fDirty) {
+      nFrom = min(Display::pabDirtyFrom[y] << nBlockShift, nMax);
+      nTo = min(Display::pabDirtyTo[y] << nBlockShift, nMax);
+
+      short *pds = pdsScan + delta_x;
+      for (int x = nFrom ; x < nTo ; x++) {
+        pds[x] = aulPalette[pbSAM[x]];
+      }
+
+      pfDirty[y] = false;
+      fChanged = true;
     }
-    pb  = pbSAM;
-    pds = (short *)(pdsScan + lPitchDW) + delta_x;
 
-    len = SIM_WIDTH - delta_x;
-    while (len-- > 0) {
-      *pds++ = aulScanline[*pb++];
+    // The strip is redrawn in full if the line below may have only just stopped covering it
+    if (y == nBottom-1)
+      ;
+    else if (pfHiRes[y] && !pfHiRes[y+1] && pfDirty[y+1])
+      nFrom = 0, nTo = delta_x_lo - delta_x_hi;
+    else if (pfHiRes[y] && !pfHiRes[y+1])
+      nTo = min(nTo, delta_x_lo - delta_x_hi);
+    else
+      nTo = 0;
+
+    short *pds = (short *)(pdsScan + lPitchDW) + delta_x;
+    for (int x = nFrom ; x < nTo ; x++) {
+      pds[x] = aulScanline[pbSAM[x]];
     }
-    pb = (pbSAM += lPitch);
-    pdsScan += lPitchDW;
+  }
+
+  return fChanged;
+}
+
+// Darken a 5:6:5 pixel to the scanline level, in the same way AdjustBrightness does for the palette
+static inline WORD
+loc_Scanline_pixel(WORD w, int nOffset, int nMult)
+{
+  int r = (w >> 11), g = (w >> 5) & 0x3f, b = w & 0x1f;
+
+  r = (nOffset >> 3) + (r * nMult / 100);
+  g = (nOffset >> 2) + (g * nMult / 100);
+  b = (nOffset >> 3) + (b * nMult / 100);
+
+  return (r << 11) | (g << 5) | b;
+}
+
+// Darken pixels [nFrom_,nTo_) of a direct colour line into the scanline row below it
+static void
+loc_Draw_scanline_row(int nLine_, bool fHiRes_, int nFrom_, int nTo_, int nOffset_, int nMult_)
+{
+  int nRow = nHostTop + nLine_;
+  if (nRow < 0 || nRow+1 >= SIM_HEIGHT)
+    return;
+
+  WORD* pwFrom = Display::GetHostLine(nLine_, fHiRes_);
+  WORD* pwTo = reinterpret_cast<WORD*>(reinterpret_cast<BYTE*>(pwFrom) + blit_surface->pitch);
+
+  for (int x = nFrom_ ; x < nTo_ ; x++) {
+    pwTo[x] = loc_Scanline_pixel(pwFrom[x], nOffset_, nMult_);
   }
 }
 
+// Direct colour frames are already on the surface, leaving only the parts of the scanline rows that
+// the blit would leave showing: under the last line, and left of a low-res line below a high-res one
+static bool
+loc_Draw_scanline(CScreen* pScreen_)
+{
+  bool *pfDirty = Display::pafDirty;
+  int nLast = (pScreen_->GetHeight() >> 1) - 1;
+
+  int nAdjust = GetOption(scanlines) ? (GetOption(scanlevel) - 100) : 0;
+  if (nAdjust < -100) nAdjust = -100;
+  int nOffset = (nAdjust <= 0) ? 0 : nAdjust;
+  int nMult = 100 - ((nAdjust <= 0) ? -nAdjust : nAdjust);
+
+  bool fChanged = false;
+
+  for (int i = 0 ; i < nLast ; i++) {
+    if (pScreen_->IsHiRes(i) && !pScreen_->IsHiRes(i+1) && (pfDirty[i] || pfDirty[i+1]))
+      loc_Draw_scanline_row(i, true, 0, nHostLeftLo - nHostLeftHi, nOffset, nMult);
+
+    fChanged |= pfDirty[i];
+    pfDirty[i] = false;
+  }
+
+  if (nLast >= 0 && pfDirty[nLast]) {
+    bool fHiRes = pScreen_->IsHiRes(nLast);
+    int nBlockShift = fHiRes ? 4 : 3, nMax = SIM_WIDTH - (fHiRes ? nHostLeftHi : nHostLeftLo);
+
+    loc_Draw_scanline_row(nLast, fHiRes, min(Display::pabDirtyFrom[nLast] << nBlockShift, nMax),
+                          min(Display::pabDirtyTo[nLast] << nBlockShift, nMax), nOffset, nMult);
+
+    pfDirty[nLast] = false;
+    fChanged = true;
+  }
+
+  return fChanged;
+}
+
 static inline void 
 loc_Apply_step_x(SDL_Rect* a_rect)
 {
@@ -348,7 +468,17 @@ loc_Draw_gu_max_height()
 bool 
 DrawChanges (CScreen* pScreen_, SDL_Surface* pSurface_)
 {
-  loc_Draw_blit(pScreen_);
+  bool fChanged = Frame::IsDirectColour() ? loc_Draw_scanline(pScreen_) : loc_Draw_blit(pScreen_);
+
+  // Only scale the surface while the display buffers don't all show it yet, or something is drawn over it
+  bool fOverlay = psp_kbd_is_danzeff_mode() || GetOption(display_lr);
+  if (fChanged || fOverlay || fLastOverlay)
+    nStaleBuffers = 2;
+  fLastOverlay = fOverlay;
+
+  if (!nStaleBuffers)
+    return false;
+  nStaleBuffers--;
 
   int RenderMode = GetOption(render_mode);
 
@@ -430,7 +560,12 @@ void Display::Update (CScreen* pScreen_)
       int view_fps = GetOption(view_fps);
       if (view_fps) {
         char buffer[32];
-        sprintf(buffer, "%3d", (int)sim_current_fps);
+        // While warping, show how many times real speed we're running at instead
+        int speed = Frame::GetSpeed();
+        if (Frame::IsWarping())
+          sprintf(buffer, "x%d.%d", speed / 100, (speed % 100) / 10);
+        else
+          sprintf(buffer, "%3d", (int)sim_current_fps);
         psp_sdl_fill_print(0, 0, buffer, 0xffffff, 0 );
       }
 
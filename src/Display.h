@@ -32,19 +32,37 @@ class Display
         static void Exit (bool fReInit_=false);
 
         static bool IsLineDirty (int nLine_) { return pafDirty[nLine_]; }
-        static void SetLineDirty (int nLine_) { pafDirty[nLine_] = true; }
+        static void SetLineDirty (int nLine_, int nFrom_=0, int nTo_=0xff);
         static void SetDirty ();
 
         static void Update (CScreen* pScreen_);
+        static WORD* GetHostLine (int nLine_, bool fHiRes_);
 
         static void DisplayToSamSize (int* pnX_, int* pnY_);
         static void SamToDisplaySize (int* pnX_, int* pnY_);
         static void DisplayToSamPoint (int* pnX_, int* pnY_);
         static void SamToDisplayPoint (int* pnX_, int* pnY_);
 
-        static bool* pafDirty;
+        static MACHINE_LOCAL bool* pafDirty;
+        static MACHINE_LOCAL BYTE *pabDirtyFrom, *pabDirtyTo;   // Blocks of each dirty line to show again
 };
 
-extern SDL_Rect rSource, rTarget;
+// Mark blocks [nFrom_,nTo_) of a line as needing showing again, adding to any it already has
+inline void Display::SetLineDirty (int nLine_, int nFrom_/*=0*/, int nTo_/*=0xff*/)
+{
+    if (!pafDirty[nLine_])
+    {
+        pafDirty[nLine_] = true;
+        pabDirtyFrom[nLine_] = nFrom_;
+        pabDirtyTo[nLine_] = nTo_;
+    }
+    else
+    {
+        pabDirtyFrom[nLine_] = min(static_cast<int>(pabDirtyFrom[nLine_]), nFrom_);
+        pabDirtyTo[nLine_] = max(static_cast<int>(pabDirtyTo[nLine_]), nTo_);
+    }
+}
+
+extern MACHINE_LOCAL SDL_Rect rSource, rTarget;
 
 #endif  // DISPLAY_H
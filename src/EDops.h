@@ -26,6 +26,9 @@
 // Changes 1999-2001 by Simon Owen
 //  - Fixed INI/IND so the zero flag is set when B becomes zero
 
+// Block instructions run further passes without returning to the main loop when nothing can happen
+// in between, with block_load/block_compare/repeat_io from CPU.cpp deciding when that's the case
+
 
 // Basic instruction header, specifying opcode and nominal T-States of the first M-Cycle (AFTER the ED code)
 // The first three T-States of the first M-Cycle are already accounted for
@@ -94,6 +97,7 @@
                             if (loop) { \
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
+                                block_load(1); \
                             } \
                         } while (0)
 
@@ -110,6 +114,7 @@
                             if (loop) { \
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
+                                block_load(-1); \
                             } \
                         } while (0)
 
@@ -126,6 +131,7 @@
                             if (loop) { \
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
+                                block_compare(1); \
                             } \
                         } while (0)
 
@@ -142,6 +148,7 @@
                             if (loop) { \
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
+                                block_compare(-1); \
                             } \
                         } while (0)
 
@@ -157,7 +164,7 @@
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
                             } \
-                        } while (0)
+                        } while ((loop) && repeat_io(5))
 
 // Input; decrement; [repeat]
 #define ind(loop)       do { \
@@ -171,7 +178,7 @@
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
                             } \
-                        } while (0)
+                        } while ((loop) && repeat_io(5))
 
 // I can't determine the correct flags outcome for the block OUT instructions.
 // Spec says that the carry flag is left unchanged and N is set to 1, but that
@@ -189,7 +196,7 @@
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
                             } \
-                        } while (0)
+                        } while ((loop) && repeat_io(5))
 
 // Output; decrement; [repeat]
 #define otd(loop)       do { \
@@ -203,7 +210,7 @@
                                 g_nLineCycle += 5; \
                                 pc -= 2; \
                             } \
-                        } while (0)
+                        } while ((loop) && repeat_io(5))
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -347,6 +354,14 @@ edinstr(5,0253) otd(false);                                         endinstr;
 edinstr(5,0263) oti(b);                                             endinstr;   // otir
 edinstr(5,0273) otd(b);                                             endinstr;   // otdr
 
+#ifdef USE_HEADLESS
+// Emulator trap used by the headless instruction exerciser, otherwise a NOP like the rest
+edinstr(4,0376)
+    SAVE_CACHED_STATE();
+    Z80Test::TrapHook();
+    LOAD_CACHED_STATE();
+endinstr;
+#endif
 
 // Anything not explicitly handled is effectively a 2 byte NOP (with predictable timing)
 // Only the first three T-States are already accounted for
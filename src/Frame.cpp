@@ -25,9 +25,24 @@
 //
 //  The actual drawing work is done by a template class in Frame.h, depending
 //  on whether or not the current line is high resolution.
+//
+//  With the DirectColour option the frame is instead drawn straight into the
+//  16-bit host surface (see Display::GetHostLine), saving the conversion.
+//  The CScreen version is still drawn while the GUI is active, a screenshot
+//  is waiting to be saved, or input is being recorded or replayed, as they
+//  all need the palette colours.
+//
+//  Rather than keeping a copy of the last frame to compare against, each
+//  completed line is reduced to a two-DWORD signature, and only lines whose
+//  signature has changed are marked dirty for the display to redraw.
+//
+//  The CScreen is only drawn where it may have changed: the blocks of each
+//  line written since it was last drawn (see NoteWrites), or the whole frame
+//  after a change to anything else it depends on, such as the mode, border
+//  or palette (see SetDirty).  Writes behind the drawing position show from
+//  the next frame, so they're kept apart until then.
 
 // ToDo:
-//  - change from dirty lines to dirty rectangles, to reduce rendering further
 //  - maybe move away from the template class, as it's not as useful anymore
 
 #include "SimCoupe.h"
@@ -39,6 +54,8 @@
 #include "Options.h"
 #include "OSD.h"
 #include "PNG.h"
+#include "Record.h"
+#include "Sound.h"
 #include "Util.h"
 #include "UI.h"
 
@@ -50,29 +67,67 @@ const BYTE LED_OFF_COLOUR       = GREY_2;     // Dark grey light off colour
 const BYTE UNDRAWN_COLOUR       = GREY_3;     // Mid grey for undrawn screen background
 
 const unsigned int STATUS_ACTIVE_TIME = 2500;   // Time the status text is visible for (in ms)
-const unsigned int FPS_IN_TURBO_MODE = 5;       // Number of FPS to limit to in Turbo mode
+const unsigned int SPEED_SAMPLE_TIME = 1000;    // Time the emulation speed is measured over (in ms)
 
-int s_nViewTop, s_nViewBottom;
-int s_nViewLeft, s_nViewRight;
-int s_nViewWidth, s_nViewHeight;
+MACHINE_LOCAL int s_nViewTop, s_nViewBottom;
+MACHINE_LOCAL int s_nViewLeft, s_nViewRight;
+MACHINE_LOCAL int s_nViewWidth, s_nViewHeight;
 
-CScreen *pScreen; 
+MACHINE_LOCAL CScreen *pScreen; 
 //LUDO: CScreen *pGuiScreen;
 //LUDO: CScreen *pLastScreen;
-CFrame *pFrame, *pFrameLow, *pFrameHigh;
+MACHINE_LOCAL CFrame *pFrame, *pFrameLow, *pFrameHigh;
+MACHINE_LOCAL CFrame *apFrames[2][2];          // Lo-res and hi-res renderers for the CScreen and for host pixels
+
+MACHINE_LOCAL bool fDrawFrame, g_fFlashPhase;
+MACHINE_LOCAL bool fDirect;                   // Current frame drawn straight into host pixels
+MACHINE_LOCAL DWORD* pdwLineSigs;             // Signature of each line as last shown, two DWORDs per line
+
+// Blocks of a line written since it was last drawn, as a range that's empty for a clean line
+typedef struct
+{
+    BYTE bFrom, bTo;
+}
+DIRTY_SPAN;
+
+const DIRTY_SPAN CLEAN_SPAN = { WIDTH_BLOCKS, 0 };
+
+MACHINE_LOCAL DIRTY_SPAN asDirty[HEIGHT_LINES];       // Still to be drawn this frame
+MACHINE_LOCAL DIRTY_SPAN asDirtyNext[HEIGHT_LINES];   // Written behind the drawing position, for the next frame
+MACHINE_LOCAL int nDirtyFrames;               // Drawn frames still to be drawn in full
+MACHINE_LOCAL int nFrame;
+
+MACHINE_LOCAL int nLastLine, nLastBlock;      // Line and block we've drawn up to so far this frame
+MACHINE_LOCAL int nDrawnFrames;               // Frame number in last second and number of those actually drawn
 
-bool fDrawFrame, g_fFlashPhase;
-int nFrame;
+MACHINE_LOCAL DWORD dwStatusTime;             // Time the status line was made visible
 
-int nLastLine, nLastBlock;      // Line and block we've drawn up to so far this frame
-int nDrawnFrames;               // Frame number in last second and number of those actually drawn
+MACHINE_LOCAL bool fWarp;                     // Running flat out, drawing only one frame in warpskip
+MACHINE_LOCAL DWORD dwSpeedTime;              // Start time of the current speed sample
+MACHINE_LOCAL int nSpeedFrames;               // Frames run in the current speed sample
+MACHINE_LOCAL int nSpeed = 100;               // Emulation speed over the last sample, as a percentage of real time
 
-DWORD dwStatusTime;             // Time the status line was made visible
+MACHINE_LOCAL int s_nWidth, s_nHeight;
 
-int s_nWidth, s_nHeight;
+MACHINE_LOCAL char szStatus[128], szProfile[128];
+MACHINE_LOCAL char szScreenPath[MAX_PATH];
 
-char szStatus[128], szProfile[128];
-char szScreenPath[MAX_PATH];
+#ifdef USE_WIDE_RENDER
+MACHINE_LOCAL ATTR_COLOURS g_asAttrColours[256];
+MACHINE_LOCAL bool g_fAttrColoursChanged = true;
+MACHINE_LOCAL WORD g_awMode3Pixels[256], g_awMode4Pixels[256];
+MACHINE_LOCAL DWORD g_adwMode3HiResPixels[256], g_adwMode4HiResPixels[256];
+MACHINE_LOCAL bool g_fMode3PixelsChanged = true, g_fMode4PixelsChanged = true;
+MACHINE_LOCAL ATTR_COLOURS g_asHostAttrColours[256];
+MACHINE_LOCAL DWORD g_adwHostMode3Pixels[256], g_adwHostMode4Pixels[256];
+MACHINE_LOCAL DWORD g_aadwHostMode3HiResPixels[256][2], g_aadwHostMode4HiResPixels[256][2];
+
+// The pixel masks only depend on the data byte, so every machine shares them (see Frame::InitTables)
+DWORD g_aadwPixelMasks[256][2], g_aadwHiResPixelMasks[256][4];
+DWORD g_aadwHostHiResPixelMasks[256][8];
+#endif
+
+static bool fTablesBuilt;
 
 
 typedef struct
@@ -81,7 +136,7 @@ typedef struct
 }
 REGION;
 
-REGION asViews[] =
+MACHINE_LOCAL REGION asViews[] =
 {
     { SCREEN_BLOCKS, SCREEN_LINES },
     { SCREEN_BLOCKS+2, SCREEN_LINES+20 },
@@ -93,6 +148,31 @@ REGION asViews[] =
 void DrawOSD (CScreen* pScreen_);
 void Flip (CScreen*& rpScreen_);
 
+// Build the lookup tables shared by all machines, which must be done before a second machine thread starts
+void Frame::InitTables ()
+{
+    if (fTablesBuilt)
+        return;
+
+#ifdef USE_WIDE_RENDER
+    // Build the masks for the ink pixels of each data byte, in display order whatever the host byte order
+    for (int n = 0 ; n < 256 ; n++)
+    {
+        BYTE* pbMask = reinterpret_cast<BYTE*>(g_aadwPixelMasks[n]);
+        BYTE* pbHiResMask = reinterpret_cast<BYTE*>(g_aadwHiResPixelMasks[n]);
+        BYTE* pbHostMask = reinterpret_cast<BYTE*>(g_aadwHostHiResPixelMasks[n]);
+
+        for (int nBit = 0 ; nBit < 8 ; nBit++)
+        {
+            pbMask[nBit] = pbHiResMask[nBit*2] = pbHiResMask[nBit*2+1] = (n & (0x80 >> nBit)) ? 0xff : 0x00;
+            memset(pbHostMask + nBit*4, pbMask[nBit], 4);
+        }
+    }
+#endif
+
+    fTablesBuilt = true;
+}
+
 bool Frame::Init (bool fFirstInit_/*=false*/)
 {
     bool fRet = true;
@@ -103,6 +183,13 @@ bool Frame::Init (bool fFirstInit_/*=false*/)
     // Set the last line and block draw to the start of the display
     nLastLine = nLastBlock = 0;
 
+    // The first machine builds the shared tables
+    InitTables();
+
+#ifdef USE_WIDE_RENDER
+    ChangePalette();
+#endif
+
     UINT uView = GetOption(borders);
     if (uView < 0 || uView >= (sizeof asViews / sizeof asViews[0]))
         uView = 0;
@@ -124,12 +211,21 @@ bool Frame::Init (bool fFirstInit_/*=false*/)
     if ((pScreen = new CScreen(s_nWidth, s_nHeight)) &&
         (pLastScreen = new CScreen(s_nWidth, s_nHeight)) &&
         (pGuiScreen = new CScreen(s_nWidth, s_nHeight)) &&
-        (pFrameLow = new CFrameXx1<false>) && (pFrameHigh = new CFrameXx1<true>))
+        (pFrameLow = new CFrameXx1<false,BYTE>) && (pFrameHigh = new CFrameXx1<true,BYTE>))
 # else
     if ((pScreen = new CScreen(s_nWidth, s_nHeight)) &&
-        (pFrameLow = new CFrameXx1<false>) && (pFrameHigh = new CFrameXx1<true>))
+        (apFrames[0][0] = new CFrameXx1<false,BYTE>) && (apFrames[0][1] = new CFrameXx1<true,BYTE>) &&
+        (apFrames[1][0] = new CFrameXx1<false,WORD>) && (apFrames[1][1] = new CFrameXx1<true,WORD>) &&
+        (pdwLineSigs = new DWORD[s_nHeight << 1]))
 # endif
     {
+        memset(pdwLineSigs, 0, sizeof(DWORD) * (s_nHeight << 1));
+
+        for (int i = 0 ; i < HEIGHT_LINES ; i++)
+            asDirty[i] = asDirtyNext[i] = CLEAN_SPAN;
+        nDirtyFrames = 0;
+        SetDirty();
+
         Start();
         ChangeMode(vmpr);
         fRet = Display::Init(fFirstInit_);
@@ -150,11 +246,17 @@ void Frame::Exit (bool fReInit_/*=false*/)
     TRACE("-> Frame::Exit(%s)\n", fReInit_ ? "reinit" : "");
     Display::Exit(fReInit_);
 
-    if (pFrameHigh != pFrameLow)
-        delete pFrameHigh;
-    delete pFrameLow;
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        delete apFrames[i][0];
+        delete apFrames[i][1];
+        apFrames[i][0] = apFrames[i][1] = NULL;
+    }
     pFrame = pFrameHigh = pFrameLow = NULL;
 
+    delete[] pdwLineSigs;
+    pdwLineSigs = NULL;
+
     delete pScreen;
     //LUDO: delete pGuiScreen;
     //LUDO: delete pLastScreen;
@@ -165,11 +267,121 @@ void Frame::Exit (bool fReInit_/*=false*/)
 }
 
 
+// Rebuild the mode 1 and 2 attribute colours from the CLUT, for the current flash phase
+void Frame::UpdateAttrColours ()
+{
+#ifdef USE_WIDE_RENDER
+    for (int n = 0 ; n < 256 ; n++)
+    {
+        BYTE bAttr = n, bInk = AttrFg(bAttr), bPaper = AttrBg(bAttr);
+
+        // Swap the colours if we're in the inverse part of the FLASH cycle
+        if (g_fFlashPhase && (bAttr & 0x80))
+            swap(bInk, bPaper);
+
+        DWORD dwInk = clutval[bInk] * 0x01010101, dwPaper = clutval[bPaper] * 0x01010101;
+        g_asAttrColours[n].dwPaper = dwPaper;
+        g_asAttrColours[n].dwInkXor = dwInk ^ dwPaper;
+
+        dwInk = aulPalette[clutval[bInk]] * 0x00010001, dwPaper = aulPalette[clutval[bPaper]] * 0x00010001;
+        g_asHostAttrColours[n].dwPaper = dwPaper;
+        g_asHostAttrColours[n].dwInkXor = dwInk ^ dwPaper;
+    }
+
+    g_fAttrColoursChanged = false;
+#endif
+}
+
+// Rebuild the mode 3 display bytes and host pixels from the 4 colours it has available
+void Frame::UpdateMode3Pixels ()
+{
+#ifdef USE_WIDE_RENDER
+    for (int n = 0 ; n < 256 ; n++)
+    {
+        BYTE* pb = reinterpret_cast<BYTE*>(&g_awMode3Pixels[n]);
+        BYTE* pbHiRes = reinterpret_cast<BYTE*>(&g_adwMode3HiResPixels[n]);
+
+        pb[0] = pbHiRes[1] = mode3clutval[(n & 0x30) >> 4];
+        pb[1] = pbHiRes[3] = mode3clutval[(n & 0x03)     ];
+        pbHiRes[0] = mode3clutval[ n         >> 6];
+        pbHiRes[2] = mode3clutval[(n & 0x0c) >> 2];
+
+        WORD* pw = reinterpret_cast<WORD*>(&g_adwHostMode3Pixels[n]);
+        WORD* pwHiRes = reinterpret_cast<WORD*>(g_aadwHostMode3HiResPixels[n]);
+
+        for (int i = 0 ; i < 4 ; i++)
+            pwHiRes[i] = aulPalette[pbHiRes[i]];
+        pw[0] = pwHiRes[1];
+        pw[1] = pwHiRes[3];
+    }
+
+    g_fMode3PixelsChanged = false;
+#endif
+}
+
+// Rebuild the mode 4 display bytes and host pixels from the CLUT
+void Frame::UpdateMode4Pixels ()
+{
+#ifdef USE_WIDE_RENDER
+    for (int n = 0 ; n < 256 ; n++)
+    {
+        BYTE* pb = reinterpret_cast<BYTE*>(&g_awMode4Pixels[n]);
+        BYTE* pbHiRes = reinterpret_cast<BYTE*>(&g_adwMode4HiResPixels[n]);
+
+        pb[0] = pbHiRes[0] = pbHiRes[1] = clutval[n >> 4];
+        pb[1] = pbHiRes[2] = pbHiRes[3] = clutval[n & 0x0f];
+
+        WORD* pw = reinterpret_cast<WORD*>(&g_adwHostMode4Pixels[n]);
+        WORD* pwHiRes = reinterpret_cast<WORD*>(g_aadwHostMode4HiResPixels[n]);
+
+        pw[0] = pwHiRes[0] = pwHiRes[1] = aulPalette[pb[0]];
+        pw[1] = pwHiRes[2] = pwHiRes[3] = aulPalette[pb[1]];
+    }
+
+    g_fMode4PixelsChanged = false;
+#endif
+}
+
+
 CScreen* Frame::GetScreen ()
 {
     return pScreen;
 }
 
+// Checksum the last complete frame, to compare runs without keeping the image
+// Only frames drawn to the CScreen are covered, which is all of them while recording or replaying
+DWORD Frame::GetChecksum ()
+{
+    DWORD dwSum = 0;
+
+    for (int nLine = 0 ; nLine < pScreen->GetHeight() ; nLine++)
+    {
+        const BYTE* pcb = pScreen->GetLine(nLine);
+        for (int n = 0 ; n < pScreen->GetPitch() ; n++)
+            dwSum = dwSum * 31 + pcb[n];
+    }
+
+    return dwSum;
+}
+
+// Whether the last frame was run in warp mode, unsynced and mostly undrawn
+bool Frame::IsWarping ()
+{
+    return fWarp;
+}
+
+// Whether the current frame is being drawn straight into host pixels, rather than to the CScreen
+bool Frame::IsDirectColour ()
+{
+    return fDirect;
+}
+
+// Emulation speed measured over the last second, as a percentage of real time
+int Frame::GetSpeed ()
+{
+    return nSpeed;
+}
+
 int Frame::GetWidth ()
 {
     return pScreen->GetPitch();
@@ -192,6 +404,19 @@ void Frame::SetView (UINT uBlocks_, UINT uLines_)
 }
 
 
+// Draw part of a line, or only the blocks of it that may have changed since it was last drawn
+static inline void DrawLine (CFrame* pFrame_, int nLine_, int nFrom_, int nTo_)
+{
+    if (!nDirtyFrames)
+    {
+        nFrom_ = max(nFrom_, static_cast<int>(asDirty[nLine_].bFrom));
+        nTo_ = min(nTo_, static_cast<int>(asDirty[nLine_].bTo));
+    }
+
+    if (nFrom_ < nTo_)
+        pFrame_->UpdateLine(nLine_, nFrom_, nTo_);
+}
+
 // Update the frame image to the current raster position
 void Frame::Update ()
 {
@@ -216,7 +441,7 @@ void Frame::Update ()
     {
         if (nBlock > nLastBlock)
         {
-            pFrame->UpdateLine(nLine, nLastBlock, nBlock);
+            DrawLine(pFrame, nLine, nLastBlock, nBlock);
             nLastBlock = nBlock;
         }
     }
@@ -236,7 +461,7 @@ void Frame::Update ()
             if (nFrom == nLastLine)
             {
                 // Finish the line using the current renderer, and exclude it from the draw range
-                pFrame->UpdateLine(nLastLine, nLastBlock, WIDTH_BLOCKS);
+                DrawLine(pFrame, nLastLine, nLastBlock, WIDTH_BLOCKS);
                 nFrom++;
             }
 
@@ -245,7 +470,7 @@ void Frame::Update ()
             {
                 bool fHiRes = (vmpr_mode == MODE_3) && IsScreenLine(nLine);
                 pScreen->SetHiRes(nLine-s_nViewTop, fHiRes);
-                (pFrame = fHiRes ? pFrameHigh : pFrameLow)->UpdateLine(nLine, 0, nBlock);
+                DrawLine(pFrame = fHiRes ? pFrameHigh : pFrameLow, nLine, 0, nBlock);
 
                 // Exclude the line from the block as we've drawn it now
                 nTo--;
@@ -259,7 +484,7 @@ void Frame::Update ()
             {
                 bool fHiRes = (vmpr_mode == MODE_3) && IsScreenLine(i);
                 pScreen->SetHiRes(i-s_nViewTop, fHiRes);
-                (pFrame = fHiRes ? pFrameHigh : pFrameLow)->UpdateLine(i, 0, WIDTH_BLOCKS);
+                DrawLine(pFrame = fHiRes ? pFrameHigh : pFrameLow, i, 0, WIDTH_BLOCKS);
             }
 
             // If the last line drawn was incomplete, restore the rendered used for it
@@ -301,7 +526,7 @@ void Frame::UpdateAll ()
 // Fill the display after current raster position, currently with a dark grey
 void RasterComplete ()
 {
-    static DWORD dwCycleCounter;
+    static MACHINE_LOCAL DWORD dwCycleCounter;
 
     // Don't do anything if the current frame is being skipped or we've already completed the area
     if (dwCycleCounter == g_dwCycleCounter)
@@ -325,6 +550,10 @@ void RasterComplete ()
     // If there anything to clear?
     if (nTop <= nBottom)
     {
+        // The area cleared will need drawing again from the display memory
+        if (nTop < nBottom)
+            Frame::SetDirty();
+
         // Complete the undrawn section of the current line, if any
         if (nTop == (nLastLine-s_nViewTop))
         {
@@ -332,7 +561,14 @@ void RasterComplete ()
             BYTE* pLine = pScreen->GetLine(nTop, fHiRes); // Fetch fHiRes
 
             int nOffset = nLeft << (fHiRes ? 4 : 3), nWidth = Frame::GetWidth() - nOffset;
-            if (nWidth > 0)
+
+            // Host lines are only as wide as they appear
+            if (fDirect)
+            {
+                if ((nWidth = pScreen->GetWidth(nTop) - nOffset) > 0)
+                    FillHostPixels(Display::GetHostLine(nTop, fHiRes) + nOffset, UNDRAWN_COLOUR, nWidth);
+            }
+            else if (nWidth > 0)
                 memset(pLine + nOffset, UNDRAWN_COLOUR, nWidth);
 
             nTop++;
@@ -340,7 +576,12 @@ void RasterComplete ()
 
         // Fill the remaining lines
         for (int i = nTop ; i < nBottom ; i++)
-            memset(pScreen->GetLine(i), UNDRAWN_COLOUR, Frame::GetWidth());
+        {
+            if (fDirect)
+                FillHostPixels(Display::GetHostLine(i, pScreen->IsHiRes(i)), UNDRAWN_COLOUR, pScreen->GetWidth(i));
+            else
+                memset(pScreen->GetLine(i), UNDRAWN_COLOUR, Frame::GetWidth());
+        }
     }
 
     ProfileEnd();
@@ -382,7 +623,7 @@ void Frame::Complete ()
             SaveFrame(szScreenPath);
 # endif
 
-        static bool fLastActive = false;
+        static MACHINE_LOCAL bool fLastActive = false;
 # if 0 //LUDO:
         if (GUI::IsActive())
         {
@@ -411,20 +652,51 @@ void Frame::Complete ()
         }
         else
 # endif
-# if 0 //LUDO:
         {
+# if 0 //LUDO:
             DrawOSD(pScreen);
+# endif
             Flip(pScreen);
         }
-# endif
         // Redraw what's new
         Redraw();
 
         fLastActive = GUI::IsActive();
     }
 
+    // Writes behind the drawing position are drawn in the next frame, along with anything a skipped frame didn't draw
+    for (int i = 0 ; i < HEIGHT_LINES ; i++)
+    {
+        if (fDrawFrame)
+            asDirty[i] = asDirtyNext[i];
+        else
+        {
+            asDirty[i].bFrom = min(asDirty[i].bFrom, asDirtyNext[i].bFrom);
+            asDirty[i].bTo = max(asDirty[i].bTo, asDirtyNext[i].bTo);
+        }
+
+        asDirtyNext[i] = CLEAN_SPAN;
+    }
+
+    if (fDrawFrame && nDirtyFrames)
+        nDirtyFrames--;
+
     ProfileEnd();
 
+    // Measure the emulation speed, which is shown as a multiplier while warping
+    DWORD dwNow = OSD::GetTime();
+    nSpeedFrames++;
+
+    if (dwNow - dwSpeedTime >= SPEED_SAMPLE_TIME)
+    {
+        // The first sample is only used to set the start time
+        if (dwSpeedTime)
+            nSpeed = static_cast<int>(nSpeedFrames * 100000LL / (EMULATED_FRAMES_PER_SECOND * static_cast<long long>(dwNow - dwSpeedTime)));
+
+        dwSpeedTime = dwNow;
+        nSpeedFrames = 0;
+    }
+
     // Unless we're fast booting, sync to 50Hz and decide whether we should draw the next frame
     if (!g_nFastBooting)
         Sync();
@@ -436,15 +708,34 @@ void Frame::Start ()
     // Last drawn position is the start of the frame
     nLastLine = nLastBlock = 0;
 
+    // Draw straight into host pixels if nothing needs the palette colours of this frame, starting afresh on a change
+    bool fDirectNow = GetOption(directcolour) && !GUI::IsActive() && !szScreenPath[0] && !Record::IsActive();
+    if (fDirectNow != fDirect)
+    {
+        fDirect = fDirectNow;
+        SetDirty();
+    }
+
+    pFrameLow = apFrames[fDirect][0];
+    pFrameHigh = apFrames[fDirect][1];
+
     // Set up for drawing with the appropriate render object
     bool fHiRes = (vmpr_mode == MODE_3) && (s_nViewTop >= TOP_BORDER_LINES);
     pScreen->SetHiRes(0, fHiRes);
     pFrame = fHiRes ? pFrameHigh : pFrameLow;
 
     // Toggle paper/ink colours every 16 emulated frames for the flash attribute in modes 1 and 2
-    static int nFlash = 0;
+    static MACHINE_LOCAL int nFlash = 0;
     if (!(++nFlash % 16))
+    {
         g_fFlashPhase = !g_fFlashPhase;
+#ifdef USE_WIDE_RENDER
+        g_fAttrColoursChanged = true;
+#endif
+        // Any flashing attributes on the screen will need drawing again
+        if (!VMPR_MODE_3_OR_4)
+            SetDirty();
+    }
 
     // If the status line has been visible long enough, hide it
     if (szStatus[0] && ((OSD::GetTime() - dwStatusTime) > STATUS_ACTIVE_TIME))
@@ -455,30 +746,40 @@ void Frame::Start ()
 extern int psp_sim_update_fps();
 extern void psp_sim_synchronize(int speed_limiter);
 
+// Check for disk activity that's worth warping through, with the sensitivity set by the turboload option
+static bool IsDiskActive ()
+{
+    // Real floppy drives can't be hurried, so only images count
+    return GetOption(turboload) &&
+        ((pDrive1 && pDrive1->IsActive() && (pDrive1->GetType() != dskImage || ((CDrive*)pDrive1)->GetDiskType() != dtFloppy)) ||
+         (pDrive2 && pDrive2->IsActive() && (pDrive2->GetType() != dskImage || ((CDrive*)pDrive2)->GetDiskType() != dtFloppy)));
+}
+
 void Frame::Sync ()
 {
 # if 0 //LUDO: 
-    DWORD dwNow = OSD::GetTime();
-
     // Fetch the frame number we should be up to, according to the running timer
     int nTicks = OSD::FrameSync(false);
+# endif
 
-    // Determine whether we're running at increased speed during disk activity
-    bool fTurboDisk = GetOption(turboload) &&
-        ((pDrive1 && pDrive1->IsActive() && (pDrive1->GetType() != dskImage || ((CDrive*)pDrive1)->GetDiskType() != dtFloppy)) ||
-         (pDrive2 && pDrive2->IsActive() && (pDrive2->GetType() != dskImage || ((CDrive*)pDrive2)->GetDiskType() != dtFloppy)));
+    // Warp if asked to, or automatically during disk activity
+    bool fWarpNow = !GUI::IsActive() && (g_fTurbo || (GetOption(warpdisk) && IsDiskActive()));
 
-    // Running in Turbo mode?
-    if (!GUI::IsActive() && (g_fTurbo || fTurboDisk))
+    // Discard anything already buffered for the sound we're about to stop or restart generating
+    if (fWarpNow != fWarp)
     {
-        static DWORD dwLastFrame;
+        fWarp = fWarpNow;
+        Sound::Silence();
+    }
 
-        // Draw 5 frames a second in turbo mode
-        if (fDrawFrame = ((dwNow - dwLastFrame) >= 1000/FPS_IN_TURBO_MODE))
-            dwLastFrame = dwNow;
+    // Running in warp mode?
+    if (fWarp)
+    {
+        // Draw only one frame in warpskip, and run flat out without syncing to anything
+        // Input recordings and replays still draw every frame, so the frame output can be checked
+        fDrawFrame = Record::IsActive() || !(nFrame % max(GetOption(warpskip), 1));
     }
     else
-# endif
     {
         // Whether the next frame gets draw depends on frame-skip setting...
         // In auto-skip mode we'll draw unless we're behind, but leave some slack at the end of the frame just in case
@@ -492,7 +793,8 @@ void Frame::Sync ()
             nTicks = OSD::FrameSync(true);
         ProfileEnd();
 # else
-        fDrawFrame = GetOption(frameskip) ? !(nFrame % (1 + GetOption(frameskip))) : true;
+        // Input recordings and replays draw every frame, so the frame output can be checked
+        fDrawFrame = (GetOption(frameskip) && !Record::IsActive()) ? !(nFrame % (1 + GetOption(frameskip))) : true;
 
         int view_fps = GetOption(view_fps);
         if (view_fps) {
@@ -533,7 +835,8 @@ void Frame::Clear ()
     pScreen->Clear();
     //LUDO: pLastScreen->Clear();
 
-    // Mark the full display as dirty so it gets redrawn
+    // Mark the full frame and display as dirty so they get redrawn
+    SetDirty();
     Display::SetDirty();
 }
 
@@ -546,38 +849,74 @@ void Frame::Redraw ()
 }
 
 
-// Flip buffers, so we can start working on the new frame
+// Two-DWORD signature of a line, which changes with almost any change to its contents
+static inline void GetLineSig (const DWORD* pdw_, int nDWORDs_, bool fHiRes_, DWORD* pdwSig_)
+{
+    DWORD dwA = 0x811c9dc5 ^ fHiRes_, dwB = nDWORDs_;
+
+    while (nDWORDs_--)
+    {
+        DWORD dw = *pdw_++;
+        dwA = (dwA ^ dw) * 0x01000193;
+        dwB = (dwB + dw) * 0x9e3779b1;
+        dwB = (dwB << 13) | (dwB >> 19);
+    }
+
+    pdwSig_[0] = dwA;
+    pdwSig_[1] = dwB;
+}
+
+// Work out which lines of the completed frame have changed since they were last shown
 void Flip (CScreen*& rpScreen_)
 {
-# if 0 //LUDO:
     ProfileStart(Gfx);
 
     int nHeight = rpScreen_->GetHeight() >> (GUI::IsActive() ? 0 : 1);
 
-    DWORD* pdwA = reinterpret_cast<DWORD*>(rpScreen_->GetLine(0));
-    DWORD* pdwB = reinterpret_cast<DWORD*>(pLastScreen->GetLine(0));
-    int nPitchDW = rpScreen_->GetPitch() >> 2;
+    // The signatures are out of date on the first frame after a direct colour one, and the host
+    // surface may hold anything on the first one
+    static MACHINE_LOCAL bool fLastDirect = false;
+    if (fDirect != fLastDirect)
+        Display::SetDirty();
+    fLastDirect = fDirect;
 
-    bool *pfHiRes = rpScreen_->GetHiRes(), *pfHiResLast = pLastScreen->GetHiRes();
+    DWORD* pdwSig = pdwLineSigs;
+    int nPitchDW = rpScreen_->GetPitch() >> 2;
 
-    // Work out what has changed since the last frame
-    for (int i = 0 ; i < nHeight ; i++)
+    for (int i = 0 ; i < nHeight ; i++, pdwSig += 2)
     {
-        // Skip lines currently marked as dirty
-        if (Display::IsLineDirty(i))
+        // Only the blocks drawn this frame can have changed, with a full frame covering the whole line
+        int nFrom = 0, nTo = 0xff;
+        if (!nDirtyFrames)
+        {
+            const DIRTY_SPAN& rSpan = asDirty[i + s_nViewTop];
+            if (rSpan.bFrom >= rSpan.bTo)
+                continue;
+
+            nFrom = max(rSpan.bFrom - s_nViewLeft, 0);
+            nTo = max(rSpan.bTo - s_nViewLeft, 0);
+        }
+
+        // Direct colour lines are already on the host surface, so there's nothing to save by checking them
+        if (fDirect)
+        {
+            Display::SetLineDirty(i, nFrom, nTo);
             continue;
+        }
 
-        // If they're different resolutions, or have different contents, they're dirty
-        if (pfHiRes[i] != pfHiResLast[i] || memcmp(pdwA, pdwB, rpScreen_->GetWidth(i)))
-            Display::SetLineDirty(i);
+        // The whole pitch is covered, as the display may show more of a low-res line than its width
+        DWORD adwSig[2];
+        GetLineSig(reinterpret_cast<DWORD*>(rpScreen_->GetLine(i)), nPitchDW, rpScreen_->IsHiRes(i), adwSig);
 
-        pdwA += nPitchDW;
-        pdwB += nPitchDW;
+        if (adwSig[0] != pdwSig[0] || adwSig[1] != pdwSig[1])
+        {
+            pdwSig[0] = adwSig[0];
+            pdwSig[1] = adwSig[1];
+            Display::SetLineDirty(i, nFrom, nTo);
+        }
     }
 
-    //LUDO: swap(pLastScreen, rpScreen_);
     ProfileEnd();
-# endif
 }
 
 
@@ -635,7 +974,7 @@ void DrawOSD (CScreen* pScreen_)
 void Frame::SaveFrame (const char* pcszPath_/*=NULL*/)
 {
 #ifdef USE_ZLIB
-    static int nNext = 0;
+    static MACHINE_LOCAL int nNext = 0;
 
     // If no path is supplied we need to generate a unique one
     if (!pcszPath_)
@@ -689,11 +1028,33 @@ void Frame::SetStatus (const char *pcszFormat_, ...)
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Convert the drawn part of a line to high resolution, wherever the current frame is being drawn
+static void ConvertToHiRes (int nLine_, int nBlock_)
+{
+    if (!fDirect)
+        pScreen->GetHiResLine(nLine_, nBlock_);
+    else if (!pScreen->IsHiRes(nLine_))
+    {
+        // The lo-res pixels may be moved as well as doubled, so work from a copy
+        WORD awLine[WIDTH_PIXELS];
+        int nPixels = min(nBlock_, (pScreen->GetPitch() >> 4)) << 3;
+        memcpy(awLine, Display::GetHostLine(nLine_, false), nPixels * sizeof(WORD));
+
+        WORD* pw = Display::GetHostLine(nLine_, true);
+        for (int i = 0 ; i < nPixels ; i++)
+            pw[i*2] = pw[i*2+1] = awLine[i];
+
+        pScreen->SetHiRes(nLine_, true);
+    }
+}
 
 // Handle screen mode changes, which may require converting low-res data to hi-res
 // Changes on the main screen may generate an artefact by using old data in the new mode (described by Dave Laundon)
 void Frame::ChangeMode (BYTE bVal_)
 {
+    // The new mode or page changes everything after this point
+    SetDirty();
+
     // Action only needs to be taken on main screen lines
     if (IsScreenLine(g_nLine))
     {
@@ -706,7 +1067,7 @@ void Frame::ChangeMode (BYTE bVal_)
             if (((bVal_ & VMPR_MODE_MASK) == MODE_3) && !pScreen->IsHiRes(nLine))
             {
                 // Convert the used part of the line to high resolution, and use the high resolution object
-                pScreen->GetHiResLine(nLine, nBlock);
+                ConvertToHiRes(nLine, nBlock);
                 pFrame = pFrameHigh;
             }
 
@@ -721,8 +1082,11 @@ void Frame::ChangeMode (BYTE bVal_)
     }
 
     // Update the mode in the rendering objects
-    pFrameLow->SetMode(bVal_);
-    pFrameHigh->SetMode(bVal_);
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        apFrames[i][0]->SetMode(bVal_);
+        apFrames[i][1]->SetMode(bVal_);
+    }
 }
 
 
@@ -735,7 +1099,7 @@ void Frame::ChangeScreen (BYTE bVal_)
     if (g_nLine >= s_nViewTop && g_nLine < s_nViewBottom && nBlock >= s_nViewLeft && nBlock < s_nViewRight)
     {
         // Convert the used part of the line to high resolution
-        pScreen->GetHiResLine(g_nLine - s_nViewTop, nBlock);
+        ConvertToHiRes(g_nLine - s_nViewTop, nBlock);
         pFrame = pFrameHigh;
 
         // Draw the artefact and advance the draw position
@@ -746,9 +1110,44 @@ void Frame::ChangeScreen (BYTE bVal_)
 
 
 // A screen line in a specified range is being written to, so we need to ensure it's up-to-date
-void Frame::TouchLines (int nFrom_, int nTo_)
+void Frame::TouchLines (int nFrom_, int nTo_, int nBlock_)
 {
     // Is the line being modified in the area since we last update
-    if (nTo_ >= nLastLine && nFrom_ <= g_nLine)
+    if (NeedsUpdate(nFrom_, nTo_))
         Update();
+
+    NoteWrites(nFrom_, nTo_, nBlock_, nBlock_+1);
+}
+
+// Note writes to blocks [nFromBlock_,nToBlock_) of a range of lines, which are drawn when the raster next reaches them
+void Frame::NoteWrites (int nFrom_, int nTo_, int nFromBlock_, int nToBlock_)
+{
+    for (int i = nFrom_ ; i <= nTo_ ; i++)
+    {
+        // Blocks not yet drawn this frame are drawn in it, and those already drawn in the next
+        if (i > nLastLine || (i == nLastLine && nToBlock_ > nLastBlock))
+        {
+            asDirty[i].bFrom = min(static_cast<int>(asDirty[i].bFrom), nFromBlock_);
+            asDirty[i].bTo = max(static_cast<int>(asDirty[i].bTo), nToBlock_);
+        }
+
+        if (i < nLastLine || (i == nLastLine && nFromBlock_ < nLastBlock))
+        {
+            asDirtyNext[i].bFrom = min(static_cast<int>(asDirtyNext[i].bFrom), nFromBlock_);
+            asDirtyNext[i].bTo = max(static_cast<int>(asDirtyNext[i].bTo), nToBlock_);
+        }
+    }
+}
+
+// Something other than the display memory has changed, so the whole frame needs drawing again.  That's the
+// rest of this frame and all of the next, or just the next if nothing has been drawn yet.
+void Frame::SetDirty ()
+{
+    nDirtyFrames = max(nDirtyFrames, (nLastLine || nLastBlock) ? 2 : 1);
+}
+
+// Would a write to a line in the specified range need the frame updating first?
+bool Frame::NeedsUpdate (int nFrom_, int nTo_)
+{
+    return nTo_ >= nLastLine && nFrom_ <= g_nLine;
 }
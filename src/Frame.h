@@ -30,12 +30,16 @@
 #include "IO.h"
 #include "Profile.h"
 #include "CScreen.h"
+#include "Display.h"
 #include "Util.h"
 
+#define USE_WIDE_RENDER     // Draw through tables a word at a time, with the byte-at-a-time version as the fallback
+
 
 class Frame
 {
     public:
+        static void InitTables ();
         static bool Init (bool fFirstInit_=false);
         static void Exit (bool fReInit_=false);
 
@@ -44,17 +48,28 @@ class Frame
         static void Update ();
         static void UpdateAll ();
         static void Complete ();
-        static void TouchLines (int nFrom_, int nTo_);
-        static inline void TouchLine (int nLine_) { TouchLines(nLine_, nLine_); }
+        static void TouchLines (int nFrom_, int nTo_, int nBlock_);
+        static void NoteWrites (int nFrom_, int nTo_, int nFromBlock_, int nToBlock_);
+        static bool NeedsUpdate (int nFrom_, int nTo_);
+        static inline void TouchLine (int nLine_, int nBlock_) { TouchLines(nLine_, nLine_, nBlock_); }
+        static void SetDirty ();
         static void ChangeMode (BYTE bVal_);
         static void ChangeScreen (BYTE bVal_);
+        static void ChangePalette ();
+        static void UpdateAttrColours ();
+        static void UpdateMode3Pixels ();
+        static void UpdateMode4Pixels ();
 
         static void Sync ();
+        static bool IsWarping ();
+        static bool IsDirectColour ();
+        static int GetSpeed ();
         static void Clear ();
         static void Redraw ();
         static void SaveFrame (const char* pcszPath_=NULL);
 
         static CScreen* GetScreen ();
+        static DWORD GetChecksum ();
         static int GetWidth ();
         static int GetHeight ();
         static void SetView (UINT uBlocks_, UINT uLines_);
@@ -68,15 +83,63 @@ inline BYTE AttrBg (BYTE bAttr_) { return (((bAttr_) >> 3) & 0xf); }
 inline BYTE AttrFg (BYTE bAttr_) { return ((((bAttr_) >> 3) & 8) | ((bAttr_) & 7)); }
 
 
-extern bool fDrawFrame, g_fFlashPhase;
-extern int g_nFrame;
+extern MACHINE_LOCAL bool fDrawFrame, g_fFlashPhase;
+extern MACHINE_LOCAL int g_nFrame;
+
+extern MACHINE_LOCAL int s_nWidth, s_nHeight;         // hi-res pixels
+extern MACHINE_LOCAL int s_nViewTop, s_nViewBottom;   // in lines
+extern MACHINE_LOCAL int s_nViewLeft, s_nViewRight;   // in screen blocks
+
+extern MACHINE_LOCAL BYTE *apbPageReadPtrs[],  *apbPageWritePtrs[];
+extern MACHINE_LOCAL WORD g_awMode1LineToByte[SCREEN_LINES];
+
+#ifdef USE_WIDE_RENDER
+// Mode 1 and 2 colours for each attribute, with the FLASH swap for the current phase already applied, as the
+// paper colour and the ink colour XORed with it, each repeated in all 4 bytes.  Rebuilt before drawing after
+// any change to the CLUT or the flash phase.
+typedef struct
+{
+    DWORD dwPaper, dwInkXor;
+}
+ATTR_COLOURS;
+
+extern MACHINE_LOCAL ATTR_COLOURS g_asAttrColours[256];
+extern MACHINE_LOCAL bool g_fAttrColoursChanged;
+
+// Byte masks selecting the ink pixels of each data byte, for 1 and 2 bytes per pixel, shared by all machines
+extern DWORD g_aadwPixelMasks[256][2], g_aadwHiResPixelMasks[256][4];
+
+// Display bytes for each mode 3 and 4 data byte, at 1 and 2 bytes per pixel, with only the odd pixels for
+// lo-res mode 3.  Rebuilt before drawing after any change to the CLUT.
+extern MACHINE_LOCAL WORD g_awMode3Pixels[256], g_awMode4Pixels[256];
+extern MACHINE_LOCAL DWORD g_adwMode3HiResPixels[256], g_adwMode4HiResPixels[256];
+extern MACHINE_LOCAL bool g_fMode3PixelsChanged, g_fMode4PixelsChanged;
+
+// The same for 16-bit host pixels, rebuilt along with them.  A lo-res host pixel is the size of a hi-res
+// pair of palette bytes, so shares their masks.
+extern MACHINE_LOCAL ATTR_COLOURS g_asHostAttrColours[256];
+extern DWORD g_aadwHostHiResPixelMasks[256][8];
+extern MACHINE_LOCAL DWORD g_adwHostMode3Pixels[256], g_adwHostMode4Pixels[256];
+extern MACHINE_LOCAL DWORD g_aadwHostMode3HiResPixels[256][2], g_aadwHostMode4HiResPixels[256][2];
+#endif
+
+// Called when the CLUT or the colours derived from it may have changed
+inline void Frame::ChangePalette ()
+{
+#ifdef USE_WIDE_RENDER
+    g_fAttrColoursChanged = g_fMode3PixelsChanged = g_fMode4PixelsChanged = true;
+#endif
+    SetDirty();
+}
 
-extern int s_nWidth, s_nHeight;         // hi-res pixels
-extern int s_nViewTop, s_nViewBottom;   // in lines
-extern int s_nViewLeft, s_nViewRight;   // in screen blocks
+// Fill a run of host pixels with a palette colour, a pair at a time as runs are always whole blocks
+inline void FillHostPixels (WORD* pw_, UINT uColour_, int nPixels_)
+{
+    DWORD dw = aulPalette[uColour_] * 0x00010001UL, *pdw = reinterpret_cast<DWORD*>(pw_);
 
-extern BYTE *apbPageReadPtrs[],  *apbPageWritePtrs[];
-extern WORD g_awMode1LineToByte[SCREEN_LINES];
+    for (nPixels_ >>= 1 ; nPixels_ > 0 ; nPixels_--)
+        *pdw++ = dw;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -141,8 +204,8 @@ class CFrame
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// Template class for lo-res and hi-res drawing
-template <bool fHiRes_>
+// Template class for lo-res and hi-res drawing, as CScreen palette bytes or as 16-bit host pixels
+template <bool fHiRes_, typename PIXEL>
 class CFrameXx1 : public CFrame
 {
     protected:
@@ -154,68 +217,98 @@ class CFrameXx1 : public CFrame
         void ScreenChange (BYTE bNewVal_, int nLine_, int nBlock_);
 
     protected:
-        void LeftBorder (BYTE* pbLine_, int nFrom_, int nTo_);
-        void RightBorder (BYTE* pbLine_, int nFrom_, int nTo_);
+        PIXEL* GetLine (int nLine_);
+        PIXEL GetPixel (UINT uColour_);
+        void Fill (PIXEL* pLine_, UINT uColour_, int nPixels_);
+
+        void LeftBorder (PIXEL* pLine_, int nFrom_, int nTo_);
+        void RightBorder (PIXEL* pLine_, int nFrom_, int nTo_);
         void BorderLine (int nLine_, int nFrom_, int nTo_);
         void BlackLine (int nLine_, int nFrom_, int nTo_);
 };
 
 
-template <bool fHiRes_>
-inline void CFrameXx1<fHiRes_>::LeftBorder (BYTE* pbLine_, int nFrom_, int nTo_)
+// Start of a display line, in the CScreen or on the host surface
+template <bool fHiRes_, typename PIXEL>
+inline PIXEL* CFrameXx1<fHiRes_,PIXEL>::GetLine (int nLine_)
+{
+    if (sizeof(PIXEL) == 1)
+        return reinterpret_cast<PIXEL*>(Frame::GetScreen()->GetLine(nLine_-s_nViewTop));
+
+    return reinterpret_cast<PIXEL*>(Display::GetHostLine(nLine_-s_nViewTop, fHiRes_));
+}
+
+// Value drawn for a palette colour, which is the palette index itself or the host colour for it
+template <bool fHiRes_, typename PIXEL>
+inline PIXEL CFrameXx1<fHiRes_,PIXEL>::GetPixel (UINT uColour_)
+{
+    return static_cast<PIXEL>((sizeof(PIXEL) == 1) ? uColour_ : aulPalette[uColour_]);
+}
+
+template <bool fHiRes_, typename PIXEL>
+inline void CFrameXx1<fHiRes_,PIXEL>::Fill (PIXEL* pLine_, UINT uColour_, int nPixels_)
+{
+    if (sizeof(PIXEL) == 1)
+        memset(pLine_, uColour_, nPixels_);
+    else
+        FillHostPixels(reinterpret_cast<WORD*>(pLine_), uColour_, nPixels_);
+}
+
+template <bool fHiRes_, typename PIXEL>
+inline void CFrameXx1<fHiRes_,PIXEL>::LeftBorder (PIXEL* pLine_, int nFrom_, int nTo_)
 {
     int nFrom = max(s_nViewLeft, nFrom_), nTo = min(nTo_, BORDER_BLOCKS);
 
     // Draw the required section of the left border, if any
     if (nFrom < nTo)
-        memset(pbLine_ + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), clutval[border_col], (nTo - nFrom) << (fHiRes_ ? 4 : 3));
+        Fill(pLine_ + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), clutval[border_col], (nTo - nFrom) << (fHiRes_ ? 4 : 3));
 }
 
-template <bool fHiRes_>
-inline void CFrameXx1<fHiRes_>::RightBorder (BYTE* pbLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+inline void CFrameXx1<fHiRes_,PIXEL>::RightBorder (PIXEL* pLine_, int nFrom_, int nTo_)
 {
     int nFrom = max((WIDTH_BLOCKS-BORDER_BLOCKS), nFrom_), nTo = min(nTo_, s_nViewRight);
 
     // Draw the required section of the right border, if any
     if (nFrom < nTo)
-        memset(pbLine_ + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), clutval[border_col], (nTo - nFrom) << (fHiRes_ ? 4 : 3));
+        Fill(pLine_ + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), clutval[border_col], (nTo - nFrom) << (fHiRes_ ? 4 : 3));
 }
 
-template <bool fHiRes_>
-inline void CFrameXx1<fHiRes_>::BorderLine (int nLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+inline void CFrameXx1<fHiRes_,PIXEL>::BorderLine (int nLine_, int nFrom_, int nTo_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
+    PIXEL* pLine = GetLine(nLine_);
 
     // Work out the range that within the visible area
     int nFrom = max(s_nViewLeft, nFrom_), nTo = min(nTo_, s_nViewRight);
 
     // Draw the required section of the border, if any
     if (nFrom < nTo)
-        memset(pbLine + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), clutval[border_col], (nTo - nFrom) << (fHiRes_ ? 4 : 3));
+        Fill(pLine + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), clutval[border_col], (nTo - nFrom) << (fHiRes_ ? 4 : 3));
 }
 
-template <bool fHiRes_>
-inline void CFrameXx1<fHiRes_>::BlackLine (int nLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+inline void CFrameXx1<fHiRes_,PIXEL>::BlackLine (int nLine_, int nFrom_, int nTo_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
+    PIXEL* pLine = GetLine(nLine_);
 
     // Work out the range that within the visible area
     int nFrom = max(s_nViewLeft, nFrom_), nTo = min(nTo_, s_nViewRight);
 
     // Draw the required section of the left border, if any
     if (nFrom < nTo)
-        memset(pbLine + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), 0, (nTo - nFrom) << (fHiRes_ ? 4 : 3));
+        Fill(pLine + ((nFrom-s_nViewLeft) << (fHiRes_ ? 4 : 3)), 0, (nTo - nFrom) << (fHiRes_ ? 4 : 3));
 }
 
 
-template <bool fHiRes_>
-void CFrameXx1<fHiRes_>::Mode1Line (int nLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+void CFrameXx1<fHiRes_,PIXEL>::Mode1Line (int nLine_, int nFrom_, int nTo_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
+    PIXEL* pLine = GetLine(nLine_);
     nLine_ -= TOP_BORDER_LINES;
 
     // Draw the required section of the left border, if any
-    LeftBorder(pbLine, nFrom_, nTo_);
+    LeftBorder(pLine, nFrom_, nTo_);
 
     // Work out the range that within the visible area
     int nFrom = max(BORDER_BLOCKS, nFrom_), nTo = min(nTo_, BORDER_BLOCKS+SCREEN_BLOCKS);
@@ -223,20 +316,58 @@ void CFrameXx1<fHiRes_>::Mode1Line (int nLine_, int nFrom_, int nTo_)
     // Draw the required section of the main screen, if any
     if (nFrom < nTo)
     {
-        BYTE* pFrame = pbLine + ((nFrom - s_nViewLeft) << (fHiRes_ ? 4 : 3));
+        PIXEL* pFrame = pLine + ((nFrom - s_nViewLeft) << (fHiRes_ ? 4 : 3));
         BYTE* pbDataMem = m_pbScreenData + g_awMode1LineToByte[nLine_] + (nFrom - BORDER_BLOCKS);
         BYTE* pbAttrMem = m_pbScreenData + 6144 + ((nLine_ & 0xf8) << 2) + (nFrom - BORDER_BLOCKS);
 
+#ifdef USE_WIDE_RENDER
+        if (g_fAttrColoursChanged)
+            Frame::UpdateAttrColours();
+#endif
+
         // The actual screen line
         for (int i = nFrom; i < nTo; i++)
         {
+#ifdef USE_WIDE_RENDER
+            // Blend the ink and paper a DWORD at a time, selecting ink where the data bits are set
+            const ATTR_COLOURS* pColours = (sizeof(PIXEL) == 1) ? &g_asAttrColours[*pbAttrMem++] : &g_asHostAttrColours[*pbAttrMem++];
+            DWORD dwPaper = pColours->dwPaper, dwInkXor = pColours->dwInkXor;
+            DWORD* pdwFrame = reinterpret_cast<DWORD*>(pFrame);
+
+            if (sizeof(PIXEL) == 1 && !fHiRes_)
+            {
+                const DWORD* pdwMask = g_aadwPixelMasks[*pbDataMem++];
+                pdwFrame[0] = dwPaper ^ (dwInkXor & pdwMask[0]);
+                pdwFrame[1] = dwPaper ^ (dwInkXor & pdwMask[1]);
+            }
+            else if (sizeof(PIXEL) == 1 || !fHiRes_)
+            {
+                const DWORD* pdwMask = g_aadwHiResPixelMasks[*pbDataMem++];
+                pdwFrame[0] = dwPaper ^ (dwInkXor & pdwMask[0]);
+                pdwFrame[1] = dwPaper ^ (dwInkXor & pdwMask[1]);
+                pdwFrame[2] = dwPaper ^ (dwInkXor & pdwMask[2]);
+                pdwFrame[3] = dwPaper ^ (dwInkXor & pdwMask[3]);
+            }
+            else
+            {
+                const DWORD* pdwMask = g_aadwHostHiResPixelMasks[*pbDataMem++];
+                pdwFrame[0] = dwPaper ^ (dwInkXor & pdwMask[0]);
+                pdwFrame[1] = dwPaper ^ (dwInkXor & pdwMask[1]);
+                pdwFrame[2] = dwPaper ^ (dwInkXor & pdwMask[2]);
+                pdwFrame[3] = dwPaper ^ (dwInkXor & pdwMask[3]);
+                pdwFrame[4] = dwPaper ^ (dwInkXor & pdwMask[4]);
+                pdwFrame[5] = dwPaper ^ (dwInkXor & pdwMask[5]);
+                pdwFrame[6] = dwPaper ^ (dwInkXor & pdwMask[6]);
+                pdwFrame[7] = dwPaper ^ (dwInkXor & pdwMask[7]);
+            }
+#else
             BYTE bData = *pbDataMem++, bAttr = *pbAttrMem++, bInk = AttrFg(bAttr), bPaper = AttrBg(bAttr);
 
             // toggle the colours if we're in the inverse part of the FLASH cycle
             if (g_fFlashPhase && (bAttr & 0x80))
                 swap(bInk, bPaper);
 
-            BYTE ink = clutval[bInk], paper = clutval[bPaper];
+            PIXEL ink = GetPixel(clutval[bInk]), paper = GetPixel(clutval[bPaper]);
 
             if (!fHiRes_)
             {
@@ -260,23 +391,23 @@ void CFrameXx1<fHiRes_>::Mode1Line (int nLine_, int nFrom_, int nTo_)
                 pFrame[12] = pFrame[13] = (bData & 0x02) ? ink : paper;
                 pFrame[14] = pFrame[15] = (bData & 0x01) ? ink : paper;
             }
-
+#endif
             pFrame += fHiRes_ ? 16 : 8;
         }
     }
 
     // Draw the required section of the right border, if any
-    RightBorder(pbLine, nFrom_, nTo_);
+    RightBorder(pLine, nFrom_, nTo_);
 }
 
-template <bool fHiRes_>
-void CFrameXx1<fHiRes_>::Mode2Line (int nLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+void CFrameXx1<fHiRes_,PIXEL>::Mode2Line (int nLine_, int nFrom_, int nTo_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
+    PIXEL* pLine = GetLine(nLine_);
     nLine_ -= TOP_BORDER_LINES;
 
     // Draw the required section of the left border, if any
-    LeftBorder(pbLine, nFrom_, nTo_);
+    LeftBorder(pLine, nFrom_, nTo_);
 
     // Work out the range that within the visible area
     int nFrom = max(BORDER_BLOCKS, nFrom_), nTo = min(nTo_, BORDER_BLOCKS+SCREEN_BLOCKS);
@@ -284,20 +415,58 @@ void CFrameXx1<fHiRes_>::Mode2Line (int nLine_, int nFrom_, int nTo_)
     // Draw the required section of the main screen, if any
     if (nFrom < nTo)
     {
-        BYTE* pFrame = pbLine + ((nFrom - s_nViewLeft) << (fHiRes_ ? 4 : 3));
+        PIXEL* pFrame = pLine + ((nFrom - s_nViewLeft) << (fHiRes_ ? 4 : 3));
         BYTE* pbDataMem = m_pbScreenData + (nLine_ << 5) + (nFrom - BORDER_BLOCKS);
         BYTE* pbAttrMem = pbDataMem + 0x2000;
 
+#ifdef USE_WIDE_RENDER
+        if (g_fAttrColoursChanged)
+            Frame::UpdateAttrColours();
+#endif
+
         // The actual screen line
         for (int i = nFrom; i < nTo; i++)
         {
+#ifdef USE_WIDE_RENDER
+            // Blend the ink and paper a DWORD at a time, selecting ink where the data bits are set
+            const ATTR_COLOURS* pColours = (sizeof(PIXEL) == 1) ? &g_asAttrColours[*pbAttrMem++] : &g_asHostAttrColours[*pbAttrMem++];
+            DWORD dwPaper = pColours->dwPaper, dwInkXor = pColours->dwInkXor;
+            DWORD* pdwFrame = reinterpret_cast<DWORD*>(pFrame);
+
+            if (sizeof(PIXEL) == 1 && !fHiRes_)
+            {
+                const DWORD* pdwMask = g_aadwPixelMasks[*pbDataMem++];
+                pdwFrame[0] = dwPaper ^ (dwInkXor & pdwMask[0]);
+                pdwFrame[1] = dwPaper ^ (dwInkXor & pdwMask[1]);
+            }
+            else if (sizeof(PIXEL) == 1 || !fHiRes_)
+            {
+                const DWORD* pdwMask = g_aadwHiResPixelMasks[*pbDataMem++];
+                pdwFrame[0] = dwPaper ^ (dwInkXor & pdwMask[0]);
+                pdwFrame[1] = dwPaper ^ (dwInkXor & pdwMask[1]);
+                pdwFrame[2] = dwPaper ^ (dwInkXor & pdwMask[2]);
+                pdwFrame[3] = dwPaper ^ (dwInkXor & pdwMask[3]);
+            }
+            else
+            {
+                const DWORD* pdwMask = g_aadwHostHiResPixelMasks[*pbDataMem++];
+                pdwFrame[0] = dwPaper ^ (dwInkXor & pdwMask[0]);
+                pdwFrame[1] = dwPaper ^ (dwInkXor & pdwMask[1]);
+                pdwFrame[2] = dwPaper ^ (dwInkXor & pdwMask[2]);
+                pdwFrame[3] = dwPaper ^ (dwInkXor & pdwMask[3]);
+                pdwFrame[4] = dwPaper ^ (dwInkXor & pdwMask[4]);
+                pdwFrame[5] = dwPaper ^ (dwInkXor & pdwMask[5]);
+                pdwFrame[6] = dwPaper ^ (dwInkXor & pdwMask[6]);
+                pdwFrame[7] = dwPaper ^ (dwInkXor & pdwMask[7]);
+            }
+#else
             BYTE bData = *pbDataMem++, bAttr = *pbAttrMem++, bInk = AttrFg(bAttr), bPaper = AttrBg(bAttr);
 
             // toggle the colours if we're in the inverse part of the FLASH cycle
             if (g_fFlashPhase && (bAttr & 0x80))
                 swap(bInk, bPaper);
 
-            BYTE ink = clutval[bInk], paper = clutval[bPaper];
+            PIXEL ink = GetPixel(clutval[bInk]), paper = GetPixel(clutval[bPaper]);
 
             if (!fHiRes_)
             {
@@ -321,23 +490,23 @@ void CFrameXx1<fHiRes_>::Mode2Line (int nLine_, int nFrom_, int nTo_)
                 pFrame[12] = pFrame[13] = (bData & 0x02) ? ink : paper;
                 pFrame[14] = pFrame[15] = (bData & 0x01) ? ink : paper;
             }
-
+#endif
             pFrame += fHiRes_ ? 16 : 8;
         }
     }
 
     // Draw the required section of the right border, if any
-    RightBorder(pbLine, nFrom_, nTo_);
+    RightBorder(pLine, nFrom_, nTo_);
 }
 
-template <bool fHiRes_>
-void CFrameXx1<fHiRes_>::Mode3Line (int nLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+void CFrameXx1<fHiRes_,PIXEL>::Mode3Line (int nLine_, int nFrom_, int nTo_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
+    PIXEL* pLine = GetLine(nLine_);
     nLine_ -= TOP_BORDER_LINES;
 
     // Draw the required section of the left border, if any
-    LeftBorder(pbLine, nFrom_, nTo_);
+    LeftBorder(pLine, nFrom_, nTo_);
 
     // Work out the range that within the visible area
     int nFrom = max(BORDER_BLOCKS, nFrom_), nTo = min(nTo_, BORDER_BLOCKS+SCREEN_BLOCKS);
@@ -345,80 +514,122 @@ void CFrameXx1<fHiRes_>::Mode3Line (int nLine_, int nFrom_, int nTo_)
     // Draw the required hi-res section of the main screen, if any
     if (nFrom < nTo)
     {
-        BYTE* pFrame = pbLine + ((nFrom - s_nViewLeft) << 4);
+        PIXEL* pFrame = pLine + ((nFrom - s_nViewLeft) << 4);
         BYTE* pbDataMem = m_pbScreenData + (nLine_ << 7) + ((nFrom - BORDER_BLOCKS) << 2);
 
+#ifdef USE_WIDE_RENDER
+        if (g_fMode3PixelsChanged)
+            Frame::UpdateMode3Pixels();
+#endif
+
         // The actual screen line
         for (int i = nFrom; i < nTo; i++)
         {
+#ifdef USE_WIDE_RENDER
+            if (sizeof(PIXEL) == 1 && !fHiRes_)
+            {
+                WORD* pwFrame = reinterpret_cast<WORD*>(pFrame);
+                pwFrame[0] = g_awMode3Pixels[pbDataMem[0]];
+                pwFrame[1] = g_awMode3Pixels[pbDataMem[1]];
+                pwFrame[2] = g_awMode3Pixels[pbDataMem[2]];
+                pwFrame[3] = g_awMode3Pixels[pbDataMem[3]];
+            }
+            else if (sizeof(PIXEL) == 1 || !fHiRes_)
+            {
+                const DWORD* pdwPixels = (sizeof(PIXEL) == 1) ? g_adwMode3HiResPixels : g_adwHostMode3Pixels;
+                DWORD* pdwFrame = reinterpret_cast<DWORD*>(pFrame);
+                pdwFrame[0] = pdwPixels[pbDataMem[0]];
+                pdwFrame[1] = pdwPixels[pbDataMem[1]];
+                pdwFrame[2] = pdwPixels[pbDataMem[2]];
+                pdwFrame[3] = pdwPixels[pbDataMem[3]];
+            }
+            else
+            {
+                DWORD* pdwFrame = reinterpret_cast<DWORD*>(pFrame);
+                const DWORD* pdw = g_aadwHostMode3HiResPixels[pbDataMem[0]];
+                pdwFrame[0] = pdw[0];
+                pdwFrame[1] = pdw[1];
+                pdw = g_aadwHostMode3HiResPixels[pbDataMem[1]];
+                pdwFrame[2] = pdw[0];
+                pdwFrame[3] = pdw[1];
+                pdw = g_aadwHostMode3HiResPixels[pbDataMem[2]];
+                pdwFrame[4] = pdw[0];
+                pdwFrame[5] = pdw[1];
+                pdw = g_aadwHostMode3HiResPixels[pbDataMem[3]];
+                pdwFrame[6] = pdw[0];
+                pdwFrame[7] = pdw[1];
+            }
+
+            pFrame += fHiRes_ ? 16 : 8;
+#else
             BYTE bData;
 
             if (!fHiRes_)
             {
                 // Use only the odd mode-3 pixels for the low-res version
                 bData = pbDataMem[0];
-                pFrame[0] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[1] = mode3clutval[(bData & 0x03)     ];
+                pFrame[0] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[1] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 bData = pbDataMem[1];
-                pFrame[2] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[3] = mode3clutval[(bData & 0x03)     ];
+                pFrame[2] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[3] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 bData = pbDataMem[2];
-                pFrame[4] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[5] = mode3clutval[(bData & 0x03)     ];
+                pFrame[4] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[5] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 bData = pbDataMem[3];
-                pFrame[6] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[7] = mode3clutval[(bData & 0x03)     ];
+                pFrame[6] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[7] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 pFrame += 8;
             }
             else
             {
                 bData = pbDataMem[0];
-                pFrame[0] = mode3clutval[ bData         >> 6];
-                pFrame[1] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[2] = mode3clutval[(bData & 0x0c) >> 2];
-                pFrame[3] = mode3clutval[(bData & 0x03)     ];
+                pFrame[0] = GetPixel(mode3clutval[ bData         >> 6]);
+                pFrame[1] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[2] = GetPixel(mode3clutval[(bData & 0x0c) >> 2]);
+                pFrame[3] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 bData = pbDataMem[1];
-                pFrame[4] = mode3clutval[ bData         >> 6];
-                pFrame[5] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[6] = mode3clutval[(bData & 0x0c) >> 2];
-                pFrame[7] = mode3clutval[(bData & 0x03)     ];
+                pFrame[4] = GetPixel(mode3clutval[ bData         >> 6]);
+                pFrame[5] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[6] = GetPixel(mode3clutval[(bData & 0x0c) >> 2]);
+                pFrame[7] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 bData = pbDataMem[2];
-                pFrame[8]  = mode3clutval[ bData         >> 6];
-                pFrame[9]  = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[10] = mode3clutval[(bData & 0x0c) >> 2];
-                pFrame[11] = mode3clutval[(bData & 0x03)     ];
+                pFrame[8]  = GetPixel(mode3clutval[ bData         >> 6]);
+                pFrame[9]  = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[10] = GetPixel(mode3clutval[(bData & 0x0c) >> 2]);
+                pFrame[11] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 bData = pbDataMem[3];
-                pFrame[12] = mode3clutval[ bData         >> 6];
-                pFrame[13] = mode3clutval[(bData & 0x30) >> 4];
-                pFrame[14] = mode3clutval[(bData & 0x0c) >> 2];
-                pFrame[15] = mode3clutval[(bData & 0x03)     ];
+                pFrame[12] = GetPixel(mode3clutval[ bData         >> 6]);
+                pFrame[13] = GetPixel(mode3clutval[(bData & 0x30) >> 4]);
+                pFrame[14] = GetPixel(mode3clutval[(bData & 0x0c) >> 2]);
+                pFrame[15] = GetPixel(mode3clutval[(bData & 0x03)     ]);
 
                 pFrame += 16;
             }
-
+#endif
             pbDataMem += 4;
         }
     }
 
     // Draw the required section of the right border, if any
-    RightBorder(pbLine, nFrom_, nTo_);
+    RightBorder(pLine, nFrom_, nTo_);
 }
 
-template <bool fHiRes_>
-void CFrameXx1<fHiRes_>::Mode4Line (int nLine_, int nFrom_, int nTo_)
+template <bool fHiRes_, typename PIXEL>
+void CFrameXx1<fHiRes_,PIXEL>::Mode4Line (int nLine_, int nFrom_, int nTo_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
+    PIXEL* pLine = GetLine(nLine_);
     nLine_ -= TOP_BORDER_LINES;
 
     // Draw the required section of the left border, if any
-    LeftBorder(pbLine, nFrom_, nTo_);
+    LeftBorder(pLine, nFrom_, nTo_);
 
     // Work out the range that within the visible area
     int nFrom = max(BORDER_BLOCKS, nFrom_), nTo = min(nTo_, BORDER_BLOCKS+SCREEN_BLOCKS);
@@ -426,63 +637,103 @@ void CFrameXx1<fHiRes_>::Mode4Line (int nLine_, int nFrom_, int nTo_)
     // Draw the required section of the main screen, if any
     if (nFrom < nTo)
     {
-        BYTE* pFrame = pbLine + ((nFrom - s_nViewLeft) << (fHiRes_ ? 4 : 3));
+        PIXEL* pFrame = pLine + ((nFrom - s_nViewLeft) << (fHiRes_ ? 4 : 3));
         BYTE* pbDataMem = ((nFrom - BORDER_BLOCKS) << 2) + m_pbScreenData + (nLine_ << 7);
 
+#ifdef USE_WIDE_RENDER
+        if (g_fMode4PixelsChanged)
+            Frame::UpdateMode4Pixels();
+#endif
+
         // The actual screen line
         for (int i = nFrom; i < nTo; i++)
         {
+#ifdef USE_WIDE_RENDER
+            if (sizeof(PIXEL) == 1 && !fHiRes_)
+            {
+                WORD* pwFrame = reinterpret_cast<WORD*>(pFrame);
+                pwFrame[0] = g_awMode4Pixels[pbDataMem[0]];
+                pwFrame[1] = g_awMode4Pixels[pbDataMem[1]];
+                pwFrame[2] = g_awMode4Pixels[pbDataMem[2]];
+                pwFrame[3] = g_awMode4Pixels[pbDataMem[3]];
+            }
+            else if (sizeof(PIXEL) == 1 || !fHiRes_)
+            {
+                const DWORD* pdwPixels = (sizeof(PIXEL) == 1) ? g_adwMode4HiResPixels : g_adwHostMode4Pixels;
+                DWORD* pdwFrame = reinterpret_cast<DWORD*>(pFrame);
+                pdwFrame[0] = pdwPixels[pbDataMem[0]];
+                pdwFrame[1] = pdwPixels[pbDataMem[1]];
+                pdwFrame[2] = pdwPixels[pbDataMem[2]];
+                pdwFrame[3] = pdwPixels[pbDataMem[3]];
+            }
+            else
+            {
+                DWORD* pdwFrame = reinterpret_cast<DWORD*>(pFrame);
+                const DWORD* pdw = g_aadwHostMode4HiResPixels[pbDataMem[0]];
+                pdwFrame[0] = pdw[0];
+                pdwFrame[1] = pdw[1];
+                pdw = g_aadwHostMode4HiResPixels[pbDataMem[1]];
+                pdwFrame[2] = pdw[0];
+                pdwFrame[3] = pdw[1];
+                pdw = g_aadwHostMode4HiResPixels[pbDataMem[2]];
+                pdwFrame[4] = pdw[0];
+                pdwFrame[5] = pdw[1];
+                pdw = g_aadwHostMode4HiResPixels[pbDataMem[3]];
+                pdwFrame[6] = pdw[0];
+                pdwFrame[7] = pdw[1];
+            }
+#else
             BYTE bData;
 
             if (!fHiRes_)
             {
                 bData = pbDataMem[0];
-                pFrame[0] = clutval[bData >> 4];
-                pFrame[1] = clutval[bData & 0x0f];
+                pFrame[0] = GetPixel(clutval[bData >> 4]);
+                pFrame[1] = GetPixel(clutval[bData & 0x0f]);
 
                 bData = pbDataMem[1];
-                pFrame[2] = clutval[bData >> 4];
-                pFrame[3] = clutval[bData & 0x0f];
+                pFrame[2] = GetPixel(clutval[bData >> 4]);
+                pFrame[3] = GetPixel(clutval[bData & 0x0f]);
 
                 bData = pbDataMem[2];
-                pFrame[4] = clutval[bData >> 4];
-                pFrame[5] = clutval[bData & 0x0f];
+                pFrame[4] = GetPixel(clutval[bData >> 4]);
+                pFrame[5] = GetPixel(clutval[bData & 0x0f]);
 
                 bData = pbDataMem[3];
-                pFrame[6] = clutval[bData >> 4];
-                pFrame[7] = clutval[bData & 0x0f];
+                pFrame[6] = GetPixel(clutval[bData >> 4]);
+                pFrame[7] = GetPixel(clutval[bData & 0x0f]);
             }
             else
             {
                 bData = pbDataMem[0];
-                pFrame[0]  = pFrame[1]  = clutval[bData >> 4];
-                pFrame[2]  = pFrame[3]  = clutval[bData & 0x0f];
+                pFrame[0]  = pFrame[1]  = GetPixel(clutval[bData >> 4]);
+                pFrame[2]  = pFrame[3]  = GetPixel(clutval[bData & 0x0f]);
 
                 bData = pbDataMem[1];
-                pFrame[4]  = pFrame[5]  = clutval[bData >> 4];
-                pFrame[6]  = pFrame[7]  = clutval[bData & 0x0f];
+                pFrame[4]  = pFrame[5]  = GetPixel(clutval[bData >> 4]);
+                pFrame[6]  = pFrame[7]  = GetPixel(clutval[bData & 0x0f]);
 
                 bData = pbDataMem[2];
-                pFrame[8]  = pFrame[9]  = clutval[bData >> 4];
-                pFrame[10] = pFrame[11] = clutval[bData & 0x0f];
+                pFrame[8]  = pFrame[9]  = GetPixel(clutval[bData >> 4]);
+                pFrame[10] = pFrame[11] = GetPixel(clutval[bData & 0x0f]);
 
                 bData = pbDataMem[3];
-                pFrame[12] = pFrame[13] = clutval[bData >> 4];
-                pFrame[14] = pFrame[15] = clutval[bData & 0x0f];
+                pFrame[12] = pFrame[13] = GetPixel(clutval[bData >> 4]);
+                pFrame[14] = pFrame[15] = GetPixel(clutval[bData & 0x0f]);
             }
-
+#endif
             pFrame += fHiRes_ ? 16 : 8;
             pbDataMem += 4;
         }
     }
 
     // Draw the required section of the right border, if any
-    RightBorder(pbLine, nFrom_, nTo_);
+    RightBorder(pLine, nFrom_, nTo_);
 }
 
 
-template <bool fHiRes_>
-void CFrameXx1<fHiRes_>::ModeChange (BYTE bNewVal_, int nLine_, int nBlock_)
+template <bool fHiRes_, typename PIXEL>
+void CFrameXx1<fHiRes_,PIXEL>::ModeChange (BYTE bNewVal_, int nLine_, int nBlock_)
 {
     int nScreenLine = nLine_ - TOP_BORDER_LINES;
 
@@ -570,21 +821,21 @@ void CFrameXx1<fHiRes_>::ModeChange (BYTE bNewVal_, int nLine_, int nBlock_)
 }
 
 
-template <bool fHiRes_>
-void CFrameXx1<fHiRes_>::ScreenChange (BYTE bNewVal_, int nLine_, int nBlock_)
+template <bool fHiRes_, typename PIXEL>
+void CFrameXx1<fHiRes_,PIXEL>::ScreenChange (BYTE bNewVal_, int nLine_, int nBlock_)
 {
-    BYTE* pbLine = Frame::GetScreen()->GetLine(nLine_-s_nViewTop);
-    BYTE* pFrame = pbLine + ((nBlock_ - s_nViewLeft) << 4);
+    PIXEL* pLine = GetLine(nLine_);
+    PIXEL* pFrame = pLine + ((nBlock_ - s_nViewLeft) << 4);
 
     // Part of the first pixel is the previous border colour, from when the screen was disabled
     // We don't have the resolution to show only part, so it'll appear brighter than the real SAM
-    pFrame[0] = clutval[border_col];
+    pFrame[0] = GetPixel(clutval[border_col]);
 
     // The rest of the cell is the new border colour, even on the main screen since the ASIC has no data!
     pFrame[1]  = pFrame[2]  = pFrame[3]  =
     pFrame[4]  = pFrame[5]  = pFrame[6]  = pFrame[7] =
     pFrame[8]  = pFrame[9]  = pFrame[10] = pFrame[11] = 
-    pFrame[12] = pFrame[13] = pFrame[14] = pFrame[15] = clutval[BORD_COL(bNewVal_)];
+    pFrame[12] = pFrame[13] = pFrame[14] = pFrame[15] = GetPixel(clutval[BORD_COL(bNewVal_)]);
 }
 
 #endif  // FRAME_H
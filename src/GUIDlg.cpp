@@ -22,6 +22,7 @@
 #include "GUIDlg.h"
 
 #include "CDisk.h"
+#include "CPU.h"
 #include "Frame.h"
 #include "HardDisk.h"
 #include "Input.h"
@@ -1431,7 +1432,9 @@ void CImportDialog::OnNotify (CWindow* pWindow_, int nParam_)
         // Loop reading chunk blocks into the relevant pages
         for (UINT uChunk ; (uChunk = min(uLen, (0x4000 - uOffset))) ; uLen -= uChunk, uOffset = 0)
         {
-            // Read directly into system memory
+            // Read directly into system memory, noting the blocks for the rewind buffer
+            for (UINT u = uOffset ; u < uOffset + uChunk ; u = (u | ((1U << MEM_BLOCK_SHIFT) - 1)) + 1)
+                track_page_write(uPage, u);
             uRead += fread(&apbPageWritePtrs[uPage][uOffset], 1, uChunk, hFile);
 
             // Stop reading if we've hit the end or reached the end of a logical block
@@ -1440,6 +1443,11 @@ void CImportDialog::OnNotify (CWindow* pWindow_, int nParam_)
         }
 
         fclose(hFile);
+
+        // The import may have overwritten code the CPU has already decoded, or the display
+        CPU::InvalidateCode();
+        Frame::SetDirty();
+
         Frame::SetStatus("%u bytes imported to %u", uRead, s_uAddr);
         Destroy();
     }
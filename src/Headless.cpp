@@ -0,0 +1,675 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Headless.cpp: Null OS/video/sound layer and frame-throughput benchmark
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  Built only with USE_HEADLESS (see Makefile-headless), this replaces the
+//  SDL/PSP front-end with do-nothing versions so the core can be run flat
+//  out on a development host.  The display blit is still performed into a
+//  private 16-bit buffer so the numbers include the cost of the full frame
+//  path, not just the Z80.
+//
+//  Usage: simcoupe-bench [-f frames | -e seconds] [-r rom] [-m romtraps] [-x external-mb] [-k warp-skip] [-c] [-q] [--state file] [--record file | --replay file] [-w frames] [-s file] [disk-image]
+//         simcoupe-bench -j machines [-f frames | -e seconds] [-r rom] [-m romtraps] [-x external-mb] [-k warp-skip] [-c] [-q] [--state file] [--replay file] [-w frames] [disk-image]
+//         simcoupe-bench -a image-list [-p workers] [-o report] [-d screenshot-dir] [-f frames | -e seconds] [-r rom] [-m romtraps] [-x external-mb] [-k warp-skip]
+//         simcoupe-bench -t exerciser.com
+//
+//  --state resumes from a saved state instead of booting, and -s saves the
+//  state at the end of the run.  -w rewinds that many frames at the end and
+//  runs them again, which should finish in the same state.  --record and
+//  --replay log and feed back input (see Record.cpp), with a replay running
+//  to its end unless -f is given, and failing if it doesn't match.  The
+//  second form runs that many independent machines at once, each on its own
+//  thread with its own MACHINE_LOCAL state, and reports their combined rate.
+//  The third form smoke-tests a list of disk images, each booted from the
+//  startup screen in a worker process, with one worker per core unless -p
+//  says otherwise (see Batch.cpp).  The last form runs a CP/M instruction
+//  exerciser instead (see Z80Test.cpp).  -e gives the run length in seconds
+//  of emulated time rather than frames, and -x adds external memory.  -k
+//  runs in warp mode, on the turbo core and drawing only one frame in that
+//  many, so the final frame may be a few frames old.  Warping during disk
+//  activity is otherwise disabled, so every frame is drawn.  -m sets the
+//  RomTraps option (see Trap.cpp), with 2 checking each native run against
+//  the ROM code and reporting the number that didn't match.  -c draws the
+//  frames straight into the buffer with the DirectColour option, leaving
+//  only the scanline rows to darken, though recordings and replays still
+//  draw through the palette (see Frame.cpp).
+
+#include "SimCoupe.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "Batch.h"
+#include "CPU.h"
+#include "Debug.h"
+#include "Display.h"
+#include "Frame.h"
+#include "GUI.h"
+#include "Input.h"
+#include "IO.h"
+#include "Main.h"
+#include "Options.h"
+#include "Parallel.h"
+#include "PNG.h"
+#include "Record.h"
+#include "Rewind.h"
+#include "Sound.h"
+#include "State.h"
+#include "Trap.h"
+#include "UI.h"
+#include "Video.h"
+#include "Z80Test.h"
+
+const int DEFAULT_BENCH_FRAMES = 500;   // 10 seconds of emulated time
+const int MAX_STARTUP_FRAMES = 250;     // Time allowed to reach the startup screen before a batch image is inserted
+
+int OSD::s_nTicks;
+bool g_fActive = true;
+
+MACHINE_LOCAL bool* Display::pafDirty;
+MACHINE_LOCAL BYTE *Display::pabDirtyFrom, *Display::pabDirtyTo;
+MACHINE_LOCAL SDL_Rect rSource, rTarget;
+
+// The headless palette uses the same RGB565 layout as the PSP surface
+MACHINE_LOCAL WORD aulPalette[N_PALETTE_COLOURS], aulScanline[N_PALETTE_COLOURS];
+
+// Private surface the blit is drawn into, with a scanline row for every SAM line
+static MACHINE_LOCAL WORD* pwSurface;
+static MACHINE_LOCAL int nSurfacePitch;
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool OSD::Init (bool fFirstInit_/*=false*/) { return true; }
+void OSD::Exit (bool fReInit_/*=false*/) { }
+
+DWORD OSD::GetTime ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<DWORD>(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+const char* OSD::GetFilePath (const char* pcszFile_/*=""*/)
+{
+    static MACHINE_LOCAL char szPath[512];
+
+    // Absolute paths are used as-is, everything else is relative to the current directory
+    if (*pcszFile_ == PATH_SEPARATOR)
+        snprintf(szPath, sizeof szPath, "%s", pcszFile_);
+    else
+    {
+        char szDir[sizeof szPath] = "";
+        if (getcwd(szDir, sizeof szDir))
+            snprintf(szPath, sizeof szPath, "%s%c%s", szDir, PATH_SEPARATOR, pcszFile_);
+        else
+            snprintf(szPath, sizeof szPath, "%s", pcszFile_);
+    }
+
+    return szPath;
+}
+
+const char* OSD::GetDirPath (const char* pcszDir_/*=""*/)
+{
+    char *psz = const_cast<char*>(GetFilePath(pcszDir_)), *pszEnd = psz+strlen(psz);
+
+    if (*psz && pszEnd[-1] != PATH_SEPARATOR)
+    {
+        pszEnd[0] = PATH_SEPARATOR;
+        pszEnd[1] = '\0';
+    }
+
+    return psz;
+}
+
+const char* OSD::GetFloppyDevice (int nDrive_)
+{
+    static char szDevice[] = "/dev/fd_";
+    szDevice[7] = '0' + nDrive_-1;
+    return szDevice;
+}
+
+bool OSD::CheckPathAccess (const char* pcszPath_) { return !access(pcszPath_, X_OK); }
+
+bool OSD::IsHidden (const char* pcszPath_)
+{
+    pcszPath_ = strrchr(pcszPath_, PATH_SEPARATOR);
+    return pcszPath_ && pcszPath_[1] == '.';
+}
+
+void OSD::DebugTrace (const char* pcsz_) { fprintf(stderr, "%s", pcsz_); }
+int OSD::FrameSync (bool fWait_/*=true*/) { return s_nTicks; }
+
+
+CPrinterDevice::CPrinterDevice () { }
+CPrinterDevice::~CPrinterDevice () { }
+bool CPrinterDevice::Open () { return false; }
+void CPrinterDevice::Close () { }
+void CPrinterDevice::Write (BYTE *pb_, size_t uLen_) { }
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Display::Init (bool fFirstInit_/*=false*/)
+{
+    Exit(true);
+
+    pafDirty = new bool[Frame::GetHeight()];
+    pabDirtyFrom = new BYTE[Frame::GetHeight()];
+    pabDirtyTo = new BYTE[Frame::GetHeight()];
+    pwSurface = new WORD[Frame::GetWidth() * Frame::GetHeight()];
+    nSurfacePitch = Frame::GetWidth() << 1;
+
+    rSource.w = rTarget.w = Frame::GetWidth();
+    rSource.h = rTarget.h = Frame::GetHeight() << 1;
+
+    return Video::Init(fFirstInit_);
+}
+
+void Display::Exit (bool fReInit_/*=false*/)
+{
+    Video::Exit(fReInit_);
+
+    if (pafDirty) { delete[] pafDirty; pafDirty = NULL; }
+    if (pabDirtyFrom) { delete[] pabDirtyFrom; pabDirtyFrom = NULL; }
+    if (pabDirtyTo) { delete[] pabDirtyTo; pabDirtyTo = NULL; }
+    if (pwSurface) { delete[] pwSurface; pwSurface = NULL; }
+}
+
+void Display::SetDirty ()
+{
+    for (int i = 0, nHeight = Frame::GetHeight() ; i < nHeight ; i++)
+    {
+        pafDirty[i] = true;
+        pabDirtyFrom[i] = 0;
+        pabDirtyTo[i] = 0xff;
+    }
+}
+
+// Lines are drawn directly into the palette rows, with no centring
+WORD* Display::GetHostLine (int nLine_, bool fHiRes_)
+{
+    return pwSurface + nLine_ * nSurfacePitch;
+}
+
+// Same work as the PSP blit: one palette row and one scanline row per changed SAM line
+void Display::Update (CScreen* pScreen_)
+{
+    WORD* pw = pwSurface;
+    int nWidth = pScreen_->GetPitch(), nHeight = pScreen_->GetHeight() >> 1;
+
+    // Direct colour frames are already there, leaving the scanline rows, which are always at half brightness
+    if (Frame::IsDirectColour())
+    {
+        for (int y = 0 ; y < nHeight ; y++, pw += nSurfacePitch)
+        {
+            if (!pafDirty[y])
+                continue;
+            pafDirty[y] = false;
+
+            // Block edges are always even pixels, so the range can be done in DWORDs
+            int nBlockShift = pScreen_->IsHiRes(y) ? 4 : 3;
+            int nFrom = min(pabDirtyFrom[y] << nBlockShift, nWidth), nTo = min(pabDirtyTo[y] << nBlockShift, nWidth);
+            DWORD* pdwFrom = reinterpret_cast<DWORD*>(pw), *pdwTo = reinterpret_cast<DWORD*>(pw + nWidth);
+
+            for (int x = (nFrom >> 1) ; x < (nTo >> 1) ; x++)
+                pdwTo[x] = (pdwFrom[x] >> 1) & 0x7bef7bef;
+        }
+
+        return;
+    }
+
+    for (int y = 0 ; y < nHeight ; y++, pw += nSurfacePitch)
+    {
+        if (!pafDirty[y])
+            continue;
+        pafDirty[y] = false;
+
+        BYTE* pb = pScreen_->GetLine(y);
+        int nBlockShift = pScreen_->IsHiRes(y) ? 4 : 3;
+        int nFrom = min(pabDirtyFrom[y] << nBlockShift, nWidth), nTo = min(pabDirtyTo[y] << nBlockShift, nWidth);
+
+        for (int x = nFrom ; x < nTo ; x++)
+            pw[x] = aulPalette[pb[x]];
+        for (int x = nFrom ; x < nTo ; x++)
+            pw[nWidth+x] = aulScanline[pb[x]];
+    }
+}
+
+void Display::DisplayToSamSize (int* pnX_, int* pnY_) { }
+void Display::SamToDisplaySize (int* pnX_, int* pnY_) { }
+void Display::DisplayToSamPoint (int* pnX_, int* pnY_) { }
+void Display::SamToDisplayPoint (int* pnX_, int* pnY_) { }
+
+
+bool Video::Init (bool fFirstInit_/*=false*/) { return CreatePalettes(); }
+void Video::Exit (bool fReInit_/*=false*/) { }
+void Video::Update () { }
+
+bool Video::CreatePalettes (bool fDimmed_/*=false*/)
+{
+    const RGBA *pSAM = IO::GetPalette(fDimmed_);
+
+    for (int i = 0 ; i < N_PALETTE_COLOURS ; i++)
+    {
+        BYTE r = pSAM[i].bRed, g = pSAM[i].bGreen, b = pSAM[i].bBlue;
+        aulPalette[i] = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+        aulScanline[i] = (aulPalette[i] >> 1) & 0x7bef;
+    }
+
+    for (int c = 0 ; c < 16 ; c++)
+        clut[c] = aulPalette[clutval[c]];
+
+    Frame::ChangePalette();
+    Display::SetDirty();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Sound::Init (bool fFirstInit_/*=false*/) { return true; }
+void Sound::Exit (bool fReInit_/*=false*/) { }
+void Sound::Out (WORD wPort_, BYTE bVal_) { }
+void Sound::FrameUpdate () { }
+void Sound::Stop () { }
+void Sound::Play () { }
+void Sound::Silence () { }
+void Sound::SaveState () { }
+bool Sound::LoadState () { return true; }
+void Sound::OutputDACLeft (BYTE bVal_) { }
+void Sound::OutputDACRight (BYTE bVal_) { }
+void Sound::OutputDAC (BYTE bVal_) { }
+
+bool Input::Init (bool fFirstInit_/*=false*/) { return true; }
+void Input::Exit (bool fReInit_/*=false*/) { }
+void Input::Acquire (bool fMouse_/*=true*/, bool fKeyboard_/*=true*/) { }
+void Input::Purge (bool fMouse_/*=true*/, bool fKeyboard_/*=true*/) { }
+void Input::Update () { }
+void Input::ProcessEvent (SDL_Event* pEvent_) { }
+
+// No debugger, so the core never needs its breakpoint checking
+bool Debug::IsBreakpointSet () { return false; }
+bool Debug::BreakpointHit () { return false; }
+
+// No GUI either, so it's never active
+CWindow* GUI::s_pGUI;
+
+bool UI::Init (bool fFirstInit_/*=false*/) { return true; }
+void UI::Exit (bool fReInit_/*=false*/) { }
+bool UI::CheckEvents () { return true; }
+bool UI::DoAction (int nAction_, bool fPressed_/*=true*/) { return false; }
+
+void UI::ShowMessage (eMsgType eType_, const char* pcszMessage_)
+{
+    fprintf(stderr, "%s\n", pcszMessage_);
+}
+
+// Frame::Sync throttling hooks, normally in the PSP display module
+int psp_sim_update_fps () { return 0; }
+void psp_sim_synchronize (int speed_limiter) { }
+
+#ifndef USE_ZLIB
+bool SaveImage (FILE* hFile_, CScreen* pScreen_) { return false; }
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Main::Exit ()
+{
+    Record::Stop();
+    CPU::Exit();
+    Input::Exit();
+    Sound::Exit();
+    Frame::Exit();
+    OSD::Exit();
+
+    Util::Exit();
+}
+
+
+static double GetSeconds ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Same loop as CPU::Run, but for a fixed number of complete frames
+static void RunFrames (int nFrames_)
+{
+    for (int nFrame = 0 ; nFrame < nFrames_ ; )
+    {
+        CPU::ExecuteChunk();
+        Frame::Complete();
+
+        if (g_nLine >= HEIGHT_LINES)
+        {
+            IO::FrameUpdate();
+            g_nLine %= HEIGHT_LINES;
+            Frame::Start();
+            Rewind::FrameEnd();
+            nFrame++;
+        }
+    }
+}
+
+// Settings from the command-line, shared by all the machines being run
+static int nArgs;
+static char** ppszArgs;
+
+static int nFrames = DEFAULT_BENCH_FRAMES, nRomTraps = 1, nRewind, nExternalMB, nWarpSkip;
+static const char *pcszDisk = "", *pcszROM = "", *pcszTest, *pcszSave;
+static bool fFrames, fDirectColour;
+
+typedef struct
+{
+    pthread_t hThread;
+    int nExitCode;
+    int nFrames;                // Frames run, which a replay can change
+    double dElapsed;
+    DWORD dwTrapMismatches;
+}
+MACHINE_RUN;
+
+// Create a machine on the current thread, with the given disk in drive 1.  If that fails, whatever was
+// created is tidied away again, as the caller has no machine to exit.
+static bool InitMachine (const char* pcszDisk_)
+{
+    if (!Util::Init() || !Options::Load(nArgs, ppszArgs))
+        return false;
+
+    // Run flat out, drawing every frame unless warping
+    SetOption(rom, pcszROM);
+    SetOption(disk1, pcszDisk_);
+    SetOption(sound, false);
+    SetOption(frameskip, 0);
+    SetOption(speed_limiter, 0);
+    SetOption(romtraps, nRomTraps);
+    SetOption(externalmem, nExternalMB);
+    SetOption(warpskip, nWarpSkip);
+    SetOption(warpdisk, false);
+    SetOption(directcolour, fDirectColour);
+
+    if (!OSD::Init(true) || !Sound::Init(true) || !Frame::Init(true) || !Input::Init(true) || !CPU::Init(true))
+    {
+        fprintf(stderr, "Initialisation failed\n");
+        Main::Exit();
+        return false;
+    }
+
+    g_fTurbo = nWarpSkip > 0;
+
+    if (*GetOption(state) && !State::Load(GetOption(state)))
+    {
+        Main::Exit();
+        return false;
+    }
+
+    return true;
+}
+
+// Run the machine created on the current thread, returning false if any part of the run failed
+static bool RunCreatedMachine (MACHINE_RUN* pRun_)
+{
+    pRun_->nFrames = nFrames;
+
+    if (*GetOption(record) && !Record::Start(GetOption(record)))
+        return false;
+    else if (*GetOption(replay))
+    {
+        if (!Record::Play(GetOption(replay)))
+            return false;
+
+        // Run the whole replay unless told otherwise
+        if (!fFrames)
+            pRun_->nFrames = Record::GetFrames();
+    }
+
+    if (pcszTest)
+        return Z80Test::Run(pcszTest);
+
+    double dStart = GetSeconds();
+
+    RunFrames(pRun_->nFrames);
+
+    pRun_->dElapsed = GetSeconds() - dStart;
+    if (pRun_->dElapsed <= 0.0)
+        pRun_->dElapsed = 1e-6;
+
+    pRun_->dwTrapMismatches = Trap::GetMismatches();
+
+    // Rewind and run the end again, which should leave the machine exactly as it was
+    if (nRewind)
+    {
+        int nBack = Rewind::Back(nRewind);
+        if (nBack != nRewind)
+        {
+            fprintf(stderr, "Only %d frames could be rewound\n", nBack);
+            return false;
+        }
+
+        RunFrames(nRewind);
+    }
+
+    if (pcszSave && !State::Save(pcszSave))
+        return false;
+
+    // A replay that went out of step or finished differently is a failure
+    return Record::Stop();
+}
+
+// Create a machine on the current thread, run it, and tidy it away again however the run went
+static int RunMachine (MACHINE_RUN* pRun_)
+{
+    if (!InitMachine(pcszDisk))
+        return 1;
+
+    bool fOK = RunCreatedMachine(pRun_);
+    Main::Exit();
+    return fOK ? 0 : 1;
+}
+
+// Boot a machine to the startup screen and insert the image, so it auto-boots as if the user had inserted it
+static bool RunImage (const char* pcszImage_, const char* pcszShot_, BATCH_RESULT* pResult_)
+{
+    if (!InitMachine(""))
+        return false;
+
+    for (int i = 0 ; i < MAX_STARTUP_FRAMES && !IO::IsAtStartupScreen() ; i++)
+        RunFrames(1);
+
+    // Open it read-only, as the smoke test mustn't change the library
+    if (!pDrive1->Insert(pcszImage_, true))
+    {
+        fprintf(stderr, "%s: not a recognised disk image\n", pcszImage_);
+        Main::Exit();
+        return false;
+    }
+
+    double dStart = GetSeconds();
+
+    RunFrames(nFrames);
+
+    double dElapsed = GetSeconds() - dStart;
+    if (dElapsed <= 0.0)
+        dElapsed = 1e-6;
+
+    pResult_->nFrames = nFrames;
+    pResult_->dTstatesPerSec = static_cast<double>(nFrames) * TSTATES_PER_FRAME / dElapsed;
+    pResult_->dwFrameHash = Frame::GetChecksum();
+
+    if (pcszShot_)
+    {
+        FILE* hFile = fopen(pcszShot_, "wb");
+        if (hFile)
+        {
+            pResult_->fScreenshot = SaveImage(hFile, Frame::GetScreen());
+            pResult_->fScreenshot &= !fclose(hFile);
+        }
+
+        if (!pResult_->fScreenshot)
+            fprintf(stderr, "Failed to save screenshot to %s\n", pcszShot_);
+    }
+
+    Main::Exit();
+    return true;
+}
+
+static void* MachineThread (void* pv_)
+{
+    MACHINE_RUN* pRun = reinterpret_cast<MACHINE_RUN*>(pv_);
+    pRun->nExitCode = RunMachine(pRun);
+    return NULL;
+}
+
+
+int main (int argc_, char* argv_[])
+{
+    int nMachines = 1, nWorkers = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    const char *pcszBatch = NULL, *pcszReport = NULL, *pcszShotDir = NULL;
+    bool fQuiet = false, fRecord = false;
+
+    for (int i = 1 ; i < argc_ ; i++)
+    {
+        if (!strcmp(argv_[i], "-f") && i+1 < argc_)
+            nFrames = atoi(argv_[++i]), fFrames = true;
+        else if (!strcmp(argv_[i], "-r") && i+1 < argc_)
+            pcszROM = argv_[++i];
+        else if (!strcmp(argv_[i], "-m") && i+1 < argc_)
+            nRomTraps = atoi(argv_[++i]);
+        else if (!strcmp(argv_[i], "-x") && i+1 < argc_)
+            nExternalMB = atoi(argv_[++i]);
+        else if (!strcmp(argv_[i], "-k") && i+1 < argc_)
+            nWarpSkip = atoi(argv_[++i]);
+        else if (!strcmp(argv_[i], "-t") && i+1 < argc_)
+            pcszTest = argv_[++i];
+        else if (!strcmp(argv_[i], "-w") && i+1 < argc_)
+            nRewind = atoi(argv_[++i]);
+        else if (!strcmp(argv_[i], "-s") && i+1 < argc_)
+            pcszSave = argv_[++i];
+        else if (!strcmp(argv_[i], "-e") && i+1 < argc_)
+            nFrames = atoi(argv_[++i]) * EMULATED_FRAMES_PER_SECOND, fFrames = true;
+        else if (!strcmp(argv_[i], "-j") && i+1 < argc_)
+            nMachines = atoi(argv_[++i]);
+        else if (!strcmp(argv_[i], "-a") && i+1 < argc_)
+            pcszBatch = argv_[++i];
+        else if (!strcmp(argv_[i], "-p") && i+1 < argc_)
+            nWorkers = atoi(argv_[++i]);
+        else if (!strcmp(argv_[i], "-o") && i+1 < argc_)
+            pcszReport = argv_[++i];
+        else if (!strcmp(argv_[i], "-d") && i+1 < argc_)
+            pcszShotDir = argv_[++i];
+        else if (!strcmp(argv_[i], "--record") && i+1 < argc_)
+            i++, fRecord = true;    // handled by Options::Load
+        else if ((!strcmp(argv_[i], "--state") || !strcmp(argv_[i], "--replay")) && i+1 < argc_)
+            i++;    // handled by Options::Load
+        else if (!strcmp(argv_[i], "-q"))
+            fQuiet = true;
+        else if (!strcmp(argv_[i], "-c"))
+            fDirectColour = true;
+        else if (argv_[i][0] != '-')
+            pcszDisk = argv_[i];
+        else
+            nMachines = 0;
+    }
+
+    // Multiple machines can't share output files, or the exerciser's console output, and a batch brings its own disks
+    bool fShared = pcszSave || fRecord || pcszTest;
+    if (nMachines < 1 || (nMachines > 1 && fShared) || (pcszBatch && (fShared || nMachines > 1 || nRewind || *pcszDisk || fDirectColour)))
+    {
+        fprintf(stderr, "Usage: %s [-f frames | -e seconds] [-r rom] [-m romtraps] [-x external-mb] [-k warp-skip] [-c] [-q] [--state file] [--record file | --replay file] [-w frames] [-s file] [disk-image]\n", argv_[0]);
+        fprintf(stderr, "       %s -j machines [-f frames | -e seconds] [-r rom] [-m romtraps] [-x external-mb] [-k warp-skip] [-c] [-q] [--state file] [--replay file] [-w frames] [disk-image]\n", argv_[0]);
+        fprintf(stderr, "       %s -a image-list [-p workers] [-o report] [-d screenshot-dir] [-f frames | -e seconds] [-r rom] [-m romtraps] [-x external-mb] [-k warp-skip]\n", argv_[0]);
+        fprintf(stderr, "       %s -t exerciser.com\n", argv_[0]);
+        return 1;
+    }
+
+    nArgs = argc_;
+    ppszArgs = argv_;
+
+    if (pcszBatch)
+        return Batch::Run(pcszBatch, pcszReport, pcszShotDir, nWorkers, RunImage) ? 0 : 1;
+
+    MACHINE_RUN* pasRuns = new MACHINE_RUN[nMachines];
+    memset(pasRuns, 0, sizeof(MACHINE_RUN) * nMachines);
+
+    double dStart = GetSeconds();
+
+    // The lookup tables the machines share are built before any of their threads start
+    CPU::InitTables();
+    Frame::InitTables();
+
+    // A single machine runs on the main thread, and any more get a thread each
+    if (nMachines == 1)
+        pasRuns[0].nExitCode = RunMachine(&pasRuns[0]);
+    else
+    {
+        for (int i = 0 ; i < nMachines ; i++)
+        {
+            if (pthread_create(&pasRuns[i].hThread, NULL, MachineThread, &pasRuns[i]))
+            {
+                fprintf(stderr, "Failed to start machine %d\n", i+1);
+                return 1;
+            }
+        }
+
+        for (int i = 0 ; i < nMachines ; i++)
+            pthread_join(pasRuns[i].hThread, NULL);
+    }
+
+    double dElapsed = GetSeconds() - dStart;
+    if (dElapsed <= 0.0)
+        dElapsed = 1e-6;
+
+    int nExitCode = 0, nTotalFrames = 0;
+    bool fRan = !pcszTest;
+
+    for (int i = 0 ; i < nMachines ; i++)
+    {
+        nExitCode |= pasRuns[i].nExitCode;
+        nTotalFrames += pasRuns[i].nFrames;
+        fRan &= pasRuns[i].dElapsed > 0.0;
+
+        if (nMachines > 1 && !fQuiet && pasRuns[i].dElapsed > 0.0)
+            printf("machine %d:  %d frames in %.3fs\n", i+1, pasRuns[i].nFrames, pasRuns[i].dElapsed);
+    }
+
+    // The stats are for the time taken by the machines together, or the lone run alone
+    if (nMachines == 1)
+        dElapsed = pasRuns[0].dElapsed;
+
+    double dTstates = static_cast<double>(nTotalFrames) * TSTATES_PER_FRAME;
+    double dFPS = nTotalFrames / dElapsed;
+
+    // Nothing was timed if a machine failed to start, or was running the exerciser
+    if (fRan && fQuiet)
+        printf("%.1f\n", dFPS);
+    else if (fRan)
+    {
+        printf("frames:     %d in %.3fs\n", nTotalFrames, dElapsed);
+        printf("T-states/s: %.0f\n", dTstates / dElapsed);
+        printf("frames/s:   %.1f\n", dFPS);
+        printf("speed:      %.1f%% of real time (%d Hz)\n", dFPS * 100.0 / EMULATED_FRAMES_PER_SECOND, EMULATED_FRAMES_PER_SECOND);
+
+        if (nRomTraps > 1)
+            printf("mismatches: %lu ROM traps\n", static_cast<unsigned long>(pasRuns[0].dwTrapMismatches));
+    }
+
+    delete[] pasRuns;
+    return nExitCode;
+}
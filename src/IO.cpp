@@ -52,9 +52,11 @@
 #include "Mouse.h"
 #include "Options.h"
 #include "Parallel.h"
+#include "Record.h"
 #include "SAMDOS.h"
 #include "SDIDE.h"
 #include "Sound.h"
+#include "State.h"
 #include "Util.h"
 #include "Video.h"
 #include "YATBus.h"
@@ -63,39 +65,39 @@
 #include "TestHW.cpp"
 #endif
 
-extern int g_nLine;
-extern int g_nLineCycle;
+extern MACHINE_LOCAL int g_nLine;
+extern MACHINE_LOCAL int g_nLineCycle;
 
-CDiskDevice *pDrive1, *pDrive2, *pSDIDE, *pYATBus, *pBootDrive;
-CIoDevice *pParallel1, *pParallel2;
-CIoDevice *pSerial1, *pSerial2;
-CIoDevice *pSambus, *pDallas;
-CIoDevice *pMidi;
-CIoDevice *pBeeper;
+MACHINE_LOCAL CDiskDevice *pDrive1, *pDrive2, *pSDIDE, *pYATBus, *pBootDrive;
+MACHINE_LOCAL CIoDevice *pParallel1, *pParallel2;
+MACHINE_LOCAL CIoDevice *pSerial1, *pSerial2;
+MACHINE_LOCAL CIoDevice *pSambus, *pDallas;
+MACHINE_LOCAL CIoDevice *pMidi;
+MACHINE_LOCAL CIoDevice *pBeeper;
 
 // Port read/write addresses for I/O breakpoints
-WORD wPortRead, wPortWrite;
+MACHINE_LOCAL WORD wPortRead, wPortWrite;
 
 // Paging ports for internal and external memory
-BYTE vmpr, hmpr, lmpr, lepr, hepr;
-BYTE vmpr_mode, vmpr_page1, vmpr_page2;
+MACHINE_LOCAL BYTE vmpr, hmpr, lmpr, lepr, hepr;
+MACHINE_LOCAL BYTE vmpr_mode, vmpr_page1, vmpr_page2;
 
-BYTE border, border_col;
+MACHINE_LOCAL BYTE border, border_col;
 
-BYTE keyboard;
-BYTE status_reg;
-BYTE line_int;
+MACHINE_LOCAL BYTE keyboard;
+MACHINE_LOCAL BYTE status_reg;
+MACHINE_LOCAL BYTE line_int;
 
-BYTE lpen;
+MACHINE_LOCAL BYTE lpen;
 
-UINT clut[N_CLUT_REGS], clutval[N_CLUT_REGS], mode3clutval[4];
+MACHINE_LOCAL UINT clut[N_CLUT_REGS], clutval[N_CLUT_REGS], mode3clutval[4];
 
-BYTE keyports[9];       // 8 rows of keys (+ 1 row for unscanned keys)
-BYTE keybuffer[9];      // working buffer for key changed, activated mid-frame
-bool fInputDirty;       // true if the input has been modified since the last frame
+MACHINE_LOCAL BYTE keyports[9];       // 8 rows of keys (+ 1 row for unscanned keys)
+MACHINE_LOCAL BYTE keybuffer[9];      // working buffer for key changed, activated mid-frame
+MACHINE_LOCAL bool fInputDirty;       // true if the input has been modified since the last frame
 
-bool fASICStartup;      // If set, the ASIC will be unresponsive shortly after first power-on
-bool g_fAutoBoot;       // Auto-boot the disk in drive 1 when we're at the startup screen
+MACHINE_LOCAL bool fASICStartup;      // If set, the ASIC will be unresponsive shortly after first power-on
+MACHINE_LOCAL bool g_fAutoBoot;       // Auto-boot the disk in drive 1 when we're at the startup screen
 
 
 bool IO::Init (bool fFirstInit_/*=false*/)
@@ -346,10 +348,14 @@ static inline void PaletteChange (BYTE bHMPR_)
 {
     // Update the 4 colours available to mode 3 (note: the middle colours are switched)
     BYTE mode3_bcd48 = (bHMPR_ & HMPR_MD3COL_MASK) >> 3;
-    mode3clutval[0] = clutval[mode3_bcd48 | 0];
-    mode3clutval[1] = clutval[mode3_bcd48 | 2];
-    mode3clutval[2] = clutval[mode3_bcd48 | 1];
-    mode3clutval[3] = clutval[mode3_bcd48 | 3];
+    UINT auMode3[4] = { clutval[mode3_bcd48 | 0], clutval[mode3_bcd48 | 2], clutval[mode3_bcd48 | 1], clutval[mode3_bcd48 | 3] };
+
+    // HMPR writes are frequent, so only a real change has the drawing tables rebuilt
+    if (memcmp(mode3clutval, auMode3, sizeof auMode3))
+    {
+        memcpy(mode3clutval, auMode3, sizeof auMode3);
+        Frame::ChangePalette();
+    }
 }
 
 
@@ -417,6 +423,10 @@ void IO::OutVmpr (BYTE bVal_)
     // Extract the page number(s) for faster access by the memory writing functions
     vmpr_page1 = VMPR_PAGE;
     vmpr_page2 = (vmpr_page1+1) & VMPR_PAGE_MASK;
+
+    // Update which sections now hold display memory
+    for (int nSection = SECTION_A ; nSection <= SECTION_D ; nSection++)
+        UpdateSectionVideo(asSections[nSection]);
 }
 
 void IO::OutLepr (BYTE bVal_)
@@ -447,9 +457,10 @@ void IO::OutClut (WORD wPort_, BYTE bVal_)
         // Draw up to the current point with the previous settings
         Frame::Update();
 
-        // Update the clut entry and the mode 3 palette
+        // Update the clut entry and the mode 3 palette, and have the drawing tables rebuilt before they're next used
         clut[wPort_] = static_cast<DWORD>(aulPalette[clutval[wPort_] = bVal_]);
         PaletteChange(hmpr);
+        Frame::ChangePalette();
     }
 }
 
@@ -637,7 +648,10 @@ void IO::Out (WORD wPort_, BYTE bVal_)
 
             // Has the border colour has changed colour or the screen been enabled/disabled?
             if (fScreenOffChange || ((border ^ bVal_) & BORD_COLOUR_MASK))
+            {
                 Frame::Update();
+                Frame::SetDirty();
+            }
 
             // If the screen enable state has changed, consider a border change artefact
             if (fScreenOffChange && (border & BORD_SOFF))
@@ -765,9 +779,11 @@ void IO::Out (WORD wPort_, BYTE bVal_)
                         // and the CheckCpuEvents above has taken care of it, so do nothing
                         if (status_reg & STATUS_INT_LINE)
                         {
-                            // Otherwise, set the interrupt ourselves and create an event to end it
+                            // Otherwise, set the interrupt ourselves and create an event to end it.  If it was
+                            // only just cancelled, the end event still pending for it is already at this time.
                             status_reg &= ~STATUS_INT_LINE;
-                            AddCpuEvent(evtStdIntEnd, g_dwCycleCounter - nLineCycle_ + INT_ACTIVE_TIME);
+                            if (!IsCpuEventPending(evtStdIntEnd))
+                                AddCpuEvent(evtStdIntEnd, g_dwCycleCounter - nLineCycle_ + INT_ACTIVE_TIME);
                         }
                     }
                     else
@@ -880,6 +896,8 @@ void IO::FrameUpdate ()
     CClockDevice::FrameUpdate();
     Sound::FrameUpdate();
     Input::Update();
+    Mouse::Update();
+    Record::FrameEnd();
 }
 
 void IO::UpdateInput()
@@ -889,7 +907,7 @@ void IO::UpdateInput()
         Input::Purge(false);
 
     // Non-zero to tap the F9 key
-    static int nAutoBoot = 0;
+    static MACHINE_LOCAL int nAutoBoot = 0;
 
     // If an auto-boot is required, make sure we're at the stripey startup screen
     if (g_fAutoBoot && IsAtStartupScreen())
@@ -913,11 +931,14 @@ void IO::UpdateInput()
         memcpy(keyports, keybuffer, sizeof keyports);
         fInputDirty = false;
     }
+
+    // Log any change for an input recording, or replace the matrix from a replay
+    Record::UpdateKeyboard(keyports);
 }
 
 const RGBA* IO::GetPalette (bool fDimmed_/*=false*/)
 {
-    static RGBA asPalette[N_PALETTE_COLOURS];
+    static MACHINE_LOCAL RGBA asPalette[N_PALETTE_COLOURS];
 
     // Look-up table for an even intensity spread, used to map SAM colours to RGB
     static const BYTE abIntensities[] = { 0x00, 0x24, 0x49, 0x6d, 0x92, 0xb6, 0xdb, 0xff };
@@ -1026,3 +1047,80 @@ bool IO::Rst8Hook ()
     // RST not processed
     return false;
 }
+
+
+// ASIC state as saved, with the CLUT as SAM colour numbers rather than the host palette values
+typedef struct
+{
+    BYTE    bLmpr, bHmpr, bVmpr, bLepr, bHepr;
+    BYTE    bBorder, bKeyboard, bStatus, bLineInt, bLpen;
+    BYTE    abClut[N_CLUT_REGS];
+    BYTE    abKeyports[sizeof keyports];
+    bool    fASICStartup, fAutoBoot;
+}
+IO_STATE;
+
+void IO::SaveState ()
+{
+    IO_STATE sState;
+    memset(&sState, 0, sizeof sState);
+
+    sState.bLmpr = lmpr;
+    sState.bHmpr = hmpr;
+    sState.bVmpr = vmpr;
+    sState.bLepr = lepr;
+    sState.bHepr = hepr;
+    sState.bBorder = border;
+    sState.bKeyboard = keyboard;
+    sState.bStatus = status_reg;
+    sState.bLineInt = line_int;
+    sState.bLpen = lpen;
+    sState.fASICStartup = fASICStartup;
+    sState.fAutoBoot = g_fAutoBoot;
+
+    for (int n = 0 ; n < N_CLUT_REGS ; n++)
+        sState.abClut[n] = clutval[n];
+
+    memcpy(sState.abKeyports, keyports, sizeof keyports);
+
+    State::Write(&sState, sizeof sState);
+}
+
+bool IO::LoadState ()
+{
+    IO_STATE sState;
+    if (!State::Read(&sState, sizeof sState))
+        return false;
+
+    // Set the ports directly, then page through the usual functions to update everything derived from them
+    lmpr = sState.bLmpr;
+    hmpr = sState.bHmpr;
+    lepr = sState.bLepr;
+    hepr = sState.bHepr;
+
+    OutVmpr(sState.bVmpr);
+    OutLmpr(lmpr);
+    OutHmpr(hmpr);
+
+    border = sState.bBorder;
+    border_col = BORD_VAL(border);
+    keyboard = sState.bKeyboard;
+    status_reg = sState.bStatus;
+    line_int = sState.bLineInt;
+    lpen = sState.bLpen;
+    fASICStartup = sState.fASICStartup;
+    g_fAutoBoot = sState.fAutoBoot;
+
+    for (int n = 0 ; n < N_CLUT_REGS ; n++)
+        clut[n] = aulPalette[clutval[n] = sState.abClut[n] & (N_PALETTE_COLOURS-1)];
+
+    PaletteChange(hmpr);
+    Frame::ChangePalette();
+
+    // Any keys held on the host will be picked up again by the next input update
+    memcpy(keyports, sState.abKeyports, sizeof keyports);
+    memcpy(keybuffer, keyports, sizeof keybuffer);
+    fInputDirty = false;
+
+    return true;
+}
@@ -65,6 +65,9 @@ class IO
         static bool IsAtStartupScreen ();
         static void CheckAutoboot ();
         static bool Rst8Hook ();
+
+        static void SaveState ();
+        static bool LoadState ();
 };
 
 
@@ -94,6 +97,10 @@ class CDiskDevice :  public CIoDevice
         virtual bool Save () { return true; }
         virtual void Reset () { }
 
+        // Controller state for save states, using State::Write and State::Read
+        virtual void SaveState () const { }
+        virtual bool LoadState () { return true; }
+
     public:
         virtual int GetType () const { return m_nType; }
         virtual int GetDiskType () const { return -1; }
@@ -245,8 +252,8 @@ enum eSamKey
     SK_CONTROL, SK_UP, SK_DOWN, SK_LEFT, SK_RIGHT, SK_NONE, SK_MAX=SK_NONE
 };
 
-extern BYTE keyboard, keyports[9], keybuffer[9];
-extern bool fInputDirty;
+extern MACHINE_LOCAL BYTE keyboard, keyports[9], keybuffer[9];
+extern MACHINE_LOCAL bool fInputDirty;
 
 // Helper macros for SAM keyboard matrix manipulation
 inline bool IsSamKeyPressed (int k) { return !(keybuffer[(k) >> 3] & (1 << ((k) & 7))); }
@@ -260,25 +267,25 @@ inline void ReleaseAllSamKeys ()    { memset(keybuffer, 0xff, sizeof keyports);
 #endif
 
 // Last port read/written
-extern WORD wPortRead, wPortWrite;
+extern MACHINE_LOCAL WORD wPortRead, wPortWrite;
 
 // Paging ports for internal and external memory
-extern BYTE vmpr, hmpr, lmpr, lepr, hepr;
-extern BYTE vmpr_mode, vmpr_page1, vmpr_page2;
+extern MACHINE_LOCAL BYTE vmpr, hmpr, lmpr, lepr, hepr;
+extern MACHINE_LOCAL BYTE vmpr_mode, vmpr_page1, vmpr_page2;
 
-extern BYTE border;
-extern BYTE border_col;
+extern MACHINE_LOCAL BYTE border;
+extern MACHINE_LOCAL BYTE border_col;
 
 // Write only ports
-extern BYTE line_int;
-extern UINT clut[N_CLUT_REGS], clutval[N_CLUT_REGS], mode3clutval[4];
+extern MACHINE_LOCAL BYTE line_int;
+extern MACHINE_LOCAL UINT clut[N_CLUT_REGS], clutval[N_CLUT_REGS], mode3clutval[4];
 
 // Read only ports
-extern BYTE status_reg;
-extern BYTE lpen;
+extern MACHINE_LOCAL BYTE status_reg;
+extern MACHINE_LOCAL BYTE lpen;
 
-extern CDiskDevice *pDrive1, *pDrive2, *pSDIDE, *pYATBus;
-extern CIoDevice *pParallel1, *pParallel2;
-extern bool g_fAutoBoot;
+extern MACHINE_LOCAL CDiskDevice *pDrive1, *pDrive2, *pSDIDE, *pYATBus;
+extern MACHINE_LOCAL CIoDevice *pParallel1, *pParallel2;
+extern MACHINE_LOCAL bool g_fAutoBoot;
 
 #endif
@@ -239,8 +239,8 @@ void Input::Purge (bool fMouse_/*=true*/, bool fKeyboard_/*=true*/)
         while (SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_MOUSEEVENTMASK) > 0);
         SDL_GetRelativeMouseState(&n, &n);
 
-        // Reset the mouse
-        Mouse::Init();
+        // Discard any movement and release the buttons
+        Mouse::Purge();
     }
 }
 
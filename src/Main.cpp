@@ -25,7 +25,9 @@
 #include "Frame.h"
 #include "Input.h"
 #include "Options.h"
+#include "Record.h"
 #include "Sound.h"
+#include "State.h"
 #include "UI.h"
 #include "Util.h"
 #include "Display.h"
@@ -44,6 +46,17 @@ bool Main::Init (int argc_, char* argv_[])
            Frame::Init(true) && 
            Input::Init(true) && 
            CPU::Init(true);
+
+    // Resume from a saved state if one was given, falling back on a normal boot if it fails
+    if (f && *GetOption(state))
+        State::Load(GetOption(state));
+
+    // Start recording or replaying input, from whatever state the machine is in now
+    if (f && *GetOption(record))
+        Record::Start(GetOption(record));
+    else if (f && *GetOption(replay))
+        Record::Play(GetOption(replay));
+
    psp_sdl_black_screen();
    return f;
 }
@@ -51,6 +64,7 @@ bool Main::Init (int argc_, char* argv_[])
 void
 Main::Exit ()
 {
+    Record::Stop();
     CPU::Exit();
     Input::Exit();
     Sound::Exit();
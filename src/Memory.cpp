@@ -25,41 +25,139 @@
 #include "SimCoupe.h"
 #include "Memory.h"
 
+#ifdef USE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "CPU.h"
 #include "CStream.h"
 #include "HDBOOT.h"
 #include "Options.h"
 #include "OSD.h"
+#include "Rewind.h"
 #include "SAMROM.h"
+#include "State.h"
+#include "Trap.h"
 #include "Util.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 // Single block holding all memory needed
-BYTE* pMemory;
-int nAllocatedPages;
+MACHINE_LOCAL BYTE* pMemory;
+MACHINE_LOCAL int nAllocatedPages;
+MACHINE_LOCAL size_t uMappedSize;     // Size of the block if it was mapped rather than allocated
 
 // Master read and write lists that are static for a given memory configuration
-BYTE* apbPageReadPtrs[TOTAL_PAGES];
-BYTE* apbPageWritePtrs[TOTAL_PAGES];
-
-// Page numbers present in each of the 4 sections in the 64K address range
-int anSectionPages[4];
-bool afContendedPages[4];
+MACHINE_LOCAL BYTE* apbPageReadPtrs[TOTAL_PAGES];
+MACHINE_LOCAL BYTE* apbPageWritePtrs[TOTAL_PAGES];
 
-// Array of pointers for memory to use when reading from or writing to each each section
-BYTE* apbSectionReadPtrs[4];
-BYTE* apbSectionWritePtrs[4];
+// Pages, memory pointers and access details for each of the 4 sections in the 64K address range
+MACHINE_LOCAL MEM_SECTION asSections[4] __attribute__((aligned(64)));
 
 // Look-up tables for fast mapping between mode 1 display addresses and line numbers
-WORD g_awMode1LineToByte[SCREEN_LINES];
-BYTE g_abMode1ByteToLine[SCREEN_LINES];
+MACHINE_LOCAL WORD g_awMode1LineToByte[SCREEN_LINES];
+MACHINE_LOCAL BYTE g_abMode1ByteToLine[SCREEN_LINES];
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static void LoadRoms (BYTE* pb0_, BYTE* pb1_);
 
 
+// RAM powers up striped, alternating between 0x00 and 0xff every 128 bytes
+static void StripeRAM (BYTE* pb_, int nPages_)
+{
+    memset(pb_, 0xff, nPages_*MEM_PAGE_SIZE);
+    for (int i = 0 ; i < nPages_*MEM_PAGE_SIZE ; i += 0x100)
+        memset(pb_+i, 0x00, 0x080);
+}
+
+#ifdef USE_MMAP
+// Create a host file holding one striped RAM page, returning its descriptor, or -1 on failure
+static int CreateTemplatePage ()
+{
+    BYTE ab[MEM_PAGE_SIZE];
+    StripeRAM(ab, 1);
+
+    FILE* hFile = tmpfile();
+    if (hFile && fwrite(ab, sizeof ab, 1, hFile) == 1 && !fflush(hFile))
+        return fileno(hFile);
+
+    if (hFile)
+        fclose(hFile);
+
+    return -1;
+}
+
+// Map the memory block, with external RAM as private copies of the template page.  Untouched pages are read from
+// the template, and the host only gives a page memory of its own when it's first written, so unused external RAM
+// costs almost nothing.  The read and write pointers are no different from an allocated block, so there's no
+// extra work for the CPU core either.
+static BYTE* MapMemory (int nTotalPages_, int nExtStart_, int nExtPages_)
+{
+    // One template is shared by every machine in the process, and it must line up with host pages
+    static int hTemplate = CreateTemplatePage();
+    if (hTemplate < 0 || !nExtPages_ || (MEM_PAGE_SIZE % sysconf(_SC_PAGESIZE)))
+        return NULL;
+
+    size_t uSize = nTotalPages_ * MEM_PAGE_SIZE;
+    void* pv = mmap(NULL, uSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (pv == MAP_FAILED)
+        return NULL;
+
+    BYTE* pb = reinterpret_cast<BYTE*>(pv);
+
+    for (int nExt = 0 ; nExt < nExtPages_ ; nExt++)
+    {
+        if (mmap(pb + (nExtStart_+nExt)*MEM_PAGE_SIZE, MEM_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, hTemplate, 0) == MAP_FAILED)
+        {
+            munmap(pv, uSize);
+            return NULL;
+        }
+    }
+
+    uMappedSize = uSize;
+    return pb;
+}
+#endif
+
+// Allocate the memory block, with the RAM striped and everything else set to 0xff
+static BYTE* AllocMemory (int nTotalPages_, int nIntPages_, int nExtPages_)
+{
+    BYTE* pb = NULL;
+
+#ifdef USE_MMAP
+    // External RAM is already striped if the block could be mapped
+    if ((pb = MapMemory(nTotalPages_, nIntPages_, nExtPages_)))
+    {
+        StripeRAM(pb, nIntPages_);
+        memset(pb + (nIntPages_+nExtPages_)*MEM_PAGE_SIZE, 0xff, (nTotalPages_-nIntPages_-nExtPages_)*MEM_PAGE_SIZE);
+        return pb;
+    }
+#endif
+
+    if ((pb = new BYTE[nTotalPages_*MEM_PAGE_SIZE]))
+    {
+        StripeRAM(pb, nIntPages_+nExtPages_);
+        memset(pb + (nIntPages_+nExtPages_)*MEM_PAGE_SIZE, 0xff, (nTotalPages_-nIntPages_-nExtPages_)*MEM_PAGE_SIZE);
+    }
+
+    return pb;
+}
+
+static void FreeMemory (BYTE* pb_, size_t uMappedSize_)
+{
+#ifdef USE_MMAP
+    if (uMappedSize_)
+    {
+        munmap(pb_, uMappedSize_);
+        return;
+    }
+#endif
+
+    delete[] pb_;
+}
+
+
 // Allocate and initialise memory
 bool Memory::Init (bool fFirstInit_/*=false*/)
 {
@@ -81,19 +179,16 @@ bool Memory::Init (bool fFirstInit_/*=false*/)
     // Only consider changes if the memory requirements have changes
     if (nTotalPages != nAllocatedPages)
     {
+        size_t uOldMappedSize = uMappedSize;
+        uMappedSize = 0;
+
         // Error/fail depending on whether we've got an existing allocation to fall back on
-        if (!(pb = new BYTE[nTotalPages*MEM_PAGE_SIZE]))
+        if (!(pb = AllocMemory(nTotalPages, nIntPages, nExtPages)))
         {
+            uMappedSize = uOldMappedSize;
             Message(pMemory ? msgError : msgFatal, "Out of memory!");
             return false;
         }
-        else
-        {
-            // Initialise memory to 0xff, and stripe the RAM banks between 0xff and 0x00 every 128 bytes
-            memset(pb, 0xff, nTotalPages*MEM_PAGE_SIZE);
-            for (int i = 0 ; i < nRamPages*MEM_PAGE_SIZE ; i += 0x100)
-                memset(pb+i, 0x00, 0x080);
-        }
 
 
         // Set up the scratch banks after the ROMs, used for reads from invalid memory and writes to read-only memory
@@ -130,7 +225,7 @@ bool Memory::Init (bool fFirstInit_/*=false*/)
                     memcpy(apbRead[nPage], apbPageReadPtrs[nPage], MEM_PAGE_SIZE);
             }
 
-            delete pMemory;
+            FreeMemory(pMemory, uOldMappedSize);
             pMemory = NULL;
         }
 
@@ -140,6 +235,9 @@ bool Memory::Init (bool fFirstInit_/*=false*/)
         pMemory = pb;
         nAllocatedPages = nTotalPages;
 
+        // Nothing recorded for the old memory can be used with the new
+        Rewind::Clear();
+
         // Finally, refresh the paging to update any physical memory references
         IO::OutLmpr(lmpr);
         IO::OutHmpr(hmpr);
@@ -149,15 +247,59 @@ bool Memory::Init (bool fFirstInit_/*=false*/)
     // Load/update the ROM images
     LoadRoms(apbPageReadPtrs[ROM0], apbPageReadPtrs[ROM1]);
 
-    return true;
+    // Arm the ROM traps that match them
+    Trap::Init();
+
+    return Rewind::Init(fFirstInit_);
 }
 
 void Memory::Exit (bool fReInit_/*=false*/)
 {
-    if (!fReInit_) { delete[] pMemory; pMemory = NULL; }
+    Rewind::Exit(fReInit_);
+    if (!fReInit_) { FreeMemory(pMemory, uMappedSize); pMemory = NULL; nAllocatedPages = 0; uMappedSize = 0; }
 }
 
 
+// The RAM and ROM pages are contiguous at the start of the memory block, so they're saved in one piece after the page counts
+void Memory::SaveState ()
+{
+    int anPages[2];
+    anPages[0] = (apbPageReadPtrs[N_PAGES_MAIN/2] == apbPageReadPtrs[SCRATCH_READ]) ? N_PAGES_MAIN/2 : N_PAGES_MAIN;
+    anPages[1] = nAllocatedPages - anPages[0] - 2 - 2;
+
+    State::Write(anPages, sizeof anPages);
+    State::Write(pMemory, (anPages[0]+anPages[1]+2) * MEM_PAGE_SIZE);
+}
+
+bool Memory::LoadState ()
+{
+    int anPages[2];
+    if (!State::Read(anPages, sizeof anPages) || (anPages[0] != N_PAGES_MAIN && anPages[0] != N_PAGES_MAIN/2) ||
+        anPages[1] < 0 || anPages[1] > N_PAGES_1MB*MAX_EXTERNAL_MB || anPages[1] % N_PAGES_1MB)
+        return false;
+
+    // Switch to the saved memory configuration if it's different
+    if (GetOption(mainmem) != ((anPages[0] == N_PAGES_MAIN) ? 512 : 256) || GetOption(externalmem) != anPages[1]/N_PAGES_1MB ||
+        nAllocatedPages != anPages[0]+anPages[1]+2+2)
+    {
+        SetOption(mainmem, (anPages[0] == N_PAGES_MAIN) ? 512 : 256);
+        SetOption(externalmem, anPages[1]/N_PAGES_1MB);
+
+        if (!Init())
+            return false;
+    }
+
+    // Earlier frames can't be rewound to over the loaded memory
+    Rewind::Clear();
+
+    if (!State::Read(pMemory, (anPages[0]+anPages[1]+2) * MEM_PAGE_SIZE))
+        return false;
+
+    // The saved ROMs may not be the ones loaded
+    Trap::Init();
+    return true;
+}
+
 // Read the ROM image into the ROM area of our paged memory block
 static void LoadRoms (BYTE* pb0_, BYTE* pb1_)
 {
@@ -23,30 +23,49 @@
 #define MEMORY_H
 
 #include "Frame.h"
+#include "Rewind.h"
 
 class Memory
 {
     public:
         static bool Init (bool fFirstInit_=false);
         static void Exit (bool fReInit_=false);
+
+        static void SaveState ();
+        static bool LoadState ();
 };
 
 
 enum { INTMEM, EXTMEM=N_PAGES_MAIN, ROM0=EXTMEM+(N_PAGES_1MB*MAX_EXTERNAL_MB), ROM1, SCRATCH_READ, SCRATCH_WRITE, TOTAL_PAGES };
 enum eSection { SECTION_A, SECTION_B, SECTION_C, SECTION_D };
+enum { VIDEO_NONE, VIDEO_PAGE1, VIDEO_PAGE2 };
+
+// Everything a memory access needs to know about one 16K section of the address space, kept together so an
+// access touches a single structure.  The size is padded to a power of 2, and on the PSP the whole map fits
+// in one 64-byte cache line.
+typedef struct
+{
+    BYTE*   pbRead;         // Memory to use when reading from the section
+    BYTE*   pbWrite;        // Memory to use when writing, which is scratch space for ROM or protected RAM
+    int     nPage;          // Page number present in the section
+    bool    fContended;     // Accesses are subject to memory contention
+    BYTE    bVideo;         // Display page that writes to the section may affect (VIDEO_xxx)
+}
+__attribute__((aligned(16))) MEM_SECTION;
+
+extern MACHINE_LOCAL MEM_SECTION asSections[4];
+extern MACHINE_LOCAL BYTE g_abMode1ByteToLine[SCREEN_LINES];
+extern MACHINE_LOCAL WORD g_awMode1LineToByte[SCREEN_LINES];
+extern MACHINE_LOCAL BYTE *apbPageReadPtrs[],  *apbPageWritePtrs[];
 
-extern int anSectionPages[4];
-extern BYTE* apbSectionReadPtrs[4];
-extern BYTE* apbSectionWritePtrs[4];
-extern BYTE g_abMode1ByteToLine[SCREEN_LINES];
-extern WORD g_awMode1LineToByte[SCREEN_LINES];
-extern BYTE *apbPageReadPtrs[],  *apbPageWritePtrs[];
-extern bool afContendedPages[4];
+// Writes are tracked in 1K blocks for the rewind buffer, with a bit for each block of a page written this frame
+const int MEM_BLOCK_SHIFT = 10;
+extern MACHINE_LOCAL WORD awWrittenBlocks[TOTAL_PAGES];
 
 
 // Map a 16-bit address through the memory indirection - allows fast paging
 inline int VPAGE (WORD wAddr_) { return wAddr_ >> 14; }
-inline int RPAGE (WORD wAddr_) { return anSectionPages[VPAGE(wAddr_)]; }
+inline int RPAGE (WORD wAddr_) { return asSections[VPAGE(wAddr_)].nPage; }
 
 void write_to_screen_vmpr0 (WORD wAddr_);
 void write_to_screen_vmpr1 (WORD wAddr_);
@@ -55,29 +74,121 @@ void write_word (WORD wAddr_, WORD wVal_);
 
 inline BYTE* phys_read_addr (UINT uPage_, UINT uOffset_)
 {
-    return &apbSectionReadPtrs[uPage_ & (N_PAGES_MAIN-1)][uOffset_ & (MEM_PAGE_SIZE-1)];
+    return &apbPageReadPtrs[uPage_ & (N_PAGES_MAIN-1)][uOffset_ & (MEM_PAGE_SIZE-1)];
 }
 
 inline BYTE* phys_read_addr (WORD wAddr_)
 {
-    return &apbSectionReadPtrs[VPAGE(wAddr_)][wAddr_ & (MEM_PAGE_SIZE-1)];
+    return &asSections[VPAGE(wAddr_)].pbRead[wAddr_ & (MEM_PAGE_SIZE-1)];
 }
 
 inline BYTE* phys_write_addr (WORD wAddr_)
 {
-    return &apbSectionWritePtrs[VPAGE(wAddr_)][wAddr_ & (MEM_PAGE_SIZE-1)];
+    return &asSections[VPAGE(wAddr_)].pbWrite[wAddr_ & (MEM_PAGE_SIZE-1)];
 }
 
 
 inline void check_video_write (WORD wAddr_)
 {
-    // Does the write fall within the first display page?
-    if (RPAGE(wAddr_) == vmpr_page1)
-        write_to_screen_vmpr0(wAddr_);
+    switch (asSections[VPAGE(wAddr_)].bVideo)
+    {
+        // Nothing to do unless the section holds a display page
+        case VIDEO_NONE:
+            break;
+
+        case VIDEO_PAGE1:
+            write_to_screen_vmpr0(wAddr_);
+            break;
 
-    // Does the write fall within the second display page? (modes 3 and 4 only)
-    else if ((RPAGE(wAddr_) == vmpr_page2) && (vmpr_mode > MODE_2))
-        write_to_screen_vmpr1(wAddr_);
+        // The second display page is only used by modes 3 and 4
+        case VIDEO_PAGE2:
+            write_to_screen_vmpr1(wAddr_);
+            break;
+    }
+}
+
+
+// Check whether any write to a range of addresses in one section could need the frame drawing up to the raster
+// position first, so block writes only need to check each byte as it's written if it might affect the display.
+// If not, the lines they could touch are noted for drawing here instead.
+inline bool check_video_range (WORD wAddr_, UINT uLen_)
+{
+    UINT uFrom = wAddr_ & (MEM_PAGE_SIZE-1), uTo = uFrom + uLen_ - 1;
+    int nFrom = SCREEN_LINES, nTo = -1;
+    UINT uRowShift = 0;     // Bytes in each display row as a shift, for the mappings with one row to a line
+
+    // Find the span of lines the writes could touch, using the same mapping as write_to_screen_vmpr0/1
+    BYTE bVideo = asSections[VPAGE(wAddr_)].bVideo;
+    if (bVideo == VIDEO_PAGE1)
+    {
+        switch (vmpr_mode)
+        {
+            case MODE_1:
+                // Screen data lines within a third are interleaved, so the whole third is included
+                if (uFrom < 6144)
+                {
+                    nFrom = (uFrom >> 11) << 6;
+                    nTo = ((min(uTo, 6143U) >> 11) << 6) + 63;
+                }
+
+                // Each attribute row covers 8 lines
+                if (uTo >= 6144 && uFrom < 6912)
+                {
+                    nFrom = min(nFrom, static_cast<int>(((max(uFrom, 6144U) - 6144) & 0xffe0) >> 2));
+                    nTo = max(nTo, static_cast<int>(((min(uTo, 6911U) - 6144) & 0xffe0) >> 2) + 7);
+                }
+                break;
+
+            case MODE_2:
+                if (uFrom < 6144)
+                {
+                    nFrom = uFrom >> 5;
+                    nTo = min(uTo, 6143U) >> 5;
+                }
+
+                if (uTo >= 8192 && uFrom < 8192+6144)
+                {
+                    nFrom = min(nFrom, static_cast<int>((max(uFrom, 8192U) & 0x1fff) >> 5));
+                    nTo = max(nTo, static_cast<int>((min(uTo, 8192U+6143) & 0x1fff) >> 5));
+                }
+
+                uRowShift = 5;
+                break;
+
+            default:
+                nFrom = uFrom >> 7;
+                nTo = uTo >> 7;
+                uRowShift = 7;
+                break;
+        }
+    }
+    else if (bVideo == VIDEO_PAGE2 && uFrom < 8192)
+    {
+        nFrom = (uFrom + MEM_PAGE_SIZE) >> 7;
+        nTo = (min(uTo, 8191U) + MEM_PAGE_SIZE) >> 7;
+        uRowShift = 7;
+    }
+
+    if (nFrom > nTo)
+        return false;
+
+    nFrom += TOP_BORDER_LINES;
+    nTo += TOP_BORDER_LINES;
+
+    if (Frame::NeedsUpdate(nFrom, nTo))
+        return true;
+
+    // Writes within one row only touch the blocks they cover, with 32 blocks to a row
+    int nFromBlock = BORDER_BLOCKS, nToBlock = BORDER_BLOCKS+SCREEN_BLOCKS;
+    if (uRowShift && (uFrom >> uRowShift) == (uTo >> uRowShift))
+    {
+        UINT uRowMask = (1U << uRowShift) - 1;
+        nFromBlock = BORDER_BLOCKS + ((uFrom & uRowMask) >> (uRowShift - 5));
+        nToBlock = BORDER_BLOCKS + ((uTo & uRowMask) >> (uRowShift - 5)) + 1;
+    }
+
+    Frame::NoteWrites(nFrom, nTo, nFromBlock, nToBlock);
+    return false;
 }
 
 
@@ -91,8 +202,35 @@ inline WORD read_word (WORD wAddr_)
     return read_byte(wAddr_) | (read_byte(wAddr_+1) << 8);
 }
 
+// Note a write to a page, so the rewind buffer can keep what its block held at the start of the frame.  Pages
+// that aren't tracked have all their bits set, so this costs only the test.
+inline void track_page_write (int nPage_, UINT uOffset_)
+{
+    UINT uBlock = (uOffset_ & (MEM_PAGE_SIZE-1)) >> MEM_BLOCK_SHIFT;
+
+    if (!(awWrittenBlocks[nPage_] & (1 << uBlock)))
+        Rewind::SaveBlock(nPage_, uBlock);
+}
+
+inline void track_write (WORD wAddr_)
+{
+    track_page_write(RPAGE(wAddr_), wAddr_);
+}
+
+// Note writes to a range of addresses in one section
+inline void track_write_range (WORD wAddr_, UINT uLen_)
+{
+    int nPage = RPAGE(wAddr_);
+    UINT uOffset = wAddr_ & (MEM_PAGE_SIZE-1);
+
+    for (UINT u = uOffset & ~((1U << MEM_BLOCK_SHIFT) - 1) ; u < uOffset + uLen_ ; u += 1U << MEM_BLOCK_SHIFT)
+        track_page_write(nPage, u);
+}
+
+
 inline void write_byte (WORD wAddr_, BYTE bVal_)
 {
+    track_write(wAddr_);
     *phys_write_addr(wAddr_) = bVal_;
 }
 
@@ -106,23 +244,37 @@ inline void write_word (WORD wAddr_, WORD wVal_)
 
 inline int GetSectionPage (eSection nSection_)
 {
-    return anSectionPages[nSection_];
+    return asSections[nSection_].nPage;
+}
+
+// Work out which display page, if any, writes to a section could affect
+inline void UpdateSectionVideo (MEM_SECTION& rSection_)
+{
+    if (rSection_.nPage == vmpr_page1)
+        rSection_.bVideo = VIDEO_PAGE1;
+    else if (rSection_.nPage == vmpr_page2 && vmpr_mode > MODE_2)
+        rSection_.bVideo = VIDEO_PAGE2;
+    else
+        rSection_.bVideo = VIDEO_NONE;
 }
 
 // Page in real memory page at <nSection_>, where <nSection_> is in range 0..3
 inline void PageIn (eSection nSection_, int nPage_)
 {
+    MEM_SECTION& rSection = asSections[nSection_];
+
     // Remember the page that's now occupying the section
-    anSectionPages[nSection_] = nPage_;
-    afContendedPages[nSection_] = (nPage_ < N_PAGES_MAIN);
+    rSection.nPage = nPage_;
+    rSection.fContended = (nPage_ < N_PAGES_MAIN);
+    UpdateSectionVideo(rSection);
 
     // Look up the relevant read and write pointers for the section
-    apbSectionReadPtrs[nSection_] = apbPageReadPtrs[nPage_];
-    apbSectionWritePtrs[nSection_] = apbPageWritePtrs[nPage_];
+    rSection.pbRead = apbPageReadPtrs[nPage_];
+    rSection.pbWrite = apbPageWritePtrs[nPage_];
 
     // Check for write protected RAM in section A
     if ((nSection_ == SECTION_A) && (lmpr & LMPR_WPROT))
-        apbSectionWritePtrs[nSection_] = apbPageWritePtrs[SCRATCH_WRITE];
+        rSection.pbWrite = apbPageWritePtrs[SCRATCH_WRITE];
 }
 
 
@@ -135,29 +287,29 @@ inline void write_to_screen_vmpr0 (WORD wAddr_)
     switch (vmpr_mode)
     {
         case MODE_1:
-            // If writing to the main screen data, invalidate the screen line we're writing to
+            // If writing to the main screen data, invalidate the block we're writing to
             if (wAddr_ < 6144)
-                Frame::TouchLine(g_abMode1ByteToLine[wAddr_ >> 5] + TOP_BORDER_LINES);
+                Frame::TouchLine(g_abMode1ByteToLine[wAddr_ >> 5] + TOP_BORDER_LINES, (wAddr_ & 0x1f) + BORDER_BLOCKS);
 
-            // If writing to the attribute area, invalidate the 8 lines containing the attribute
+            // If writing to the attribute area, invalidate the block on the 8 lines containing the attribute
             else if (wAddr_ < 6912)
             {
                 int nLine = (((wAddr_-6144) & 0xffe0) >> 2) + TOP_BORDER_LINES;
-                Frame::TouchLines(nLine, nLine + 7);
+                Frame::TouchLines(nLine, nLine + 7, (wAddr_ & 0x1f) + BORDER_BLOCKS);
             }
 
             break;
 
         case MODE_2:
-            // If the write falls within the screen data or attributes, invalidate the line
+            // If the write falls within the screen data or attributes, invalidate the block
             if (wAddr_ < 6144 || (wAddr_ >= 8192 && wAddr_ < (8192+6144)))
-                Frame::TouchLine(((wAddr_ & 0x1fff) >> 5) + TOP_BORDER_LINES);
+                Frame::TouchLine(((wAddr_ & 0x1fff) >> 5) + TOP_BORDER_LINES, (wAddr_ & 0x1f) + BORDER_BLOCKS);
             break;
 
         // Modes 3 and 4
         default:
-            // The write is to the first 16K of a mode 3 or 4 screen
-            Frame::TouchLine((wAddr_ >> 7) + TOP_BORDER_LINES);
+            // The write is to the first 16K of a mode 3 or 4 screen, with 4 bytes to each block
+            Frame::TouchLine((wAddr_ >> 7) + TOP_BORDER_LINES, ((wAddr_ & 0x7f) >> 2) + BORDER_BLOCKS);
             break;
     }
 }
@@ -168,7 +320,7 @@ inline void write_to_screen_vmpr1 (WORD wAddr_)
     wAddr_ &= (MEM_PAGE_SIZE-1);
 
     if (wAddr_ < 8192)
-        Frame::TouchLine(((wAddr_ + MEM_PAGE_SIZE) >> 7) + TOP_BORDER_LINES);
+        Frame::TouchLine(((wAddr_ + MEM_PAGE_SIZE) >> 7) + TOP_BORDER_LINES, ((wAddr_ & 0x7f) >> 2) + BORDER_BLOCKS);
 }
 
 
@@ -28,6 +28,7 @@
 
 #include "CPU.h"
 #include "Options.h"
+#include "Record.h"
 #include "Util.h"
 
 
@@ -44,14 +45,17 @@ typedef struct
 MOUSEBUFFER;
 
 
-static MOUSEBUFFER sMouse;
-static UINT uBuffer;            // Read position in mouse data
+static MACHINE_LOCAL MOUSEBUFFER sMouse;
+static MACHINE_LOCAL UINT uBuffer;            // Read position in mouse data
 
-static DWORD dwReadTime;        // Global cycle time of last mouse read
+static MACHINE_LOCAL DWORD dwReadTime;        // Global cycle time of last mouse read
 
-static int nDeltaX, nDeltaY;    // System change in X and Y since last read
-static int nReadX, nReadY;      // Read change in X and Y
-static BYTE bButtons;           // Current button states
+static MACHINE_LOCAL int nDeltaX, nDeltaY;    // System change in X and Y since last read
+static MACHINE_LOCAL int nReadX, nReadY;      // Read change in X and Y
+static MACHINE_LOCAL BYTE bButtons;           // Current button states
+
+static MACHINE_LOCAL int nHostX, nHostY;      // Host movement not yet passed to the SAM
+static MACHINE_LOCAL BYTE bHostButtons;       // Host button states, passed on with the movement
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -60,6 +64,7 @@ void Mouse::Init (bool fFirstInit_/*=false*/)
     // Clear cached mouse data
     nDeltaX = nDeltaY = 0;
     bButtons = 0;
+    Purge();
 
     sMouse.bStrobe = sMouse.bDummy = 0xff;
     uBuffer = 0;
@@ -120,8 +125,8 @@ BYTE Mouse::Read (DWORD dwTime_)
 // Move the mouse
 void Mouse::Move (int nDeltaX_, int nDeltaY_)
 {
-    nDeltaX += nDeltaX_;
-    nDeltaY += nDeltaY_;
+    nHostX += nDeltaX_;
+    nHostY += nDeltaY_;
 }
 
 // Press or release a mouse button
@@ -136,7 +141,26 @@ void Mouse::SetButton (int nButton_, bool fPressed_/*=true*/)
 
     // Reset or set the bit depending on whether the button is being pressed or released
     if (fPressed_)
-        bButtons |= bBit;
+        bHostButtons |= bBit;
     else
-        bButtons &= ~bBit;
+        bHostButtons &= ~bBit;
+}
+
+// Discard host movement, and release the buttons
+void Mouse::Purge ()
+{
+    nHostX = nHostY = 0;
+    bHostButtons = 0;
+}
+
+// Pass the host input to the SAM, once a frame, so an input recording can log or replace it at a fixed point
+void Mouse::Update ()
+{
+    Record::UpdateMouse(nHostX, nHostY, bHostButtons);
+
+    nDeltaX += nHostX;
+    nDeltaY += nHostY;
+    bButtons = bHostButtons;
+
+    nHostX = nHostY = 0;
 }
@@ -31,6 +31,8 @@ class Mouse
         static BYTE Read (DWORD dwTime_);
         static void Move (int nDeltaX_, int nDeltaY_);
         static void SetButton (int nButton_, bool fPressed_=true);
+        static void Purge ();
+        static void Update ();
 };
 
 #endif
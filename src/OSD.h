@@ -26,6 +26,8 @@
 #include <sys/types.h>      // for _off_t definition
 #include <fcntl.h>
 
+#ifndef USE_HEADLESS
+
 #include <pspkernel.h>
 #include <pspdebug.h>
 #include <pspsdk.h>
@@ -39,6 +41,20 @@
 #endif
 #define SDL
 
+#else
+
+// The headless host build has no SDL, so supply the few types the shared headers refer to
+typedef unsigned char       Uint8;
+typedef unsigned short      Uint16;
+typedef unsigned int        Uint32;
+
+typedef struct { short x, y; unsigned short w, h; } SDL_Rect;
+typedef union SDL_Event SDL_Event;
+
+#include <sys/ioctl.h>
+
+#endif  // USE_HEADLESS
+
 #ifndef SDL_DISABLE
 #define SDL_DISABLE  0
 #define SDL_ENABLE   1
@@ -22,11 +22,15 @@
 //  Options specified on the command-line override options in the file.
 //  The settings are only and written back when it's closed.
 
+#ifndef USE_HEADLESS
 #include <psptypes.h>
 #include <psppower.h>
+#endif
 #include "SimCoupe.h"
 #include "Options.h"
 
+#include <stddef.h>
+
 #include "simcoupec.h"
 #include "IO.h"
 #include "OSD.h"
@@ -42,7 +46,7 @@ typedef struct
     const char* pcszName;                                       // Option name used in config file
     int nType;                                                  // Option type
 
-    union { void* pv;  char* ppsz;  bool* pf;  int* pn; };      // Address of config variable
+    size_t uOffset;                                             // Offset of config variable in OPTIONS
 
     const char* pcszDefault;                                    // Default value of option, with only appropriate type used
     int nDefault;
@@ -53,11 +57,11 @@ typedef struct
 OPTION;
 
 // Helper macros for structure definition below
-#define OPT_S(o,v,s)        { o, OT_STRING, {&Options::s_Options.v}, (s), 0,  false }
-#define OPT_N(o,v,n)        { o, OT_INT,    {&Options::s_Options.v}, "", (n), false }
-#define OPT_F(o,v,f)        { o, OT_BOOL,   {&Options::s_Options.v}, "",  0,  (f) }
+#define OPT_S(o,v,s)        { o, OT_STRING, offsetof(OPTIONS,v), (s), 0,  false }
+#define OPT_N(o,v,n)        { o, OT_INT,    offsetof(OPTIONS,v), "", (n), false }
+#define OPT_F(o,v,f)        { o, OT_BOOL,   offsetof(OPTIONS,v), "",  0,  (f) }
 
-OPTIONS Options::s_Options;
+MACHINE_LOCAL OPTIONS Options::s_Options;
 
 OPTION aOptions[] = 
 {
@@ -66,6 +70,8 @@ OPTION aOptions[] =
 
     OPT_N("Sync",         sync,           1),         // Sync to 50Hz
     OPT_N("FrameSkip",    frameskip,      0),         // Auto frame-skipping
+    OPT_N("WarpSkip",     warpskip,       10),        // Draw one frame in 10 while warping
+    OPT_F("WarpDisk",     warpdisk,       true),      // Warp during disk activity
     OPT_N("Scale",        scale,          2),         // Windowed display is 2x2
     OPT_F("Ratio5_4",     ratio5_4,       false),     // Don't use 5:4 screen ratio
     OPT_F("Scanlines",    scanlines,      true),      // TV scanlines
@@ -79,11 +85,15 @@ OPTION aOptions[] =
     OPT_F("HWAccel",      hwaccel,        true),      // Use hardware accelerated video
     OPT_F("Greyscale",    greyscale,      false),     // Colour display
     OPT_F("Filter",       filter,         false),     // Filter the OpenGL image when stretching
+    OPT_F("DirectColour", directcolour,   false),     // Draw palette colours, converted for the display afterwards
 
     OPT_S("ROM",          rom,            ""),        // No custom ROM (use built-in)
     OPT_F("HDBootRom",    hdbootrom,      false),     // Don't use HDBOOT ROM patches
     OPT_F("FastReset",    fastreset,      true),      // Allow fast Z80 resets
     OPT_F("AsicDelay",    asicdelay,      false),     // No ASIC startup delay of ~50ms
+    OPT_N("RomTraps",     romtraps,       1),         // Run busy ROM routines natively
+    OPT_S("NoTraps",      notraps,        ""),        // Use every ROM trap that matches the ROM
+    OPT_N("RewindSize",   rewindsize,     1024),      // 1MB rewind buffer
     OPT_N("MainMemory",   mainmem,        512),       // 512K main memory
     OPT_N("ExternalMem",  externalmem,    0),         // No external memory
 
@@ -159,7 +169,7 @@ OPTION aOptions[] =
     OPT_F("PauseInactive",pauseinactive,  false),     // Continue to run when inactive
 
     OPT_S("FnKeys",       fnkeys,
-     "F1=1,SF1=2,AF1=0,CF1=3,F2=5,SF2=6,AF2=4,CF2=7,F3=30,F4=11,SF4=12,AF4=8,F5=25,SF5=23,F6=26,F7=21,F8=22,F9=14,SF9=13,F10=9,SF10=10,F11=16,F12=15,CF12=8"),
+     "F1=1,SF1=2,AF1=0,CF1=3,F2=5,SF2=6,AF2=4,CF2=7,F3=30,F4=11,SF4=12,AF4=8,F5=25,SF5=23,F6=26,F7=21,F8=22,F9=14,SF9=13,F10=9,SF10=10,F11=16,F12=15,CF12=8,SF3=35"),
 
     { NULL, 0 }
 };
@@ -191,11 +201,14 @@ void Options::SetDefaults (bool fForce_/*=true*/)
         // Set the default if forcing defaults, or if we've not already 
         if (fForce_ || !p->fSpecified)
         {
+            // The options are per-machine, so they're found relative to the current set
+            void* pv = reinterpret_cast<BYTE*>(&s_Options) + p->uOffset;
+
             switch (p->nType)
             {
-                case OT_BOOL:       *p->pf = p->fDefault;   break;
-                case OT_INT:        *p->pn = p->nDefault;   break;
-                case OT_STRING:     strcpy(p->ppsz, p->pcszDefault);   break;
+                case OT_BOOL:       *static_cast<bool*>(pv) = p->fDefault;   break;
+                case OT_INT:        *static_cast<int*>(pv) = p->nDefault;    break;
+                case OT_STRING:     strcpy(static_cast<char*>(pv), p->pcszDefault);   break;
             }
         }
     }
@@ -217,6 +230,7 @@ void Options::SetDefaults (bool fForce_/*=true*/)
     Options::s_Options.frameskip = 0;
     getcwd(Options::s_Options.home_dir, MAX_PATH);
 
+#ifndef USE_HEADLESS
     sim_update_save_name("");
 
     sim_load_settings();
@@ -224,6 +238,7 @@ void Options::SetDefaults (bool fForce_/*=true*/)
     scePowerSetClockFrequency(Options::s_Options.psp_cpu_clock, 
                               Options::s_Options.psp_cpu_clock, 
                               Options::s_Options.psp_cpu_clock/2);
+#endif
 # if 0
     save_used[SIM_MAX_SAVE_STATE];
 # endif
@@ -254,6 +269,17 @@ bool Options::Load (int argc_, char* argv_[])
     bool fIncompatible = GetOption(cfgversion) != CFG_VERSION;
     SetDefaults(fIncompatible);
 
+    // Check the command-line for a state to resume, and input to record or replay
+    for (int i = 1 ; i < argc_-1 ; i++)
+    {
+        if (!strcmp(argv_[i], "--state"))
+            SetOption(state, argv_[++i]);
+        else if (!strcmp(argv_[i], "--record"))
+            SetOption(record, argv_[++i]);
+        else if (!strcmp(argv_[i], "--replay"))
+            SetOption(replay, argv_[++i]);
+    }
+
     return true;
 }
 
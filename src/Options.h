@@ -30,6 +30,8 @@ typedef struct
 
     int     sync;                   // Syncronise the emulator to 50Hz
     int     frameskip;              // 0 for auto, otherwise 'mod frameskip' used to decide which to draw
+    int     warpskip;               // Draw one frame in this many while warping
+    bool    warpdisk;               // Warp automatically during disk activity (sensitivity from turboload)
     int     scale;                  // Window scaling mode
     bool    ratio5_4;               // Use 5:4 screen ratio?
     bool    scanlines;              // Show scanlines?
@@ -43,11 +45,15 @@ typedef struct
     bool    hwaccel;                // Non-zero to use hardware accelerated video
     bool    greyscale;              // Non-zero to use greyscale instead of colour
     bool    filter;                 // Non-zero to filter the OpenGL image when stretching
+    bool    directcolour;           // Draw the frame straight into host pixels, without the palette conversion
 
     char    rom[MAX_PATH];          // SAM ROM image path
     bool    hdbootrom;              // Use HDBOOT ROM patches
     bool    fastreset;              // Fast SAM system reset?
     bool    asicdelay;              // ASIC startup delay of ~49ms
+    int     romtraps;               // Native versions of busy ROM routines (0=off, 1=on, 2=on and checked against the ROM code)
+    char    notraps[128];           // Names of ROM traps not to use, separated by commas
+    int     rewindsize;             // Rewind buffer size in K (0=none)
     int     mainmem;                // 256 or 512 for amount of main memory
     int     externalmem;            // Number of MB of external memory
 
@@ -126,6 +132,10 @@ typedef struct
 
     char    fnkeys[256];            // Function key bindings
 
+    char    state[MAX_PATH];        // Machine state to resume at startup (command-line only, never saved)
+    char    record[MAX_PATH];       // Input recording to write (command-line only, never saved)
+    char    replay[MAX_PATH];       // Input recording to replay (command-line only, never saved)
+
     //LUDO:
     int     snd_enable;
     int     render_mode;
@@ -153,7 +163,7 @@ class Options
         static bool Load (int argc_, char* argv[]);
         static bool Save ();
 
-        static OPTIONS s_Options;
+        static MACHINE_LOCAL OPTIONS s_Options;
 };
 
 
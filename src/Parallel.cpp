@@ -98,7 +98,7 @@ void CPrintBuffer::FrameEnd ()
 
 bool CPrinterFile::Open ()
 {
-    static int nNext = 0;
+    static MACHINE_LOCAL int nNext = 0;
     char szTemplate[MAX_PATH], szOutput[MAX_PATH];
 
     sprintf(szTemplate, "%sprnt%%04d.txt", OSD::GetDirPath(GetOption(datapath)));
@@ -0,0 +1,345 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Record.cpp: Input recording and replay
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  A recording logs each change to the keyboard matrix and mouse as the SAM
+//  sees them, against the number of frames since the start and the global
+//  cycle counter.  The matrix only changes at the input update part way
+//  through each frame, and the mouse only at the end of a frame, so feeding
+//  them back at the same points gives exactly the same emulation.  That needs
+//  the same starting state, options, ROM and disks, so recordings are best
+//  made from a saved state.  Live input is ignored during a replay.
+//
+//  Stopping a recording adds checksums of RAM and the last complete frame,
+//  which the replay checks when it reaches the same point.  Every frame is
+//  drawn while recording or replaying, so the frame output doesn't depend on
+//  frame-skipping.  Events are written in the host layout and byte order.
+
+#include "SimCoupe.h"
+#include "Record.h"
+
+#include "CPU.h"
+#include "Frame.h"
+#include "IO.h"
+#include "Memory.h"
+
+const char RECORD_MAGIC[8] = { 'S','i','m','I','n','p','u','t' };
+const DWORD RECORD_VERSION = 1;
+
+enum { EVENT_KEYS=1, EVENT_MOUSE, EVENT_END };
+
+typedef struct
+{
+    char    acMagic[8];
+    DWORD   dwVersion;
+}
+RECORD_HEADER;
+
+typedef struct
+{
+    DWORD   dwFrame;        // Frames completed since the start
+    DWORD   dwCycle;        // Global cycle counter at the change
+    BYTE    bType;          // EVENT_xxx
+
+    union
+    {
+        BYTE    abKeys[9];  // Keyboard matrix, as in keyports
+
+        struct
+        {
+            int     nDeltaX, nDeltaY;
+            BYTE    bButtons;
+        }
+        sMouse;
+
+        struct
+        {
+            DWORD   dwRAM, dwScreen;
+        }
+        sEnd;
+    };
+}
+RECORD_EVENT;
+
+static MACHINE_LOCAL FILE* hFile;                 // Recording being written
+static MACHINE_LOCAL bool fFailed;
+
+static MACHINE_LOCAL RECORD_EVENT* pasEvents;     // Replay being played
+static MACHINE_LOCAL UINT uEvents, uNext;
+static MACHINE_LOCAL bool fMismatch;
+
+static MACHINE_LOCAL DWORD dwFrame;
+static MACHINE_LOCAL BYTE abKeys[9];              // Last keyboard matrix and buttons recorded or replayed
+static MACHINE_LOCAL BYTE bButtons;
+
+
+// Checksum the RAM that's present
+static DWORD ChecksumRAM ()
+{
+    DWORD dwSum = 0;
+
+    for (int nPage = 0 ; nPage < ROM0 ; nPage++)
+    {
+        if (apbPageReadPtrs[nPage] == apbPageReadPtrs[SCRATCH_READ])
+            continue;
+
+        const BYTE* pcb = apbPageReadPtrs[nPage];
+        for (UINT u = 0 ; u < MEM_PAGE_SIZE ; u++)
+            dwSum = dwSum * 31 + pcb[u];
+    }
+
+    return dwSum;
+}
+
+
+static void WriteEvent (RECORD_EVENT* pEvent_, BYTE bType_)
+{
+    pEvent_->dwFrame = dwFrame;
+    pEvent_->dwCycle = g_dwCycleCounter;
+    pEvent_->bType = bType_;
+
+    if (fwrite(pEvent_, sizeof *pEvent_, 1, hFile) != 1)
+        fFailed = true;
+}
+
+// Fetch the next replay event, if it's of the given type and due now
+static const RECORD_EVENT* NextEvent (BYTE bType_)
+{
+    if (!pasEvents || uNext == uEvents)
+        return NULL;
+
+    const RECORD_EVENT* pEvent = &pasEvents[uNext];
+    if (pEvent->dwFrame != dwFrame || pEvent->bType != bType_)
+        return NULL;
+
+    // An event at a different time means the emulation has already gone its own way
+    if (pEvent->dwCycle != g_dwCycleCounter)
+    {
+        Message(msgWarning, "Replay out of step at frame %lu", static_cast<unsigned long>(dwFrame));
+        fMismatch = true;
+
+        delete[] pasEvents;
+        pasEvents = NULL;
+        return NULL;
+    }
+
+    uNext++;
+    return pEvent;
+}
+
+
+bool Record::Start (const char* pcszFile_)
+{
+    Stop();
+
+    if (!(hFile = fopen(pcszFile_, "wb")))
+    {
+        Message(msgError, "Failed to open %s for writing", pcszFile_);
+        return false;
+    }
+
+    RECORD_HEADER sHeader;
+    memcpy(sHeader.acMagic, RECORD_MAGIC, sizeof sHeader.acMagic);
+    sHeader.dwVersion = RECORD_VERSION;
+    fFailed = fwrite(&sHeader, sizeof sHeader, 1, hFile) != 1;
+
+    // The starting matrix and buttons are logged as the first changes
+    dwFrame = 0;
+    memset(abKeys, 0, sizeof abKeys);
+    bButtons = 0xff;
+
+    return true;
+}
+
+bool Record::Play (const char* pcszFile_)
+{
+    Stop();
+
+    FILE* hReplay = fopen(pcszFile_, "rb");
+    if (!hReplay)
+    {
+        Message(msgError, "Failed to open %s", pcszFile_);
+        return false;
+    }
+
+    RECORD_HEADER sHeader;
+    bool fOK = fread(&sHeader, sizeof sHeader, 1, hReplay) == 1 &&
+               !memcmp(sHeader.acMagic, RECORD_MAGIC, sizeof sHeader.acMagic) && sHeader.dwVersion == RECORD_VERSION;
+
+    // Read all the events up front, so the replay doesn't touch the file
+    long lStart = ftell(hReplay);
+    fOK = fOK && !fseek(hReplay, 0, SEEK_END);
+    UINT uLen = fOK ? static_cast<UINT>(ftell(hReplay) - lStart) : 0;
+
+    if (fOK && (uEvents = uLen / sizeof(RECORD_EVENT)) && (pasEvents = new RECORD_EVENT[uEvents]))
+    {
+        fseek(hReplay, lStart, SEEK_SET);
+        fOK = fread(pasEvents, sizeof(RECORD_EVENT), uEvents, hReplay) == uEvents && pasEvents[uEvents-1].bType == EVENT_END;
+    }
+    else
+        fOK = false;
+
+    fclose(hReplay);
+
+    if (!fOK)
+    {
+        Message(msgError, "%s is not a complete SimCoupe input recording", pcszFile_);
+        delete[] pasEvents;
+        pasEvents = NULL;
+        return false;
+    }
+
+    // Start from the same state as the recording
+    dwFrame = 0;
+    uNext = 0;
+    memset(abKeys, 0, sizeof abKeys);
+    bButtons = 0xff;
+
+    return true;
+}
+
+// Finish recording, or abandon a replay, returning false if anything went wrong or didn't match
+bool Record::Stop ()
+{
+    bool fOK = !fMismatch;
+    fMismatch = false;
+
+    if (hFile)
+    {
+        // Finish with the checksums of the current state, for the replay to check
+        RECORD_EVENT sEvent;
+        memset(&sEvent, 0, sizeof sEvent);
+        sEvent.sEnd.dwRAM = ChecksumRAM();
+        sEvent.sEnd.dwScreen = Frame::GetChecksum();
+        WriteEvent(&sEvent, EVENT_END);
+
+        fFailed |= !!fclose(hFile);
+        hFile = NULL;
+
+        if (fFailed)
+        {
+            Message(msgError, "Failed to write input recording");
+            fOK = false;
+        }
+    }
+    else if (pasEvents)
+    {
+        Message(msgWarning, "Replay stopped at frame %lu of %lu", static_cast<unsigned long>(dwFrame), static_cast<unsigned long>(GetFrames()));
+
+        delete[] pasEvents;
+        pasEvents = NULL;
+        fOK = false;
+    }
+
+    return fOK;
+}
+
+
+bool Record::IsActive ()
+{
+    return hFile || pasEvents;
+}
+
+// Length of the current replay, in frames
+DWORD Record::GetFrames ()
+{
+    return pasEvents ? pasEvents[uEvents-1].dwFrame : 0;
+}
+
+
+// Called from the mid-frame input update, with the matrix about to be used
+void Record::UpdateKeyboard (BYTE* pbKeys_)
+{
+    if (hFile)
+    {
+        if (memcmp(pbKeys_, abKeys, sizeof abKeys))
+        {
+            RECORD_EVENT sEvent;
+            memset(&sEvent, 0, sizeof sEvent);
+            memcpy(abKeys, pbKeys_, sizeof abKeys);
+            memcpy(sEvent.abKeys, abKeys, sizeof abKeys);
+            WriteEvent(&sEvent, EVENT_KEYS);
+        }
+    }
+    else if (pasEvents)
+    {
+        if (const RECORD_EVENT* pEvent = NextEvent(EVENT_KEYS))
+            memcpy(abKeys, pEvent->abKeys, sizeof abKeys);
+
+        memcpy(pbKeys_, abKeys, sizeof abKeys);
+    }
+}
+
+// Called at the end of each frame, with the host mouse input about to be passed on
+void Record::UpdateMouse (int& rnDeltaX_, int& rnDeltaY_, BYTE& rbButtons_)
+{
+    if (hFile)
+    {
+        if (rnDeltaX_ || rnDeltaY_ || rbButtons_ != bButtons)
+        {
+            RECORD_EVENT sEvent;
+            memset(&sEvent, 0, sizeof sEvent);
+            sEvent.sMouse.nDeltaX = rnDeltaX_;
+            sEvent.sMouse.nDeltaY = rnDeltaY_;
+            sEvent.sMouse.bButtons = bButtons = rbButtons_;
+            WriteEvent(&sEvent, EVENT_MOUSE);
+        }
+    }
+    else if (pasEvents)
+    {
+        rnDeltaX_ = rnDeltaY_ = 0;
+
+        if (const RECORD_EVENT* pEvent = NextEvent(EVENT_MOUSE))
+        {
+            rnDeltaX_ = pEvent->sMouse.nDeltaX;
+            rnDeltaY_ = pEvent->sMouse.nDeltaY;
+            bButtons = pEvent->sMouse.bButtons;
+        }
+
+        rbButtons_ = bButtons;
+    }
+}
+
+// Called at the end of each frame, once it's complete
+void Record::FrameEnd ()
+{
+    if (!IsActive())
+        return;
+
+    dwFrame++;
+
+    // Check the end of a replay against the recording
+    if (const RECORD_EVENT* pEvent = NextEvent(EVENT_END))
+    {
+        DWORD dwRAM = ChecksumRAM(), dwScreen = Frame::GetChecksum();
+        fMismatch = dwRAM != pEvent->sEnd.dwRAM || dwScreen != pEvent->sEnd.dwScreen;
+
+        if (fMismatch)
+            Message(msgWarning, "Replay finished, but RAM %08lx and frame %08lx don't match the recording (%08lx and %08lx)",
+                static_cast<unsigned long>(dwRAM), static_cast<unsigned long>(dwScreen),
+                static_cast<unsigned long>(pEvent->sEnd.dwRAM), static_cast<unsigned long>(pEvent->sEnd.dwScreen));
+        else
+            Message(msgInfo, "Replay finished after %lu frames, with matching RAM %08lx and frame %08lx",
+                static_cast<unsigned long>(dwFrame), static_cast<unsigned long>(dwRAM), static_cast<unsigned long>(dwScreen));
+
+        delete[] pasEvents;
+        pasEvents = NULL;
+    }
+}
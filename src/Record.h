@@ -0,0 +1,39 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Record.h: Input recording and replay
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+#ifndef RECORD_H
+#define RECORD_H
+
+class Record
+{
+    public:
+        static bool Start (const char* pcszFile_);
+        static bool Play (const char* pcszFile_);
+        static bool Stop ();
+
+        static bool IsActive ();
+        static DWORD GetFrames ();
+
+        static void UpdateKeyboard (BYTE* pbKeys_);
+        static void UpdateMouse (int& rnDeltaX_, int& rnDeltaY_, BYTE& rbButtons_);
+        static void FrameEnd ();
+};
+
+#endif
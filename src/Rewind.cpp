@@ -0,0 +1,399 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Rewind.cpp: Rewind buffer of recent frames
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  Each frame adds a record to a ring buffer, holding the CPU, ASIC and SAA
+//  state at the start of the frame, followed by each 1K memory block written
+//  during it, as it was at the start.  The first write to a block in a frame
+//  copies it aside, so the memory used depends on how much is written, rather
+//  than on how much RAM is fitted.  At the end of the frame the copies are
+//  stored as runs of bytes that differ from the current contents.
+//
+//  Stepping back undoes the records newest first, each restoring the blocks
+//  its frame wrote, then loads the state saved with the last one undone.  The
+//  oldest records are dropped to make room for new ones.  Disk devices and
+//  their images aren't included, so rewinding over disk activity may upset
+//  whatever was using the disk.
+
+#include "SimCoupe.h"
+#include "Rewind.h"
+
+#include "CPU.h"
+#include "Display.h"
+#include "Frame.h"
+#include "Memory.h"
+#include "Options.h"
+#include "State.h"
+
+const int MAX_REWIND_FRAMES = 60 * EMULATED_FRAMES_PER_SECOND;    // Up to a minute of frames
+
+const UINT BLOCK_SIZE = 1U << MEM_BLOCK_SHIFT;
+const UINT MAX_FRAME_STATE = 4096;                      // Space for the state at the start of a frame
+const UINT MAX_BLOCK_DATA = 3 + BLOCK_SIZE*3/2;         // Page and block number, then worst-case runs
+
+typedef struct
+{
+    UINT    uOffset;        // Position of the record in the ring buffer
+    UINT    uLen;
+}
+REWIND_FRAME;
+
+typedef struct
+{
+    int     nPage;
+    UINT    uBlock;
+}
+SAVED_BLOCK;
+
+MACHINE_LOCAL WORD awWrittenBlocks[TOTAL_PAGES];
+
+static MACHINE_LOCAL BYTE* pbRing;                        // Frame records, oldest first from asFrames[nFirstFrame]
+static MACHINE_LOCAL UINT uRingSize;
+static MACHINE_LOCAL REWIND_FRAME asFrames[MAX_REWIND_FRAMES];
+static MACHINE_LOCAL int nFirstFrame, nFrames;
+
+static MACHINE_LOCAL BYTE* pbRecord;                      // Record for the frame in progress, starting with its state
+static MACHINE_LOCAL UINT uRecordSize, uStateLen;         // No record is being built if there's no state
+
+static MACHINE_LOCAL SAVED_BLOCK* psSaved;                // Blocks written this frame, with their previous contents
+static MACHINE_LOCAL BYTE* pbSaved;
+static MACHINE_LOCAL UINT uSaved, uSavedSize;
+
+
+bool Rewind::Init (bool fFirstInit_/*=false*/)
+{
+    UINT uSize = static_cast<UINT>(max(GetOption(rewindsize), 0)) << 10;
+
+    // Start afresh if the buffer size has changed
+    if (fFirstInit_ || uSize != uRingSize)
+    {
+        Exit();
+
+        if (uSize && (pbRing = new BYTE[uSize]))
+            uRingSize = uSize;
+
+        Clear();
+    }
+
+    return true;
+}
+
+void Rewind::Exit (bool fReInit_/*=false*/)
+{
+    if (!fReInit_)
+    {
+        delete[] pbRing;    pbRing = NULL;      uRingSize = 0;
+        delete[] pbRecord;  pbRecord = NULL;    uRecordSize = 0;
+        delete[] psSaved;   psSaved = NULL;
+        delete[] pbSaved;   pbSaved = NULL;     uSavedSize = 0;
+
+        Clear();
+    }
+}
+
+
+// Forget everything recorded, which is needed whenever memory is changed without the writes being tracked
+void Rewind::Clear ()
+{
+    nFirstFrame = nFrames = 0;
+    uStateLen = uSaved = 0;
+
+    // Track only the RAM that's present, and only if there's somewhere to keep it
+    for (int nPage = 0 ; nPage < TOTAL_PAGES ; nPage++)
+    {
+        bool fTrack = pbRing && nPage < ROM0 && apbPageReadPtrs[nPage] != apbPageReadPtrs[SCRATCH_READ];
+        awWrittenBlocks[nPage] = fTrack ? 0 : 0xffff;
+    }
+}
+
+
+// Called on the first write to a block in each frame, before the write is made
+void Rewind::SaveBlock (int nPage_, UINT uBlock_)
+{
+    awWrittenBlocks[nPage_] |= 1 << uBlock_;
+
+    if (!pbRing)
+        return;
+
+    // Make more room if more blocks have been written in this frame than any before
+    if (uSaved == uSavedSize)
+    {
+        UINT uNewSize = uSavedSize ? uSavedSize*2 : 64;
+        SAVED_BLOCK* ps = new SAVED_BLOCK[uNewSize];
+        BYTE* pb = new BYTE[uNewSize * BLOCK_SIZE];
+
+        if (!ps || !pb)
+        {
+            delete[] ps;
+            delete[] pb;
+            return;
+        }
+
+        if (uSaved)
+        {
+            memcpy(ps, psSaved, uSaved * sizeof *ps);
+            memcpy(pb, pbSaved, uSaved * BLOCK_SIZE);
+        }
+
+        delete[] psSaved;   psSaved = ps;
+        delete[] pbSaved;   pbSaved = pb;
+        uSavedSize = uNewSize;
+    }
+
+    psSaved[uSaved].nPage = nPage_;
+    psSaved[uSaved].uBlock = uBlock_;
+    memcpy(pbSaved + uSaved*BLOCK_SIZE, apbPageReadPtrs[nPage_] + (uBlock_ << MEM_BLOCK_SHIFT), BLOCK_SIZE);
+    uSaved++;
+}
+
+
+// Store the old contents of a block as runs of up to 128 bytes, either unchanged and skipped, or changed and kept
+static BYTE* EncodeBlock (BYTE* pb_, const BYTE* pcbOld_, const BYTE* pcbNew_)
+{
+    for (UINT u = 0, uRun ; u < BLOCK_SIZE ; u += uRun)
+    {
+        bool fSame = pcbOld_[u] == pcbNew_[u];
+        for (uRun = 1 ; uRun < 128 && u + uRun < BLOCK_SIZE && (pcbOld_[u+uRun] == pcbNew_[u+uRun]) == fSame ; uRun++);
+
+        *pb_++ = (fSame ? 0x80 : 0x00) | (uRun - 1);
+
+        if (!fSame)
+        {
+            memcpy(pb_, pcbOld_ + u, uRun);
+            pb_ += uRun;
+        }
+    }
+
+    return pb_;
+}
+
+static const BYTE* DecodeBlock (const BYTE* pcb_, BYTE* pbBlock_)
+{
+    for (UINT u = 0, uRun ; u < BLOCK_SIZE ; u += uRun)
+    {
+        BYTE b = *pcb_++;
+        uRun = (b & 0x7f) + 1;
+
+        if (!(b & 0x80))
+        {
+            memcpy(pbBlock_ + u, pcb_, uRun);
+            pcb_ += uRun;
+        }
+    }
+
+    return pcb_;
+}
+
+
+// Add a record to the ring, dropping the oldest ones it overlaps
+static void AddRecord (const BYTE* pcb_, UINT uLen_)
+{
+    // A record too big for the buffer leaves nothing to rewind to before it
+    if (uLen_ > uRingSize)
+    {
+        nFrames = 0;
+        return;
+    }
+
+    UINT uOffset = 0;
+    if (nFrames)
+    {
+        const REWIND_FRAME& rLast = asFrames[(nFirstFrame + nFrames - 1) % MAX_REWIND_FRAMES];
+        uOffset = rLast.uOffset + rLast.uLen;
+    }
+
+    // Records are kept in one piece, so wrap to the start if there's no room at the end, abandoning what's
+    // there, which is all older than anything at the start
+    UINT uTail = uRingSize;
+    if (uOffset + uLen_ > uRingSize)
+    {
+        uTail = uOffset;
+        uOffset = 0;
+    }
+
+    if (nFrames == MAX_REWIND_FRAMES)
+    {
+        nFirstFrame = (nFirstFrame + 1) % MAX_REWIND_FRAMES;
+        nFrames--;
+    }
+
+    // Records lie in order from the write position, so the oldest ones are dropped until one doesn't overlap
+    while (nFrames)
+    {
+        const REWIND_FRAME& r = asFrames[nFirstFrame];
+
+        if (r.uOffset < uTail && (r.uOffset >= uOffset + uLen_ || r.uOffset + r.uLen <= uOffset))
+            break;
+
+        nFirstFrame = (nFirstFrame + 1) % MAX_REWIND_FRAMES;
+        nFrames--;
+    }
+
+    REWIND_FRAME& rNew = asFrames[(nFirstFrame + nFrames++) % MAX_REWIND_FRAMES];
+    rNew.uOffset = uOffset;
+    rNew.uLen = uLen_;
+
+    memcpy(pbRing + uOffset, pcb_, uLen_);
+}
+
+// Make sure the record buffer can hold a given length, keeping what's in it
+static bool ReserveRecord (UINT uLen_)
+{
+    if (uLen_ <= uRecordSize)
+        return true;
+
+    BYTE* pb = new BYTE[uLen_];
+    if (!pb)
+        return false;
+
+    if (pbRecord)
+        memcpy(pb, pbRecord, uRecordSize);
+
+    delete[] pbRecord;
+    pbRecord = pb;
+    uRecordSize = uLen_;
+    return true;
+}
+
+// Start a record for the next frame with the current state
+static void StartRecord ()
+{
+    uStateLen = 0;
+
+    if (ReserveRecord(sizeof(DWORD) + MAX_FRAME_STATE))
+    {
+        DWORD dwStateLen = uStateLen = State::SaveFrame(pbRecord + sizeof(DWORD), MAX_FRAME_STATE);
+        memcpy(pbRecord, &dwStateLen, sizeof dwStateLen);
+    }
+}
+
+// Complete the record for the frame just run with the blocks it changed, and add it to the ring
+static void EndRecord ()
+{
+    bool fRecord = uStateLen && ReserveRecord(sizeof(DWORD) + uStateLen + uSaved * MAX_BLOCK_DATA);
+    BYTE* pb = pbRecord + sizeof(DWORD) + uStateLen;
+
+    for (UINT u = 0 ; u < uSaved ; u++)
+    {
+        const SAVED_BLOCK& r = psSaved[u];
+        const BYTE* pcbOld = pbSaved + u*BLOCK_SIZE;
+        const BYTE* pcbNew = apbPageReadPtrs[r.nPage] + (r.uBlock << MEM_BLOCK_SHIFT);
+
+        // Watch for writes to the block again in the next frame
+        awWrittenBlocks[r.nPage] &= ~(1 << r.uBlock);
+
+        // Skip blocks that were only written with what they held already
+        if (!fRecord || !memcmp(pcbOld, pcbNew, BLOCK_SIZE))
+            continue;
+
+        *pb++ = r.nPage & 0xff;
+        *pb++ = r.nPage >> 8;
+        *pb++ = r.uBlock;
+        pb = EncodeBlock(pb, pcbOld, pcbNew);
+    }
+
+    uSaved = 0;
+
+    // Without a complete record there's nothing before this frame to rewind to
+    if (fRecord)
+        AddRecord(pbRecord, pb - pbRecord);
+    else
+        nFrames = 0;
+
+    uStateLen = 0;
+}
+
+// Put back the memory a record's frame changed, leaving it as it was at the start of the frame
+static void UndoRecord (const REWIND_FRAME& rFrame_)
+{
+    const BYTE* pcb = pbRing + rFrame_.uOffset;
+    const BYTE* pcbEnd = pcb + rFrame_.uLen;
+
+    DWORD dwStateLen;
+    memcpy(&dwStateLen, pcb, sizeof dwStateLen);
+
+    for (pcb += sizeof(DWORD) + dwStateLen ; pcb < pcbEnd ; )
+    {
+        int nPage = pcb[0] | (pcb[1] << 8);
+        UINT uBlock = pcb[2];
+
+        pcb = DecodeBlock(pcb + 3, apbPageReadPtrs[nPage] + (uBlock << MEM_BLOCK_SHIFT));
+    }
+}
+
+
+// Called between frames, after the end of one frame and before the start of the next
+void Rewind::FrameEnd ()
+{
+    if (pbRing)
+    {
+        EndRecord();
+        StartRecord();
+    }
+}
+
+// Step back a number of frames, or as far as possible, returning how many frames were rewound
+int Rewind::Back (int nFrames_)
+{
+    if (!pbRing)
+        return 0;
+
+    // Anything written since the last frame ended is undone too, with the rest of the newest record
+    EndRecord();
+
+    if (!nFrames || nFrames_ <= 0)
+    {
+        StartRecord();
+        return 0;
+    }
+
+    // The newest record holds the current state, so the oldest is as far back as it's possible to go
+    int nTarget = max(nFrames - 1 - nFrames_, 0);
+    int nBack = nFrames - 1 - nTarget;
+
+    for (int n = nFrames - 1 ; n >= nTarget ; n--)
+        UndoRecord(asFrames[(nFirstFrame + n) % MAX_REWIND_FRAMES]);
+
+    const REWIND_FRAME& rTarget = asFrames[(nFirstFrame + nTarget) % MAX_REWIND_FRAMES];
+    const BYTE* pcb = pbRing + rTarget.uOffset;
+
+    DWORD dwStateLen;
+    memcpy(&dwStateLen, pcb, sizeof dwStateLen);
+
+    // The target frame starts again with a new record
+    bool fOK = State::LoadFrame(pcb + sizeof(DWORD), dwStateLen);
+    nFrames = nTarget;
+
+    // The machine could be anywhere between the two states now, so start it afresh
+    if (!fOK)
+    {
+        Clear();
+        CPU::Reset(true);
+        CPU::Reset(false);
+        return 0;
+    }
+
+    // Redraw everything in the restored display
+    Frame::SetDirty();
+    Display::SetDirty();
+
+    StartRecord();
+    return nBack;
+}
@@ -0,0 +1,37 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Rewind.h: Rewind buffer of recent frames
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+#ifndef REWIND_H
+#define REWIND_H
+
+class Rewind
+{
+    public:
+        static bool Init (bool fFirstInit_=false);
+        static void Exit (bool fReInit_=false);
+
+        static void Clear ();
+        static void FrameEnd ();
+        static int Back (int nFrames_);
+
+        static void SaveBlock (int nPage_, UINT uBlock_);
+};
+
+#endif
@@ -30,6 +30,7 @@
 
 #include "SDIDE.h"
 #include "Options.h"
+#include "State.h"
 
 
 CSDIDEDevice::CSDIDEDevice (CATADevice* pDisk_)
@@ -50,6 +51,26 @@ void CSDIDEDevice::Reset ()
         m_pDisk->Reset();
 }
 
+void CSDIDEDevice::SaveState () const
+{
+    State::Write(&m_bAddressLatch, sizeof m_bAddressLatch);
+    State::Write(&m_bDataLatch, sizeof m_bDataLatch);
+    State::Write(&m_fDataLatched, sizeof m_fDataLatched);
+
+    if (m_pDisk)
+        m_pDisk->SaveState();
+}
+
+bool CSDIDEDevice::LoadState ()
+{
+    if (!State::Read(&m_bAddressLatch, sizeof m_bAddressLatch) ||
+        !State::Read(&m_bDataLatch, sizeof m_bDataLatch) ||
+        !State::Read(&m_fDataLatched, sizeof m_fDataLatched))
+        return false;
+
+    return !m_pDisk || m_pDisk->LoadState();
+}
+
 BYTE CSDIDEDevice::In (WORD wPort_)
 {
     BYTE bRet = 0xff;
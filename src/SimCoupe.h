@@ -39,6 +39,14 @@
 #define _DEBUG
 #endif
 
+// Emulated machine state is declared MACHINE_LOCAL, giving each thread a machine of its own when
+// threads are available.  Otherwise there's just the one, with no cost for accessing it.
+#ifdef USE_THREADS
+#define MACHINE_LOCAL       __thread
+#else
+#define MACHINE_LOCAL
+#endif
+
 typedef unsigned int        UINT;
 
 #include "OSD.h"            // OS-dependant stuff
@@ -40,10 +40,12 @@
 #include "SAASound.h"
 
 #include "CPU.h"
+#include "Frame.h"
 #include "GUI.h"
 #include "IO.h"
 #include "Options.h"
 #include "Profile.h"
+#include "State.h"
 
 #define SOUND_FREQ      44100
 #define SOUND_BITS      16
@@ -54,7 +56,10 @@ CSoundStream* aStreams[SOUND_STREAMS];
 CSoundStream*& pSAA = aStreams[0];     // SAA 1099 
 CSoundStream*& pDAC = aStreams[1];     // DAC for parallel DACs and Spectrum-style beeper
 
-LPCSAASOUND pSAASound;      // SAASound.dll object - needs to exist as long as we do, to preseve subtle internal states
+MACHINE_LOCAL LPCSAASOUND pSAASound;      // SAASound.dll object - needs to exist as long as we do, to preseve subtle internal states
+
+// Copy of the SAA registers as last written, for save states, as the library has no way to read them back
+MACHINE_LOCAL BYTE abSAARegs[32], bSAAReg;
 
 ////////////////////////////////////////////////////////////////////////////////
 #define my_SDL_MixAudio(tgt, src, size, vol) memcpy(tgt, src, size)
@@ -221,15 +226,44 @@ void Sound::Exit (bool fReInit_/*=false*/)
 
 void Sound::Out (WORD wPort_, BYTE bVal_)
 {
+    if ((wPort_ & SOUND_MASK) == SOUND_ADDR)
+        bSAAReg = bVal_ & (sizeof abSAARegs - 1);
+    else
+        abSAARegs[bSAAReg] = bVal_;
+
     if (pSAA)
         reinterpret_cast<CSAA*>(pSAA)->Out(wPort_, bVal_);
 }
 
+void Sound::SaveState ()
+{
+    State::Write(abSAARegs, sizeof abSAARegs);
+    State::Write(&bSAAReg, sizeof bSAAReg);
+}
+
+// The chip is restored by writing the saved registers back, so only the tone and envelope positions are lost
+bool Sound::LoadState ()
+{
+    if (!State::Read(abSAARegs, sizeof abSAARegs) || !State::Read(&bSAAReg, sizeof bSAAReg))
+        return false;
+
+    if (pSAASound)
+    {
+        for (int n = 0 ; n < static_cast<int>(sizeof abSAARegs) ; n++)
+            pSAASound->WriteAddressData(n, abSAARegs[n]);
+
+        pSAASound->WriteAddress(bSAAReg);
+    }
+
+    return true;
+}
+
 void Sound::FrameUpdate ()
 {
     ProfileStart(Snd);
 
-    if (!g_fTurbo)
+    // No sound is generated while warping, as it couldn't be played fast enough
+    if (!Frame::IsWarping())
     {
         for (int i = 0 ; i < SOUND_STREAMS ; i++)
             if (aStreams[i]) aStreams[i]->Update(true);
@@ -34,6 +34,9 @@ class Sound
         static void Play ();
         static void Silence ();                        // Silence current output
 
+        static void SaveState ();                      // SAA chip registers
+        static bool LoadState ();
+
         static void OutputDACLeft (BYTE bVal_);        // Output to left channel
         static void OutputDACRight (BYTE bVal_);       // Output to right channel
         static void OutputDAC (BYTE bVal_);            // Output to both channels
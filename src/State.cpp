@@ -0,0 +1,329 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// State.cpp: Whole-machine save states
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  A state file is a short header followed by a series of chunks, each with
+//  a 4-character id and the length of its data.  Unknown chunks are skipped,
+//  as is anything left unread at the end of a known one, so new chunks and
+//  new trailing fields don't break existing files.  Any change to the meaning
+//  or layout of existing data needs STATE_VERSION incrementing.
+//
+//  Structures are written in the host layout and byte order, so a state is
+//  only expected to be loaded by the build that saved it.  RAM and ROM are
+//  written straight from the memory block, which is most of the file.
+//
+//  Disk images aren't included, only the paths of the floppy images, so the
+//  images shouldn't be changed between saving and loading.  States are saved
+//  and loaded between frames, never part way through one.
+//
+//  The rewind buffer uses the same CPU, ASIC and SAA data for its frames, in
+//  memory rather than a file, without the chunk headers or anything else.
+
+#include "SimCoupe.h"
+#include "State.h"
+
+#include <stddef.h>
+
+#include "CPU.h"
+#include "Display.h"
+#include "Frame.h"
+#include "IO.h"
+#include "Memory.h"
+#include "Sound.h"
+
+#define STATE_ID(a,b,c,d)   ((a) | ((b) << 8) | ((c) << 16) | ((d) << 24))
+
+const char STATE_MAGIC[8] = { 'S','i','m','C','o','u','p','e' };
+const DWORD STATE_VERSION = 1;
+
+// Chunks are written in this order, and must be loaded in it too
+const DWORD CHUNK_MEMORY = STATE_ID('M','E','M',' ');   // RAM and ROM pages
+const DWORD CHUNK_IO     = STATE_ID('A','S','I','C');   // ASIC ports, CLUT and keyboard matrix
+const DWORD CHUNK_SAA    = STATE_ID('S','A','A',' ');   // SAA 1099 registers
+const DWORD CHUNK_DRIVE1 = STATE_ID('D','R','V','1');   // Drive 1 device
+const DWORD CHUNK_DRIVE2 = STATE_ID('D','R','V','2');   // Drive 2 device (or Atom)
+const DWORD CHUNK_SDIDE  = STATE_ID('S','D','I','D');   // SD IDE interface
+const DWORD CHUNK_YATBUS = STATE_ID('Y','A','T','B');   // YAMOD.ATBUS interface
+const DWORD CHUNK_CPU    = STATE_ID('C','P','U',' ');   // Z80 registers, timings and events
+
+typedef struct
+{
+    char    acMagic[8];
+    DWORD   dwVersion;
+}
+STATE_HEADER;
+
+typedef struct
+{
+    DWORD   dwId;
+    DWORD   dwLen;      // Length of the chunk data following
+}
+STATE_CHUNK;
+
+static MACHINE_LOCAL FILE* hFile;
+static MACHINE_LOCAL bool fFailed;
+static MACHINE_LOCAL long lChunkStart;    // Offset of the chunk being written
+static MACHINE_LOCAL DWORD dwChunkLeft;   // Data remaining in the chunk being read
+
+static MACHINE_LOCAL BYTE* pbBuffer;      // Memory used instead of a file, for rewind frames
+static MACHINE_LOCAL size_t uBufferLeft;  // Space left in it when saving
+
+
+static void BeginChunk (DWORD dwId_)
+{
+    STATE_CHUNK sChunk = { dwId_, 0 };
+
+    lChunkStart = ftell(hFile);
+    State::Write(&sChunk, sizeof sChunk);
+}
+
+// Go back and fill in the chunk length, now we know it
+static void EndChunk ()
+{
+    long lEnd = ftell(hFile);
+    DWORD dwLen = lEnd - lChunkStart - sizeof(STATE_CHUNK);
+
+    fseek(hFile, lChunkStart + offsetof(STATE_CHUNK, dwLen), SEEK_SET);
+    State::Write(&dwLen, sizeof dwLen);
+    fseek(hFile, lEnd, SEEK_SET);
+}
+
+
+// Device chunks start with the device type, as only a matching device can use the rest
+static void SaveDevice (DWORD dwId_, CDiskDevice* pDevice_)
+{
+    if (!pDevice_)
+        return;
+
+    BYTE bType = pDevice_->GetType();
+
+    BeginChunk(dwId_);
+    State::Write(&bType, sizeof bType);
+    pDevice_->SaveState();
+    EndChunk();
+}
+
+static bool LoadDevice (CDiskDevice* pDevice_)
+{
+    BYTE bType;
+    if (!State::Read(&bType, sizeof bType))
+        return false;
+
+    // A different device is connected now, so there's nothing to restore
+    if (!pDevice_ || pDevice_->GetType() != bType)
+    {
+        TRACE("Skipping state for device type %d\n", bType);
+        return true;
+    }
+
+    return pDevice_->LoadState();
+}
+
+
+bool State::Save (const char* pcszFile_)
+{
+    if (!(hFile = fopen(pcszFile_, "wb")))
+    {
+        Message(msgError, "Failed to open %s for writing", pcszFile_);
+        return false;
+    }
+
+    fFailed = false;
+
+    STATE_HEADER sHeader;
+    memcpy(sHeader.acMagic, STATE_MAGIC, sizeof sHeader.acMagic);
+    sHeader.dwVersion = STATE_VERSION;
+    Write(&sHeader, sizeof sHeader);
+
+    BeginChunk(CHUNK_MEMORY);   Memory::SaveState();    EndChunk();
+    BeginChunk(CHUNK_IO);       IO::SaveState();        EndChunk();
+    BeginChunk(CHUNK_SAA);      Sound::SaveState();     EndChunk();
+
+    SaveDevice(CHUNK_DRIVE1, pDrive1);
+    SaveDevice(CHUNK_DRIVE2, pDrive2);
+    SaveDevice(CHUNK_SDIDE, pSDIDE);
+    SaveDevice(CHUNK_YATBUS, pYATBus);
+
+    // The CPU goes last, as its memory contention depends on the restored video mode and border
+    BeginChunk(CHUNK_CPU);      CPU::SaveState();       EndChunk();
+
+    fFailed |= !!fclose(hFile);
+    hFile = NULL;
+
+    // Don't leave a partial state behind
+    if (fFailed)
+    {
+        Message(msgError, "Failed to save state to %s", pcszFile_);
+        unlink(pcszFile_);
+        return false;
+    }
+
+    return true;
+}
+
+bool State::Load (const char* pcszFile_)
+{
+    if (!(hFile = fopen(pcszFile_, "rb")))
+    {
+        Message(msgError, "Failed to open %s", pcszFile_);
+        return false;
+    }
+
+    STATE_HEADER sHeader;
+    dwChunkLeft = sizeof sHeader;
+
+    // Check the file before anything is changed, so a bad file leaves the machine as it was
+    if (!Read(&sHeader, sizeof sHeader) || memcmp(sHeader.acMagic, STATE_MAGIC, sizeof sHeader.acMagic))
+    {
+        Message(msgError, "%s is not a SimCoupe state file", pcszFile_);
+        fclose(hFile);
+        return false;
+    }
+    else if (sHeader.dwVersion != STATE_VERSION)
+    {
+        Message(msgError, "%s is from an incompatible SimCoupe version", pcszFile_);
+        fclose(hFile);
+        return false;
+    }
+
+    bool fOK = true;
+    STATE_CHUNK sChunk;
+
+    while (fOK && fread(&sChunk, sizeof sChunk, 1, hFile) == 1)
+    {
+        dwChunkLeft = sChunk.dwLen;
+
+        switch (sChunk.dwId)
+        {
+            case CHUNK_MEMORY:  fOK = Memory::LoadState();          break;
+            case CHUNK_IO:      fOK = IO::LoadState();              break;
+            case CHUNK_SAA:     fOK = Sound::LoadState();           break;
+            case CHUNK_DRIVE1:  fOK = LoadDevice(pDrive1);          break;
+            case CHUNK_DRIVE2:  fOK = LoadDevice(pDrive2);          break;
+            case CHUNK_SDIDE:   fOK = LoadDevice(pSDIDE);           break;
+            case CHUNK_YATBUS:  fOK = LoadDevice(pYATBus);          break;
+            case CHUNK_CPU:     fOK = CPU::LoadState();             break;
+
+            default:
+                TRACE("Skipping unknown state chunk %#010lx\n", static_cast<unsigned long>(sChunk.dwId));
+                break;
+        }
+
+        // Skip whatever is left of the chunk
+        if (fOK && dwChunkLeft)
+            fOK = !fseek(hFile, dwChunkLeft, SEEK_CUR);
+    }
+
+    fclose(hFile);
+    hFile = NULL;
+
+    // The machine could be anywhere between the two states now, so start it afresh
+    if (!fOK)
+    {
+        Message(msgError, "Failed to load state from %s", pcszFile_);
+        CPU::Reset(true);
+        CPU::Reset(false);
+        return false;
+    }
+
+    // Redraw everything in the restored display
+    Frame::SetDirty();
+    Display::SetDirty();
+    return true;
+}
+
+
+// Save the frame state to memory, returning the length used, or zero if it didn't fit
+size_t State::SaveFrame (BYTE* pb_, size_t uSize_)
+{
+    pbBuffer = pb_;
+    uBufferLeft = uSize_;
+    fFailed = false;
+
+    IO::SaveState();
+    Sound::SaveState();
+    CPU::SaveState();
+
+    pbBuffer = NULL;
+    return fFailed ? 0 : uSize_ - uBufferLeft;
+}
+
+bool State::LoadFrame (const BYTE* pcb_, size_t uLen_)
+{
+    pbBuffer = const_cast<BYTE*>(pcb_);
+    dwChunkLeft = uLen_;
+
+    bool fOK = IO::LoadState() && Sound::LoadState() && CPU::LoadState();
+
+    pbBuffer = NULL;
+    return fOK;
+}
+
+
+void State::Write (const void* pcv_, size_t uLen_)
+{
+    if (pbBuffer)
+    {
+        if (uLen_ > uBufferLeft)
+            fFailed = true;
+        else
+        {
+            memcpy(pbBuffer, pcv_, uLen_);
+            pbBuffer += uLen_;
+            uBufferLeft -= uLen_;
+        }
+    }
+    else if (uLen_ && fwrite(pcv_, uLen_, 1, hFile) != 1)
+        fFailed = true;
+}
+
+// Read data from the current chunk, failing if it's not all there
+bool State::Read (void* pv_, size_t uLen_)
+{
+    if (uLen_ > dwChunkLeft)
+        return false;
+    else if (pbBuffer)
+    {
+        memcpy(pv_, pbBuffer, uLen_);
+        pbBuffer += uLen_;
+    }
+    else if (uLen_ && fread(pv_, uLen_, 1, hFile) != 1)
+        return false;
+
+    dwChunkLeft -= uLen_;
+    return true;
+}
+
+void State::WriteString (const char* pcsz_)
+{
+    WORD wLen = strlen(pcsz_);
+    Write(&wLen, sizeof wLen);
+    Write(pcsz_, wLen);
+}
+
+bool State::ReadString (char* psz_, size_t uSize_)
+{
+    WORD wLen;
+    if (!Read(&wLen, sizeof wLen) || wLen >= uSize_ || !Read(psz_, wLen))
+        return false;
+
+    psz_[wLen] = '\0';
+    return true;
+}
@@ -0,0 +1,42 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// State.h: Whole-machine save states
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+#ifndef STATE_H
+#define STATE_H
+
+class State
+{
+    public:
+        static bool Save (const char* pcszFile_);
+        static bool Load (const char* pcszFile_);
+
+        // CPU, ASIC and sound chip state only, for the rewind buffer
+        static size_t SaveFrame (BYTE* pb_, size_t uSize_);
+        static bool LoadFrame (const BYTE* pcb_, size_t uLen_);
+
+        // Used by the modules and devices to write and read the data in their own chunks
+        static void Write (const void* pcv_, size_t uLen_);
+        static bool Read (void* pv_, size_t uLen_);
+
+        static void WriteString (const char* pcsz_);
+        static bool ReadString (char* psz_, size_t uSize_);
+};
+
+#endif
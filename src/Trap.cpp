@@ -0,0 +1,284 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Trap.cpp: Native versions of busy SAM ROM routines
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  A trap is a (ROM, address) pair where the core runs a native version of
+//  the code instead of interpreting it (see RunTrap in CPU.cpp).  Each is
+//  only armed if the ROM holds exactly the code it was written for, so a
+//  custom ROM or the HDBOOT patches can't be misread.
+//
+//  The native versions run the same instructions with the same memory and
+//  port accesses and T-state timings, so nothing else can tell them apart.
+//  With RomTraps set to 2 that's checked: each trapped run is done natively
+//  to find the result, then undone and interpreted, and the two compared
+//  when the interpreter reaches the same time.  Port reads are made twice
+//  in that mode, so a mouse being read may give the odd false mismatch.
+//
+//  These are the inner loops of the routines, not whole routines with a
+//  lump-sum T-state charge, as a run can last several lines and events
+//  must still be taken at their proper time.  There are none yet for the
+//  scroll, the calculator entry points or the line tokenizer.  DOS booting
+//  is still done by IO::Rst8Hook.
+//
+//  NoTraps lists trap names not to use, separated by commas or spaces.
+
+#include "SimCoupe.h"
+#include "Trap.h"
+
+#include "CPU.h"
+#include "Options.h"
+
+typedef struct
+{
+    const char* pcszName;       // Name used to turn it off with the NoTraps option
+    int         nROM;           // ROM it's in (0 or 1)
+    WORD        wAddr;          // Address the native version takes over from
+    const BYTE* pcbCode;        // Code it was written for, which must match the ROM
+    UINT        uCodeLen;
+}
+TRAP;
+
+// CLS: 8x PUSH DE, DJNZ, DEC C, JR NZ, filling the display from the top down with SP
+static const BYTE abClearScreen[] =
+{
+    0xd5, 0xd5, 0xd5, 0xd5, 0xd5, 0xd5, 0xd5, 0xd5, 0x10, 0xf6, 0x0d, 0x20, 0xf3
+};
+
+// Mode 4 character printing, masking in each 8-pixel font row through a 2-bit expansion table
+static const BYTE abPrintChar[] =
+{
+    0x1a, 0xa9, 0x13, 0xd9, 0x4f, 0x1f, 0x1f, 0x1f, 0xe6, 0x1e, 0x6f, 0x1a, 0xa0, 0xae, 0x12, 0x2c,
+    0x1c, 0x1a, 0xa0, 0xae, 0x12, 0x1c, 0x79, 0x17, 0xe6, 0x1e, 0x6f, 0x1a, 0xa0, 0xae, 0x12, 0x2c,
+    0x1c, 0x1a, 0xa0, 0xae, 0x12, 0x7b, 0xc6, 0x7d, 0x5f, 0x30, 0x01, 0x14, 0xd9, 0x10, 0xd1
+};
+
+// Keyboard matrix scan, reading each row from ports FE and F9 into the buffer at 5BEE
+static const BYTE abKeyScan[] =
+{
+    0xed, 0x58, 0x78, 0xdb, 0xf9, 0xab, 0xa2, 0xab, 0x04, 0x28, 0x0b, 0x77, 0x05, 0x23, 0xcb, 0x00,
+    0x38, 0xee, 0x06, 0xff, 0x18, 0xea
+};
+
+// Floating-point multiply, shifting and adding the 32-bit mantissas in HL':HL and DE':DE
+static const BYTE abMultiply[] =
+{
+    0x1f, 0x30, 0x05, 0x19, 0xd9, 0xed, 0x5a, 0xd9, 0xd9, 0xcb, 0x1c, 0xcb, 0x1d, 0xd9, 0xcb, 0x1c,
+    0xcb, 0x1d, 0x10, 0xec
+};
+
+// Indexed by trap number, with trapNone unused
+static const TRAP asTraps[trapCount] =
+{
+    { "", 0, 0, NULL, 0 },
+    { "cls",        0, 0x078e, abClearScreen,   sizeof(abClearScreen)   },
+    { "print",      0, 0x3d59, abPrintChar,     sizeof(abPrintChar)     },
+    { "keyscan",    1, 0xd5c5, abKeyScan,       sizeof(abKeyScan)       },
+    { "multiply",   1, 0xcc4b, abMultiply,      sizeof(abMultiply)      },
+};
+
+
+// State before and after a trap being checked
+typedef struct
+{
+    Z80Regs sRegs;
+    DWORD   dwRadjust, dwCycleCounter;
+    int     nLineCycle, nPrevLineCycle;
+    BYTE    aabMemory[4][MEM_PAGE_SIZE];    // Contents of the sections holding RAM
+}
+TRAP_STATE;
+
+MACHINE_LOCAL BYTE* apbTrapMaps[2];
+
+static MACHINE_LOCAL BYTE aabMaps[2][MEM_PAGE_SIZE];
+static MACHINE_LOCAL TRAP_STATE *psBefore, *psAfter;
+static MACHINE_LOCAL int nChecking;         // Trap waiting to be compared, or trapNone
+static MACHINE_LOCAL DWORD dwMismatches;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Look for a name in the NoTraps list
+static bool IsDisabled (const char* pcszName_)
+{
+    size_t uLen = strlen(pcszName_);
+
+    for (const char* p = GetOption(notraps) ; *p ; )
+    {
+        while (*p == ',' || isspace(static_cast<BYTE>(*p)))
+            p++;
+
+        size_t uWord = strcspn(p, ", \t");
+        if (uWord == uLen && !strncasecmp(p, pcszName_, uLen))
+            return true;
+
+        p += uWord;
+    }
+
+    return false;
+}
+
+// Arm the traps that match the current ROMs, called after they're loaded
+void Trap::Init ()
+{
+    int nMode = GetOption(romtraps);
+
+    apbTrapMaps[0] = apbTrapMaps[1] = NULL;
+    memset(aabMaps, trapNone, sizeof aabMaps);
+
+    for (int n = trapNone+1 ; n < trapCount ; n++)
+    {
+        const TRAP* p = &asTraps[n];
+        UINT uOffset = p->wAddr & (MEM_PAGE_SIZE-1);
+
+        if (!nMode || IsDisabled(p->pcszName) ||
+            memcmp(apbPageReadPtrs[ROM0 + p->nROM] + uOffset, p->pcbCode, p->uCodeLen))
+            continue;
+
+        aabMaps[p->nROM][uOffset] = n;
+        apbTrapMaps[p->nROM] = aabMaps[p->nROM];
+    }
+
+    // Checking needs room for the state either side of each trap
+    if (nMode > 1 && !psBefore)
+    {
+        psBefore = new TRAP_STATE;
+        psAfter = new TRAP_STATE;
+    }
+
+    Cancel();
+}
+
+// Forget any check in progress, as the machine state it was for has gone
+void Trap::Cancel ()
+{
+    nChecking = trapNone;
+    CancelCpuEvent(evtTrapCheck);
+}
+
+const char* Trap::GetName (int nTrap_)
+{
+    return (nTrap_ > trapNone && nTrap_ < trapCount) ? asTraps[nTrap_].pcszName : "";
+}
+
+
+// Whether native runs are checked against the ROM code, which applies to every trap alike
+bool Trap::IsChecking ()
+{
+    return GetOption(romtraps) > 1;
+}
+
+static void SaveState (TRAP_STATE* ps_)
+{
+    ps_->sRegs = regs;
+    ps_->dwRadjust = radjust;
+    ps_->dwCycleCounter = g_dwCycleCounter;
+    ps_->nLineCycle = g_nLineCycle;
+    ps_->nPrevLineCycle = g_nPrevLineCycle;
+
+    for (int n = 0 ; n < 4 ; n++)
+    {
+        if (asSections[n].nPage < ROM0)
+            memcpy(ps_->aabMemory[n], asSections[n].pbRead, MEM_PAGE_SIZE);
+    }
+}
+
+static void LoadState (const TRAP_STATE* ps_)
+{
+    regs = ps_->sRegs;
+    radjust = ps_->dwRadjust;
+    g_dwCycleCounter = ps_->dwCycleCounter;
+    g_nLineCycle = ps_->nLineCycle;
+    g_nPrevLineCycle = ps_->nPrevLineCycle;
+
+    for (int n = 0 ; n < 4 ; n++)
+    {
+        if (asSections[n].nPage < ROM0)
+            memcpy(asSections[n].pbRead, ps_->aabMemory[n], MEM_PAGE_SIZE);
+    }
+}
+
+// Global cycle count at the end of the last instruction run
+static DWORD GetEndTime (const TRAP_STATE* ps_)
+{
+    return ps_->dwCycleCounter - ps_->nPrevLineCycle + ps_->nLineCycle;
+}
+
+// Note the state before a trap is run natively, returning false if another check is still in progress
+bool Trap::Save ()
+{
+    if (nChecking != trapNone)
+        return false;
+
+    SaveState(psBefore);
+    return true;
+}
+
+// Note the state the native version left, and put the machine back for the ROM code to run normally
+void Trap::Expect (int nTrap_)
+{
+    SaveState(psAfter);
+    LoadState(psBefore);
+
+    nChecking = nTrap_;
+    AddCpuEvent(evtTrapCheck, GetEndTime(psAfter));
+}
+
+// Compare the interpreted result with the native one, when it reaches the same time
+void Trap::Check ()
+{
+    if (nChecking == trapNone)
+        return;
+
+    SaveState(psBefore);
+    const char* pcszName = GetName(nChecking);
+    nChecking = trapNone;
+
+    bool fMatch = true;
+
+    if (memcmp(&psBefore->sRegs, &psAfter->sRegs, sizeof psBefore->sRegs) || psBefore->dwRadjust != psAfter->dwRadjust)
+    {
+        TRACE("ROM trap %s: registers don't match at %04X (native stopped at %04X)\n", pcszName,
+                psBefore->sRegs.PC.W, psAfter->sRegs.PC.W);
+        fMatch = false;
+    }
+
+    if (g_dwCycleCounter != GetEndTime(psAfter))
+    {
+        TRACE("ROM trap %s: finished at cycle %lu instead of %lu\n", pcszName,
+                static_cast<unsigned long>(g_dwCycleCounter), static_cast<unsigned long>(GetEndTime(psAfter)));
+        fMatch = false;
+    }
+
+    for (int n = 0 ; n < 4 ; n++)
+    {
+        if (asSections[n].nPage < ROM0 && memcmp(psBefore->aabMemory[n], psAfter->aabMemory[n], MEM_PAGE_SIZE))
+        {
+            TRACE("ROM trap %s: memory in section %d doesn't match\n", pcszName, n);
+            fMatch = false;
+        }
+    }
+
+    if (!fMatch)
+        dwMismatches++;
+}
+
+DWORD Trap::GetMismatches ()
+{
+    return dwMismatches;
+}
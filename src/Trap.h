@@ -0,0 +1,53 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Trap.h: Native versions of busy SAM ROM routines
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+#ifndef TRAP_H
+#define TRAP_H
+
+#include "Memory.h"
+
+// ROM routines with native versions, in the order of the trap table in Trap.cpp
+enum { trapNone, trapClearScreen, trapPrintChar, trapKeyScan, trapMultiply, trapCount };
+
+class Trap
+{
+    public:
+        static void Init ();
+        static void Cancel ();
+        static const char* GetName (int nTrap_);
+
+        static bool IsChecking ();
+        static bool Save ();
+        static void Expect (int nTrap_);
+        static void Check ();
+        static DWORD GetMismatches ();
+};
+
+// Trap number at each address of the two ROMs, or NULL for a ROM with none armed
+extern MACHINE_LOCAL BYTE* apbTrapMaps[2];
+
+// Trap at an address in the current memory map, if it's in a ROM with one there
+inline int GetTrap (WORD wAddr_)
+{
+    UINT uROM = static_cast<UINT>(asSections[VPAGE(wAddr_)].nPage - ROM0);
+    return (uROM < 2 && apbTrapMaps[uROM]) ? static_cast<int>(apbTrapMaps[uROM][wAddr_ & (MEM_PAGE_SIZE-1)]) : trapNone;
+}
+
+#endif
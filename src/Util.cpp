@@ -40,7 +40,7 @@
 
 
 static const int TRACE_BUFFER_SIZE = 2048;
-static char* s_pszTrace;
+static MACHINE_LOCAL char* s_pszTrace;
 
 
 bool Util::Init ()
@@ -175,7 +175,7 @@ void TraceOutputString (const BYTE *pcb, UINT uLen/*=0*/)
 
 #else
 
-DWORD g_dwStart;
+MACHINE_LOCAL DWORD g_dwStart;
 
 static void TraceOutputString (const char *pcszFormat_, va_list pcvArgs);
 static void WriteTimeString (char* psz_);
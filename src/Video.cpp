@@ -38,7 +38,7 @@
 const int N_TOTAL_COLOURS = N_PALETTE_COLOURS + N_GUI_COLOURS;
 
 // SAM RGB values in appropriate format, and YUV values pre-shifted for overlay surface
-WORD aulPalette[N_TOTAL_COLOURS], aulScanline[N_TOTAL_COLOURS];
+MACHINE_LOCAL WORD aulPalette[N_TOTAL_COLOURS], aulScanline[N_TOTAL_COLOURS];
 
   extern SDL_Surface *back_surface;
 
@@ -101,8 +101,9 @@ bool Video::Init (bool fFirstInit_/*=false*/)
 
         psp_sdl_gu_init();
 
+        // Hi-res lines drawn straight into it are wider than what's shown, so leave room for them
         blit_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, 
-           SIM_WIDTH, SIM_HEIGHT,
+           max(SIM_WIDTH, Frame::GetWidth()), SIM_HEIGHT,
            back_surface->format->BitsPerPixel,
            back_surface->format->Rmask,
            back_surface->format->Gmask,
@@ -193,6 +194,9 @@ bool Video::CreatePalettes (bool fDimmed_)
     for (int c = 0 ; c < 16 ; c++)
         clut[c] = aulPalette[clutval[c]];
 
+    // The host colours drawn directly come from the palette too
+    Frame::ChangePalette();
+
     // Ensure the display is redrawn to reflect the changes
     Display::SetDirty();
 
@@ -32,7 +32,7 @@ class Video
 };
 
 
-extern WORD aulPalette[], aulScanline[];
+extern MACHINE_LOCAL WORD aulPalette[], aulScanline[];
 //extern SDL_Surface *back_surface;
 
 
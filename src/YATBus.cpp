@@ -23,6 +23,7 @@
 
 #include "SimCoupe.h"
 #include "YATBus.h"
+#include "State.h"
 
 CYATBusDevice::CYATBusDevice (CATADevice* pDisk_)
     : CDiskDevice(dskYATBus), m_bLatch(0), m_fDataLatched(false)
@@ -42,6 +43,24 @@ void CYATBusDevice::Reset ()
         m_pDisk->Reset();
 }
 
+void CYATBusDevice::SaveState () const
+{
+    State::Write(&m_bLatch, sizeof m_bLatch);
+    State::Write(&m_fDataLatched, sizeof m_fDataLatched);
+
+    if (m_pDisk)
+        m_pDisk->SaveState();
+}
+
+bool CYATBusDevice::LoadState ()
+{
+    if (!State::Read(&m_bLatch, sizeof m_bLatch) ||
+        !State::Read(&m_fDataLatched, sizeof m_fDataLatched))
+        return false;
+
+    return !m_pDisk || m_pDisk->LoadState();
+}
+
 BYTE CYATBusDevice::In (WORD wPort_)
 {
     BYTE bRet = 0xff;
@@ -35,6 +35,9 @@ class CYATBusDevice : public CDiskDevice
         BYTE In (WORD wPort_);
         void Out (WORD wPort_, BYTE bVal_);
 
+        void SaveState () const;
+        bool LoadState ();
+
         const char* GetPath() const { return m_pDisk->GetPath(); }
 
     protected:
@@ -0,0 +1,201 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Z80Test.cpp: CP/M instruction exerciser runner for the headless build
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Notes:
+//  Runs a CP/M instruction exerciser (zexdoc/zexall, or anything else that
+//  only prints through BDOS) on the emulated SAM, with RAM paged into the
+//  whole 64K.  Warm boot at 0000 and the BDOS entry point are both ED FE
+//  traps, which the core passes to TrapHook.  The exerciser output is
+//  echoed, and each test line reporting OK or ERROR is counted as a group.
+//
+//  The instruction rate is taken from the R register counter, so prefixed
+//  instructions count once for each opcode fetch.
+
+#include "SimCoupe.h"
+#include "Z80Test.h"
+
+#include <sys/time.h>
+
+#include "CPU.h"
+#include "Frame.h"
+#include "IO.h"
+#include "Memory.h"
+
+
+const WORD CPM_TPA = 0x0100;        // Programs are loaded and started here
+const WORD CPM_BDOS = 0xfe00;       // BDOS entry point, and the top of the program space
+
+const BYTE BDOS_PRINT_CHAR = 2;     // Print the character in E
+const BYTE BDOS_PRINT_STRING = 9;   // Print the '$'-terminated string at DE
+
+static MACHINE_LOCAL bool fFinished;
+static MACHINE_LOCAL int nPassed, nFailed;
+
+static MACHINE_LOCAL char szLine[256];
+static MACHINE_LOCAL size_t uLineLen;
+
+
+static double GetSeconds ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Echo a character of exerciser output, scoring each group as its result line completes
+static void PrintChar (BYTE bChar_)
+{
+    putchar(bChar_);
+
+    if (bChar_ != '\n')
+    {
+        if (bChar_ != '\r' && uLineLen < sizeof szLine - 1)
+            szLine[uLineLen++] = bChar_;
+        return;
+    }
+
+    fflush(stdout);
+
+    // Strip trailing spaces before looking for the result
+    while (uLineLen && szLine[uLineLen-1] == ' ')
+        uLineLen--;
+    szLine[uLineLen] = '\0';
+
+    if (strstr(szLine, "ERROR"))
+        nFailed++;
+    else if (uLineLen > 2 && !strcmp(szLine + uLineLen - 3, " OK"))
+        nPassed++;
+
+    uLineLen = 0;
+}
+
+
+bool Z80Test::Run (const char* pcszFile_)
+{
+    FILE* hFile = fopen(pcszFile_, "rb");
+    if (!hFile)
+    {
+        fprintf(stderr, "Can't open %s\n", pcszFile_);
+        return false;
+    }
+
+    // Page RAM into all four sections, with ROM0 switched off
+    IO::Out(LMPR_PORT, LMPR_ROM0_OFF | 0);
+    IO::Out(HMPR_PORT, 2);
+
+    for (UINT uAddr = 0 ; uAddr < CPM_TPA ; uAddr++)
+        write_byte(uAddr, 0x00);
+
+    // Load the program, which must fit below BDOS
+    UINT uLen = 0;
+    for (int nByte ; uLen < CPM_BDOS - CPM_TPA && (nByte = fgetc(hFile)) != EOF ; uLen++)
+        write_byte(CPM_TPA + uLen, nByte);
+    fclose(hFile);
+
+    // Warm boot traps, and BDOS at 0005 jumps to a trap followed by RET
+    write_byte(0x0000, OP_ED);
+    write_byte(0x0001, OP_TRAP);
+    write_byte(0x0005, OP_JP);
+    write_word(0x0006, CPM_BDOS);
+    write_byte(CPM_BDOS+0, OP_ED);
+    write_byte(CPM_BDOS+1, OP_TRAP);
+    write_byte(CPM_BDOS+2, OP_RET);
+
+    // Anything decoded from the boot ROM is no longer needed
+    CPU::InvalidateCode();
+
+    // Start the program with interrupts disabled and a return address of warm boot
+    regs.PC.W = CPM_TPA;
+    regs.SP.W = CPM_BDOS - 2;
+    write_word(regs.SP.W, 0x0000);
+    regs.IFF1 = regs.IFF2 = 0;
+
+    fFinished = false;
+    nPassed = nFailed = 0;
+    uLineLen = 0;
+
+    double dInstrs = 0.0;
+    double dStart = GetSeconds();
+
+    // Same loop as CPU::Run, until the program warm boots
+    while (!fFinished)
+    {
+        DWORD dwCycles = g_dwCycleCounter, dwRadjust = radjust;
+
+        CPU::ExecuteChunk();
+        Frame::Complete();
+
+        // LD R,A resets the counter, so skip any chunk where it's been used
+        DWORD dwFetches = radjust - dwRadjust;
+        if (dwFetches <= (g_dwCycleCounter - dwCycles) / 4)
+            dInstrs += dwFetches;
+
+        if (g_nLine >= HEIGHT_LINES)
+        {
+            IO::FrameUpdate();
+            g_nLine %= HEIGHT_LINES;
+            Frame::Start();
+        }
+    }
+
+    double dElapsed = GetSeconds() - dStart;
+    if (dElapsed <= 0.0)
+        dElapsed = 1e-6;
+
+    if (uLineLen)
+        PrintChar('\n');
+
+    printf("\n");
+    printf("groups:     %d passed, %d failed\n", nPassed, nFailed);
+    printf("time:       %.3fs\n", dElapsed);
+    printf("MIPS:       %.2f\n", dInstrs / dElapsed / 1000000.0);
+
+    return nPassed && !nFailed;
+}
+
+// Called for ED FE, with PC after the trap
+void Z80Test::TrapHook ()
+{
+    // Warm boot back at 0000 ends the run
+    if (regs.PC.W == 0x0002)
+    {
+        fFinished = g_fBreak = true;
+        return;
+    }
+
+    if (regs.PC.W != CPM_BDOS+2)
+        return;
+
+    switch (regs.BC.B.l_)
+    {
+        case BDOS_PRINT_CHAR:
+            PrintChar(regs.DE.B.l_);
+            break;
+
+        case BDOS_PRINT_STRING:
+        {
+            // Give up on a missing terminator rather than wrapping round memory forever
+            WORD wAddr = regs.DE.W;
+            for (UINT u = 0 ; u < 0x10000 && read_byte(wAddr) != '$' ; u++, wAddr++)
+                PrintChar(read_byte(wAddr));
+            break;
+        }
+    }
+}
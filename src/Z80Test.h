@@ -0,0 +1,34 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Z80Test.h: CP/M instruction exerciser runner for the headless build
+//
+//  Copyright (c) 1999-2006  Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+#ifndef Z80TEST_H
+#define Z80TEST_H
+
+// ED FE does nothing on a real Z80, so the test environment uses it to call back into the emulator
+const BYTE OP_TRAP = 0xfe;
+
+class Z80Test
+{
+    public:
+        static bool Run (const char* pcszFile_);
+        static void TrapHook ();
+};
+
+#endif
@@ -0,0 +1,146 @@
+// Part of SimCoupe - A SAM Coupe emulator
+//
+// Z80hlops.h: Z80 instructions using HL, which index prefixes change to IX or IY
+//
+//  Copyright (c) 1994 Ian Collier
+//  Copyright (c) 1999-2003 by Dave Laundon
+//  Copyright (c) 1999-2006 by Simon Owen
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+// Included by Z80ops.h, which supplies the helper macros.  These are the only instructions
+// compiled again for the IX and IY handler tables, so anything that uses HL, H, L or (HL)
+// must be here rather than in Z80ops.h, and nothing else.
+
+
+instr(4,0011)   add_hl(bc);                                         endinstr;   // add hl/ix/iy,bc
+instr(4,0031)   add_hl(de);                                         endinstr;   // add hl/ix/iy,de
+instr(4,0041)   *pHlIxIy = timed_read_code_word(pc); pc += 2;       endinstr;   // ld hl/ix/iy,nn
+instr(4,0051)   add_hl(*pHlIxIy);                                   endinstr;   // add hl/ix/iy,hl/ix/iy
+instr(4,0071)   add_hl(sp);                                         endinstr;   // add hl/ix/iy,sp
+
+instr(4,0042)   ld_pnn_rr(*pHlIxIy);                                endinstr;   // ld (nn),hl/ix/iy
+instr(4,0052)   ld_rr_pnn(*pHlIxIy);                                endinstr;   // ld hl/ix/iy,(nn)
+
+instr(6,0043)   ++*pHlIxIy;                                         endinstr;   // inc hl/ix/iy
+instr(6,0053)   --*pHlIxIy;                                         endinstr;   // dec hl/ix/iy
+
+instr(4,0044)   inc(xh);                                            endinstr;   // inc h/ixh/iyh
+instr(4,0054)   inc(xl);                                            endinstr;   // inc l/ixl/iyl
+
+HLinstr(0064)   BYTE t = timed_read_byte(addr);
+                inc(t); g_nLineCycle++;
+                timed_write_byte(addr,t);                           endinstr;   // inc (hl/ix+d/iy+d)
+
+instr(4,0045)   dec(xh);                                            endinstr;   // dec h/ixh/iyh
+instr(4,0055)   dec(xl);                                            endinstr;   // dec l/ixl/iyl
+
+HLinstr(0065)   BYTE t = timed_read_byte(addr);
+                dec(t); g_nLineCycle++;
+                timed_write_byte(addr,t);                           endinstr;   // dec (hl/ix+d/iy+d)
+
+instr(4,0046)   xh = timed_read_code_byte(pc++);                    endinstr;   // ld h/ixh/iyh,n
+instr(4,0056)   xl = timed_read_code_byte(pc++);                    endinstr;   // ld l/ixl/iyl,n
+HLinstr(0066)   timed_write_byte(addr,timed_read_code_byte(pc++));  endinstr;   // ld (hl/ix+d/iy+d),n
+
+instr(4,0140)   xh = b;                                             endinstr;   // ld h/ixh/iyh,b
+instr(4,0150)   xl = b;                                             endinstr;   // ld l/ixl/iyl,b
+HLinstr(0160)   timed_write_byte(addr,b);                           endinstr;   // ld (hl/ix+d/iy+d),b
+
+instr(4,0141)   xh = c;                                             endinstr;   // ld h/ixh/iyh,c
+instr(4,0151)   xl = c;                                             endinstr;   // ld l/ixl/iyl,c
+HLinstr(0161)   timed_write_byte(addr,c);                           endinstr;   // ld (hl/ix+d/iy+d),c
+
+instr(4,0142)   xh = d;                                             endinstr;   // ld h/ixh/iyh,d
+instr(4,0152)   xl = d;                                             endinstr;   // ld l/ixl/iyl,d
+HLinstr(0162)   timed_write_byte(addr,d);                           endinstr;   // ld (hl/ix+d/iy+d),d
+
+instr(4,0143)   xh = e;                                             endinstr;   // ld h/ixh/iyh,e
+instr(4,0153)   xl = e;                                             endinstr;   // ld l/ixl/iyl,e
+HLinstr(0163)   timed_write_byte(addr,e);                           endinstr;   // ld (hl/ix+d/iy+d),e
+
+instr(4,0104)   b = xh;                                             endinstr;   // ld b,h/ixh/iyh
+instr(4,0114)   c = xh;                                             endinstr;   // ld c,h/ixh/iyh
+instr(4,0124)   d = xh;                                             endinstr;   // ld d,h/ixh/iyh
+instr(4,0134)   e = xh;                                             endinstr;   // ld e,h/ixh/iyh
+instr(4,0154)   xl = xh;                                            endinstr;   // ld l/ixh/iyh,h/ixh/iyh
+HLinstr(0164)   timed_write_byte(addr,h);                           endinstr;   // ld (hl/ix+d/iy+d),h
+instr(4,0174)   a = xh;                                             endinstr;   // ld a,h/ixh/iyh
+
+instr(4,0105)   b = xl;                                             endinstr;   // ld b,l/ixl/iyl
+instr(4,0115)   c = xl;                                             endinstr;   // ld c,l/ixl/iyl
+instr(4,0125)   d = xl;                                             endinstr;   // ld d,l/ixl/iyl
+instr(4,0135)   e = xl;                                             endinstr;   // ld e,l/ixl/iyl
+instr(4,0145)   xh = xl;                                            endinstr;   // ld h/ixh/iyh,l/ixl/iyl
+HLinstr(0165)   timed_write_byte(addr,l);                           endinstr;   // ld (hl/ix+d/iy+d),l
+instr(4,0175)   a = xl;                                             endinstr;   // ld a,l/ixl/iyl
+
+HLinstr(0106)   b = timed_read_byte(addr);                          endinstr;   // ld b,(hl/ix+d/iy+d)
+HLinstr(0116)   c = timed_read_byte(addr);                          endinstr;   // ld c,(hl/ix+d/iy+d)
+HLinstr(0126)   d = timed_read_byte(addr);                          endinstr;   // ld d,(hl/ix+d/iy+d)
+HLinstr(0136)   e = timed_read_byte(addr);                          endinstr;   // ld e,(hl/ix+d/iy+d)
+HLinstr(0146)   h = timed_read_byte(addr);                          endinstr;   // ld h,(hl/ix+d/iy+d)
+HLinstr(0156)   l = timed_read_byte(addr);                          endinstr;   // ld l,(hl/ix+d/iy+d)
+HLinstr(0176)   a = timed_read_byte(addr);                          endinstr;   // ld a,(hl/ix+d/iy+d)
+
+instr(4,0147)   xh = a;                                             endinstr;   // ld h/ixh/iyh,a
+instr(4,0157)   xl = a;                                             endinstr;   // ld l/ixl/iyl,a
+HLinstr(0167)   timed_write_byte(addr,a);                           endinstr;   // ld (hl/ix+d/iy+d),a
+
+instr(4,0204)   add_a(xh);                                          endinstr;   // add a,h/ixh/iyh
+instr(4,0214)   adc_a(xh);                                          endinstr;   // adc a,h/ixh/iyh
+instr(4,0224)   sub_a(xh);                                          endinstr;   // sub h/ixh/iyh
+instr(4,0234)   sbc_a(xh);                                          endinstr;   // sbc a,h/ixh/iyh
+instr(4,0244)   and_a(xh);                                          endinstr;   // and h/ixh/iyh
+instr(4,0254)   xor_a(xh);                                          endinstr;   // xor h/ixh/iyh
+instr(4,0264)   or_a(xh);                                           endinstr;   // or h/ixh/iyh
+instr(4,0274)   cp_a(xh);                                           endinstr;   // cp h/ixh/iyh
+
+instr(4,0205)   add_a(xl);                                          endinstr;   // add a,l/ixl/iyl
+instr(4,0215)   adc_a(xl);                                          endinstr;   // adc a,l/ixl/iyl
+instr(4,0225)   sub_a(xl);                                          endinstr;   // sub l/ixl/iyl
+instr(4,0235)   sbc_a(xl);                                          endinstr;   // sbc a,l/ixl/iyl
+instr(4,0245)   and_a(xl);                                          endinstr;   // and l/ixl/iyl
+instr(4,0255)   xor_a(xl);                                          endinstr;   // xor l/ixl/iyl
+instr(4,0265)   or_a(xl);                                           endinstr;   // or l/ixl/iyl
+instr(4,0275)   cp_a(xl);                                           endinstr;   // cp l/ixl/iyl
+
+HLinstr(0206)   add_a(timed_read_byte(addr));                       endinstr;   // add a,(hl/ix+d/iy+d)
+HLinstr(0216)   adc_a(timed_read_byte(addr));                       endinstr;   // adc a,(hl/ix+d/iy+d)
+HLinstr(0226)   sub_a(timed_read_byte(addr));                       endinstr;   // sub (hl/ix+d/iy+d)
+HLinstr(0236)   sbc_a(timed_read_byte(addr));                       endinstr;   // sbc a,(hl/ix+d/iy+d)
+HLinstr(0246)   and_a(timed_read_byte(addr));                       endinstr;   // and (hl/ix+d/iy+d)
+HLinstr(0256)   xor_a(timed_read_byte(addr));                       endinstr;   // xor (hl/ix+d/iy+d)
+HLinstr(0266)   or_a(timed_read_byte(addr));                        endinstr;   // or (hl/ix+d/iy+d)
+HLinstr(0276)   cp_a(timed_read_byte(addr));                        endinstr;   // cp (hl/ix+d/iy+d)
+
+instr(4,0341)   pop(*pHlIxIy);                                      endinstr;   // pop hl/ix/iy
+instr(4,0351)   pc = *pHlIxIy;                                      endinstr;   // jp (hl/ix/iy)
+instr(6,0371)   sp = *pHlIxIy;                                      endinstr;   // ld sp,hl/ix/iy
+instr(5,0345)   push(*pHlIxIy);                                     endinstr;   // push hl
+
+// [cb prefix]
+instr(4,0313)
+#include "CBops.h"
+endinstr;
+
+// ex (sp),hl
+instr(4,0343)
+    WORD t = timed_read_word(sp);
+    g_nLineCycle++;
+    timed_write_word_reversed(sp,*pHlIxIy);
+    *pHlIxIy = t;
+    g_nLineCycle += 2;
+endinstr;
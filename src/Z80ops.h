@@ -43,7 +43,8 @@
 
 // Basic instruction header, specifying opcode and nominal T-States of the first M-Cycle
 // The first three T-States of the first M-Cycle are already accounted for
-#define instr(m1states, opcode) op_##opcode : { \
+// The label comes from op_label, as the file is included once each for HL, IX and IY (see Z80hlops.h)
+#define instr(m1states, opcode) op_label(opcode) : { \
                                     g_nLineCycle += m1states - 3;
 #define endinstr                } goto lab_end;
 
@@ -97,6 +98,13 @@
 // 8-bit add
 #define add_a(x)        add_a1((x),0)
 #define adc_a(x)        add_a1((x),cy)
+#ifdef USE_FLAG_TABLES
+#define add_a1(x,c)     do { \
+                            BYTE z = (x), n = (c); \
+                            f = g_abAdd[(n << 16) | (a << 8) | z]; \
+                            a += z + n; \
+                        } while (0)
+#else
 #define add_a1(x,c)     do { \
                             BYTE z = (x); \
                             WORD y = a + z + (c); \
@@ -106,10 +114,18 @@
                             a = y;                                                                   \
                             f |= (!a) << 6;                                         /* Z          */ \
                         } while (0)
+#endif
 
 // 8-bit subtract
 #define sub_a(x)        sub_a1((x),0)
 #define sbc_a(x)        sub_a1((x),cy)
+#ifdef USE_FLAG_TABLES
+#define sub_a1(x,c)     do { \
+                            BYTE z = (x), n = (c); \
+                            f = g_abSub[(n << 16) | (a << 8) | z]; \
+                            a -= z + n; \
+                        } while (0)
+#else
 #define sub_a1(x,c)     do { \
                             BYTE z = (x); \
                             WORD y = a - z - (c); \
@@ -120,9 +136,13 @@
                             a = y;                                                                   \
                             f |= (!a) << 6;                                         /* Z          */ \
                         } while (0)
+#endif
 
 // 8-bit compare
 // Undocumented flags added by Ian Collier
+#ifdef USE_FLAG_TABLES
+#define cp_a(x)         ( f = g_abCp[(a << 8) | (BYTE)(x)] )
+#else
 #define cp_a(x)          do { \
                             BYTE z = (x); \
                             WORD y = a - z; \
@@ -133,6 +153,7 @@
                                 2 |                                                 /* N          */ \
                                 ((!y) << 6);                                        /* Z          */ \
                         } while (0)
+#endif
 
 // logical and
 #define and_a(x)        ( a &= (x), f = parity(a) | F_HCARRY )
@@ -156,6 +177,18 @@
                             } \
                         } while (0)
 
+// Jump relative on a flag, fast-forwarding any tight polling loop it closes
+#define jr_poll(cc)     do { \
+                            WORD wFrom = pc; \
+                            jr(cc); \
+                            if ((WORD)(wFrom - pc) <= 5) \
+                            { \
+                                skip_idle(pc, (nIdleLoop == pc) ? radjust - dwIdleRadjust : 0); \
+                                nIdleLoop = pc; \
+                                dwIdleRadjust = radjust; \
+                            } \
+                        } while (0)
+
 // Jump absolute
 #define jp(cc)          do { \
                             if (cc) \
@@ -191,32 +224,30 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 
+// Instructions using HL, IX or IY, which are the only ones compiled again for the index tables
+#include "Z80hlops.h"
+
+#ifndef HL_OPS_ONLY
+
 instr(4,0000)                                                       endinstr;   // nop
 instr(4,0010)   swap(af,alt_af);                                    endinstr;   // ex af,af'
 instr(5,0020)   --b; jr(b);                                         endinstr;   // djnz e
 instr(4,0030)   jr(true);                                           endinstr;   // jr e
-instr(4,0040)   jr(!(f & F_ZERO));                                  endinstr;   // jr nz,e
-instr(4,0050)   jr(f & F_ZERO);                                     endinstr;   // jr z,e
+instr(4,0040)   jr_poll(!(f & F_ZERO));                             endinstr;   // jr nz,e
+instr(4,0050)   jr_poll(f & F_ZERO);                                endinstr;   // jr z,e
 instr(4,0060)   jr(!cy);                                            endinstr;   // jr nc,e
 instr(4,0070)   jr(cy);                                             endinstr;   // jr c,e
 
 
 instr(4,0001)   bc = timed_read_code_word(pc); pc += 2;             endinstr;   // ld bc,nn
-instr(4,0011)   add_hl(bc);                                         endinstr;   // add hl/ix/iy,bc
 instr(4,0021)   de = timed_read_code_word(pc); pc += 2;             endinstr;   // ld de,nn
-instr(4,0031)   add_hl(de);                                         endinstr;   // add hl/ix/iy,de
-instr(4,0041)   *pHlIxIy = timed_read_code_word(pc); pc += 2;       endinstr;   // ld hl/ix/iy,nn
-instr(4,0051)   add_hl(*pHlIxIy);                                   endinstr;   // add hl/ix/iy,hl/ix/iy
 instr(4,0061)   sp = timed_read_code_word(pc); pc += 2;             endinstr;   // ld sp,nn
-instr(4,0071)   add_hl(sp);                                         endinstr;   // add hl/ix/iy,sp
 
 
 instr(4,0002)   timed_write_byte(bc,a);                             endinstr;   // ld (bc),a
 instr(4,0012)   a = timed_read_byte(bc);                            endinstr;   // ld a,(bc)
 instr(4,0022)   timed_write_byte(de,a);                             endinstr;   // ld (de),a
 instr(4,0032)   a = timed_read_byte(de);                            endinstr;   // ld a,(de)
-instr(4,0042)   ld_pnn_rr(*pHlIxIy);                                endinstr;   // ld (nn),hl/ix/iy
-instr(4,0052)   ld_rr_pnn(*pHlIxIy);                                endinstr;   // ld hl/ix/iy,(nn)
 instr(4,0062)   ld_pnn_r(a);                                        endinstr;   // ld (nn),a
 instr(4,0072)   ld_r_pnn(a);                                        endinstr;   // ld a,(nn)
 
@@ -225,8 +256,6 @@ instr(6,0003)   ++bc;                                               endinstr;
 instr(6,0013)   --bc;                                               endinstr;   // dec bc
 instr(6,0023)   ++de;                                               endinstr;   // inc de
 instr(6,0033)   --de;                                               endinstr;   // dec de
-instr(6,0043)   ++*pHlIxIy;                                         endinstr;   // inc hl/ix/iy
-instr(6,0053)   --*pHlIxIy;                                         endinstr;   // dec hl/ix/iy
 instr(6,0063)   ++sp;                                               endinstr;   // inc sp
 instr(6,0073)   --sp;                                               endinstr;   // dec sp
 
@@ -235,11 +264,6 @@ instr(4,0004)   inc(b);                                             endinstr;
 instr(4,0014)   inc(c);                                             endinstr;   // inc c
 instr(4,0024)   inc(d);                                             endinstr;   // inc d
 instr(4,0034)   inc(e);                                             endinstr;   // inc e
-instr(4,0044)   inc(xh);                                            endinstr;   // inc h/ixh/iyh
-instr(4,0054)   inc(xl);                                            endinstr;   // inc l/ixl/iyl
-HLinstr(0064)   BYTE t = timed_read_byte(addr);
-                inc(t); g_nLineCycle++;
-                timed_write_byte(addr,t);                           endinstr;   // inc (hl/ix+d/iy+d)
 instr(4,0074)   inc(a);                                             endinstr;   // inc a
 
 
@@ -247,11 +271,6 @@ instr(4,0005)   dec(b);                                             endinstr;
 instr(4,0015)   dec(c);                                             endinstr;   // dec c
 instr(4,0025)   dec(d);                                             endinstr;   // dec d
 instr(4,0035)   dec(e);                                             endinstr;   // dec e
-instr(4,0045)   dec(xh);                                            endinstr;   // dec h/ixh/iyh
-instr(4,0055)   dec(xl);                                            endinstr;   // dec l/ixl/iyl
-HLinstr(0065)   BYTE t = timed_read_byte(addr);
-                dec(t); g_nLineCycle++;
-                timed_write_byte(addr,t);                           endinstr;   // dec (hl/ix+d/iy+d)
 instr(4,0075)   dec(a);                                             endinstr;   // dec a
 
 
@@ -259,9 +278,6 @@ instr(4,0006)   b = timed_read_code_byte(pc++);                     endinstr;
 instr(4,0016)   c = timed_read_code_byte(pc++);                     endinstr;   // ld c,n
 instr(4,0026)   d = timed_read_code_byte(pc++);                     endinstr;   // ld d,n
 instr(4,0036)   e = timed_read_code_byte(pc++);                     endinstr;   // ld e,n
-instr(4,0046)   xh = timed_read_code_byte(pc++);                    endinstr;   // ld h/ixh/iyh,n
-instr(4,0056)   xl = timed_read_code_byte(pc++);                    endinstr;   // ld l/ixl/iyl,n
-HLinstr(0066)   timed_write_byte(addr,timed_read_code_byte(pc++));  endinstr;   // ld (hl/ix+d/iy+d),n
 instr(4,0076)   a = timed_read_code_byte(pc++);                     endinstr;   // ld a,n
 
 
@@ -293,6 +309,9 @@ instr(4,0037)
 endinstr;
 
 // daa
+#ifdef USE_FLAG_TABLES
+instr(4,0047)   af = g_awDaa[((f & F_NADD) << 9) | ((f & F_HCARRY) << 5) | ((f & F_CARRY) << 8) | a];   endinstr;
+#else
 instr(4,0047)
     WORD acc = a;
     BYTE carry = cy, incr = 0;
@@ -330,6 +349,7 @@ instr(4,0047)
     a = acc;
     f = (a & 0xa8) | (!a << 6) | (f & 0x12) | (parity(a) & F_PARITY) | carry | !!(acc & 0x100);
 endinstr;
+#endif
 
 // cpl
 instr(4,0057)
@@ -352,9 +372,6 @@ instr(4,0100)                                                       endinstr;
 instr(4,0110)   c = b;                                              endinstr;   // ld c,b
 instr(4,0120)   d = b;                                              endinstr;   // ld d,b
 instr(4,0130)   e = b;                                              endinstr;   // ld e,b
-instr(4,0140)   xh = b;                                             endinstr;   // ld h/ixh/iyh,b
-instr(4,0150)   xl = b;                                             endinstr;   // ld l/ixl/iyl,b
-HLinstr(0160)   timed_write_byte(addr,b);                           endinstr;   // ld (hl/ix+d/iy+d),b
 instr(4,0170)   a = b;                                              endinstr;   // ld a,b
 
 
@@ -362,9 +379,6 @@ instr(4,0101)   b = c;                                              endinstr;
 instr(4,0111)                                                       endinstr;   // ld c,c
 instr(4,0121)   d = c;                                              endinstr;   // ld d,c
 instr(4,0131)   e = c;                                              endinstr;   // ld e,c
-instr(4,0141)   xh = c;                                             endinstr;   // ld h/ixh/iyh,c
-instr(4,0151)   xl = c;                                             endinstr;   // ld l/ixl/iyl,c
-HLinstr(0161)   timed_write_byte(addr,c);                           endinstr;   // ld (hl/ix+d/iy+d),c
 instr(4,0171)   a = c;                                              endinstr;   // ld a,c
 
 
@@ -372,9 +386,6 @@ instr(4,0102)   b = d;                                              endinstr;
 instr(4,0112)   c = d;                                              endinstr;   // ld c,d
 instr(4,0122)                                                       endinstr;   // ld d,d
 instr(4,0132)   e = d;                                              endinstr;   // ld e,d
-instr(4,0142)   xh = d;                                             endinstr;   // ld h/ixh/iyh,d
-instr(4,0152)   xl = d;                                             endinstr;   // ld l/ixl/iyl,d
-HLinstr(0162)   timed_write_byte(addr,d);                           endinstr;   // ld (hl/ix+d/iy+d),d
 instr(4,0172)   a = d;                                              endinstr;   // ld a,d
 
 
@@ -382,51 +393,22 @@ instr(4,0103)   b = e;                                              endinstr;
 instr(4,0113)   c = e;                                              endinstr;   // ld c,e
 instr(4,0123)   d = e;                                              endinstr;   // ld d,e
 instr(4,0133)                                                       endinstr;   // ld e,e
-instr(4,0143)   xh = e;                                             endinstr;   // ld h/ixh/iyh,e
-instr(4,0153)   xl = e;                                             endinstr;   // ld l/ixl/iyl,e
-HLinstr(0163)   timed_write_byte(addr,e);                           endinstr;   // ld (hl/ix+d/iy+d),e
 instr(4,0173)   a = e;                                              endinstr;   // ld a,e
 
 
-instr(4,0104)   b = xh;                                             endinstr;   // ld b,h/ixh/iyh
-instr(4,0114)   c = xh;                                             endinstr;   // ld c,h/ixh/iyh
-instr(4,0124)   d = xh;                                             endinstr;   // ld d,h/ixh/iyh
-instr(4,0134)   e = xh;                                             endinstr;   // ld e,h/ixh/iyh
 instr(4,0144)                                                       endinstr;   // ld h/ixh/iyh,h/ixh/iyh
-instr(4,0154)   xl = xh;                                            endinstr;   // ld l/ixh/iyh,h/ixh/iyh
-HLinstr(0164)   timed_write_byte(addr,h);                           endinstr;   // ld (hl/ix+d/iy+d),h
-instr(4,0174)   a = xh;                                             endinstr;   // ld a,h/ixh/iyh
 
 
-instr(4,0105)   b = xl;                                             endinstr;   // ld b,l/ixl/iyl
-instr(4,0115)   c = xl;                                             endinstr;   // ld c,l/ixl/iyl
-instr(4,0125)   d = xl;                                             endinstr;   // ld d,l/ixl/iyl
-instr(4,0135)   e = xl;                                             endinstr;   // ld e,l/ixl/iyl
-instr(4,0145)   xh = xl;                                            endinstr;   // ld h/ixh/iyh,l/ixl/iyl
 instr(4,0155)                                                       endinstr;   // ld l/ixl/iyl,l/ixl/iyl
-HLinstr(0165)   timed_write_byte(addr,l);                           endinstr;   // ld (hl/ix+d/iy+d),l
-instr(4,0175)   a = xl;                                             endinstr;   // ld a,l/ixl/iyl
-
-
-HLinstr(0106)   b = timed_read_byte(addr);                          endinstr;   // ld b,(hl/ix+d/iy+d)
-HLinstr(0116)   c = timed_read_byte(addr);                          endinstr;   // ld c,(hl/ix+d/iy+d)
-HLinstr(0126)   d = timed_read_byte(addr);                          endinstr;   // ld d,(hl/ix+d/iy+d)
-HLinstr(0136)   e = timed_read_byte(addr);                          endinstr;   // ld e,(hl/ix+d/iy+d)
-HLinstr(0146)   h = timed_read_byte(addr);                          endinstr;   // ld h,(hl/ix+d/iy+d)
-HLinstr(0156)   l = timed_read_byte(addr);                          endinstr;   // ld l,(hl/ix+d/iy+d)
 
-instr(4,0166)   pc--;                                               endinstr;   // halt
 
-HLinstr(0176)   a = timed_read_byte(addr);                          endinstr;   // ld a,(hl/ix+d/iy+d)
+instr(4,0166)   pc--;   skip_idle(pc, 1);                           endinstr;   // halt
 
 
 instr(4,0107)   b = a;                                              endinstr;   // ld b,a
 instr(4,0117)   c = a;                                              endinstr;   // ld c,a
 instr(4,0127)   d = a;                                              endinstr;   // ld d,a
 instr(4,0137)   e = a;                                              endinstr;   // ld e,a
-instr(4,0147)   xh = a;                                             endinstr;   // ld h/ixh/iyh,a
-instr(4,0157)   xl = a;                                             endinstr;   // ld l/ixl/iyl,a
-HLinstr(0167)   timed_write_byte(addr,a);                           endinstr;   // ld (hl/ix+d/iy+d),a
 instr(4,0177)                                                       endinstr;   // ld a,a
 
 
@@ -470,36 +452,6 @@ instr(4,0263)   or_a(e);                                            endinstr;
 instr(4,0273)   cp_a(e);                                            endinstr;   // cp e
 
 
-instr(4,0204)   add_a(xh);                                          endinstr;   // add a,h/ixh/iyh
-instr(4,0214)   adc_a(xh);                                          endinstr;   // adc a,h/ixh/iyh
-instr(4,0224)   sub_a(xh);                                          endinstr;   // sub h/ixh/iyh
-instr(4,0234)   sbc_a(xh);                                          endinstr;   // sbc a,h/ixh/iyh
-instr(4,0244)   and_a(xh);                                          endinstr;   // and h/ixh/iyh
-instr(4,0254)   xor_a(xh);                                          endinstr;   // xor h/ixh/iyh
-instr(4,0264)   or_a(xh);                                           endinstr;   // or h/ixh/iyh
-instr(4,0274)   cp_a(xh);                                           endinstr;   // cp h/ixh/iyh
-
-
-instr(4,0205)   add_a(xl);                                          endinstr;   // add a,l/ixl/iyl
-instr(4,0215)   adc_a(xl);                                          endinstr;   // adc a,l/ixl/iyl
-instr(4,0225)   sub_a(xl);                                          endinstr;   // sub l/ixl/iyl
-instr(4,0235)   sbc_a(xl);                                          endinstr;   // sbc a,l/ixl/iyl
-instr(4,0245)   and_a(xl);                                          endinstr;   // and l/ixl/iyl
-instr(4,0255)   xor_a(xl);                                          endinstr;   // xor l/ixl/iyl
-instr(4,0265)   or_a(xl);                                           endinstr;   // or l/ixl/iyl
-instr(4,0275)   cp_a(xl);                                           endinstr;   // cp l/ixl/iyl
-
-
-HLinstr(0206)   add_a(timed_read_byte(addr));                       endinstr;   // add a,(hl/ix+d/iy+d)
-HLinstr(0216)   adc_a(timed_read_byte(addr));                       endinstr;   // adc a,(hl/ix+d/iy+d)
-HLinstr(0226)   sub_a(timed_read_byte(addr));                       endinstr;   // sub (hl/ix+d/iy+d)
-HLinstr(0236)   sbc_a(timed_read_byte(addr));                       endinstr;   // sbc a,(hl/ix+d/iy+d)
-HLinstr(0246)   and_a(timed_read_byte(addr));                       endinstr;   // and (hl/ix+d/iy+d)
-HLinstr(0256)   xor_a(timed_read_byte(addr));                       endinstr;   // xor (hl/ix+d/iy+d)
-HLinstr(0266)   or_a(timed_read_byte(addr));                        endinstr;   // or (hl/ix+d/iy+d)
-HLinstr(0276)   cp_a(timed_read_byte(addr));                        endinstr;   // cp (hl/ix+d/iy+d)
-
-
 instr(4,0207)   add_a(a);                                           endinstr;   // add a,a
 instr(4,0217)   adc_a(a);                                           endinstr;   // adc a,a
 instr(4,0227)   sub_a(a);                                           endinstr;   // sub a
@@ -558,22 +510,18 @@ instr(4,0376)   cp_a(timed_read_code_byte(pc++));                   endinstr;
 
 instr(4,0301)   pop(bc);                                            endinstr;   // pop bc
 instr(4,0321)   pop(de);                                            endinstr;   // pop de
-instr(4,0341)   pop(*pHlIxIy);                                      endinstr;   // pop hl/ix/iy
 instr(4,0361)   pop(af);                                            endinstr;   // pop af
 
-instr(4,0351)   pc = *pHlIxIy;                                      endinstr;   // jp (hl/ix/iy)
-instr(6,0371)   sp = *pHlIxIy;                                      endinstr;   // ld sp,hl/ix/iy
 
 instr(4,0331)   swap(bc,alt_bc); swap(de,alt_de); swap(hl,alt_hl);  endinstr;   // exx
 
 
 instr(5,0305)   push(bc);                                           endinstr;   // push bc
 instr(5,0325)   push(de);                                           endinstr;   // push de
-instr(5,0345)   push(*pHlIxIy);                                     endinstr;   // push hl
 instr(5,0365)   push(af);                                           endinstr;   // push af
 
-instr(4,0335)   pNewHlIxIy = &ix;                                   endinstr;   // [ix prefix]
-instr(4,0375)   pNewHlIxIy = &iy;                                   endinstr;   // [iy prefix]
+instr(4,0335)   ppvTable = a_ix_table;  goto lab_prefix;            endinstr;   // [ix prefix]
+instr(4,0375)   ppvTable = a_iy_table;  goto lab_prefix;            endinstr;   // [iy prefix]
 
 // [ed prefix]
 instr(4,0355)
@@ -581,11 +529,6 @@ instr(4,0355)
 endinstr;
 
 
-// [cb prefix]
-instr(4,0313)
-#include "CBops.h"
-endinstr;
-
 // out (n),a
 instr(4,0323)
     BYTE bPortLow = timed_read_code_byte(pc++);
@@ -600,14 +543,6 @@ instr(4,0333)
     a = in_byte((a << 8) | bPortLow);
 endinstr;
 
-// ex (sp),hl
-instr(4,0343)
-    WORD t = timed_read_word(sp);
-    g_nLineCycle++;
-    timed_write_word_reversed(sp,*pHlIxIy);
-    *pHlIxIy = t;
-    g_nLineCycle += 2;
-endinstr;
 
 instr(4,0363)   iff1 = iff2 = 0;                                    endinstr;   // di
 instr(4,0373)   iff1 = iff2 = 1;    g_nFastBooting = 0;             endinstr;   // ei
@@ -617,7 +552,17 @@ instr(4,0353)   swap(de,hl);                                        endinstr;
 
 instr(5,0307)   push(pc); pc = 000;                                 endinstr;   // rst 0
 
-instr(5,0317)   if (IO::Rst8Hook()) return; push(pc); pc = 010;      endinstr;   // rst 8
+// rst 8, which may be intercepted to provide DOS
+instr(5,0317)
+    SAVE_CACHED_STATE();
+    if (IO::Rst8Hook())
+        return;
+    LOAD_CACHED_STATE();
+
+    push(pc);
+    pc = 010;
+endinstr;
+
 instr(5,0327)   push(pc); pc = 020;                                 endinstr;   // rst 16
 instr(5,0337)   push(pc); pc = 030;                                 endinstr;   // rst 24
 instr(5,0347)   push(pc); pc = 040;                                 endinstr;   // rst 32
@@ -625,6 +570,8 @@ instr(5,0357)   push(pc); pc = 050;                                 endinstr;
 instr(5,0367)   push(pc); pc = 060;                                 endinstr;   // rst 48
 instr(5,0377)   push(pc); pc = 070;                                 endinstr;   // rst 56
 
+#endif  // HL_OPS_ONLY
+
 #undef instr
 #undef endinstr
 #undef HLinstr
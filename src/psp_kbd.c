@@ -286,7 +286,8 @@ enum eSamKey
     { SIM_C_INCY  ,   0, SK_NONE,     "C_INCY" },
     { SIM_C_DECX  ,   0, SK_NONE,     "C_DECX" },
     { SIM_C_DECY  ,   0, SK_NONE,     "C_DECY" },
-    { SIM_C_SCREEN,   0, SK_NONE,     "C_SCREEN" }
+    { SIM_C_SCREEN,   0, SK_NONE,     "C_SCREEN" },
+    { SIM_C_WARP  ,   0, SK_NONE,     "C_WARP" }
   };
 
   static int loc_default_mapping[ KBD_ALL_BUTTONS ] = {
@@ -507,7 +508,7 @@ sim_key_event(int sim_idx, int press)
   int shift;
 
   if ((sim_idx >= SIM_C_FPS) &&
-      (sim_idx <= SIM_C_SCREEN)) {
+      (sim_idx <= SIM_C_WARP)) {
     if (press) {
       sim_treat_command_key(sim_idx);
     }
@@ -587,15 +588,15 @@ psp_kbd_reset_hotkeys(void)
   int key_id;
   for (index = 0; index < KBD_ALL_BUTTONS; index++) {
     key_id = loc_default_mapping[index];
-    if ((key_id >= SIM_C_FPS) && (key_id <= SIM_C_SCREEN)) {
+    if ((key_id >= SIM_C_FPS) && (key_id <= SIM_C_WARP)) {
       psp_kbd_mapping[index] = key_id;
     }
     key_id = loc_default_mapping_L[index];
-    if ((key_id >= SIM_C_FPS) && (key_id <= SIM_C_SCREEN)) {
+    if ((key_id >= SIM_C_FPS) && (key_id <= SIM_C_WARP)) {
       psp_kbd_mapping_L[index] = key_id;
     }
     key_id = loc_default_mapping_R[index];
-    if ((key_id >= SIM_C_FPS) && (key_id <= SIM_C_SCREEN)) {
+    if ((key_id >= SIM_C_FPS) && (key_id <= SIM_C_WARP)) {
       psp_kbd_mapping_R[index] = key_id;
     }
   }
@@ -150,6 +150,7 @@ extern "C" {
    SIM_C_DECX  ,
    SIM_C_DECY  ,
    SIM_C_SCREEN,
+   SIM_C_WARP  ,
 
    SIM_MAX_KEY 
  };
@@ -443,6 +443,7 @@ psp_main_menu(void)
   psp_sdl_flip();
 
   psp_sdl_clear_blit(0);
+  sim_display_redraw();
 
   psp_sdl_gu_init();
 
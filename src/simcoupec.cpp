@@ -20,6 +20,9 @@
 #include "Main.h"
 #include "IO.h"
 #include "CPU.h"
+#include "Action.h"
+#include "Display.h"
+#include "Frame.h"
 #include "Options.h"
 #include <psptypes.h>
 #include <psppower.h>
@@ -175,6 +178,18 @@ sim_get_frame_skip()
   return GetOption(frameskip);
 }
 
+int
+sim_get_warp_skip()
+{
+  return GetOption(warpskip);
+}
+
+int
+sim_get_warp_disk()
+{
+  return GetOption(warpdisk);
+}
+
 int
 sim_get_psp_cpu_clock()
 {
@@ -243,6 +258,18 @@ sim_set_frame_skip(int value)
   SetOption(frameskip, value);
 }
 
+void
+sim_set_warp_skip(int value)
+{
+  SetOption(warpskip, value);
+}
+
+void
+sim_set_warp_disk(int value)
+{
+  SetOption(warpdisk, (value != 0));
+}
+
 void
 sim_set_psp_cpu_clock(int value) 
 {
@@ -300,6 +327,8 @@ sim_default_settings(void)
   sim_set_psp_reverse_analog(0);
   sim_set_psp_cpu_clock(222);
   sim_set_frame_skip(1);
+  sim_set_warp_skip(10);
+  sim_set_warp_disk(1);
   sim_set_psp_screenshot_id(0);
 
   scePowerSetClockFrequency(222, 222, 222/2);
@@ -323,6 +352,8 @@ loc_sim_save_settings(char *chFileName)
     fprintf(FileDesc, "view_fps=%d\n"           , sim_get_view_fps());
     fprintf(FileDesc, "speed_limiter=%d\n"      , sim_get_speed_limiter());
     fprintf(FileDesc, "frame_skip=%d\n"         , sim_get_frame_skip());
+    fprintf(FileDesc, "warp_skip=%d\n"          , sim_get_warp_skip());
+    fprintf(FileDesc, "warp_disk=%d\n"          , sim_get_warp_disk());
 
     fclose(FileDesc);
 
@@ -390,6 +421,10 @@ loc_sim_load_settings(char *chFileName)
     if (!strcasecmp(Buffer,"speed_limiter")) sim_set_speed_limiter(Value);
     else
     if (!strcasecmp(Buffer,"frame_skip")) sim_set_frame_skip(Value);
+    else
+    if (!strcasecmp(Buffer,"warp_skip")) sim_set_warp_skip(Value);
+    else
+    if (!strcasecmp(Buffer,"warp_disk")) sim_set_warp_disk(Value);
   }
 
   fclose(FileDesc);
@@ -489,6 +524,15 @@ sim_audio_resume(void)
   }
 }
 
+// Redraw every line, for when the blit surface or the view of it has changed.  Direct colour
+// frames are drawn on the surface, so the frame has to be drawn again too.
+void
+sim_display_redraw(void)
+{
+  Frame::SetDirty();
+  Display::SetDirty();
+}
+
 int
 sim_is_save_used(int slot_id)
 {
@@ -524,7 +568,11 @@ sim_treat_command_key(int sim_idx)
     case SIM_C_DECX:
       if (Options::s_Options.render_x > -20) Options::s_Options.render_x--;
     break;
+    case SIM_C_WARP: Action::Do(actToggleTurbo);
+    break;
   }
+
+  sim_display_redraw();
 }
 
 # if 0 
@@ -45,6 +45,8 @@ extern "C" {
   extern int   sim_get_speed_limiter();
   extern int   sim_get_display_lr();
   extern int   sim_get_frame_skip();
+  extern int   sim_get_warp_skip();
+  extern int   sim_get_warp_disk();
   extern int   sim_get_psp_cpu_clock();
 
   extern void  sim_set_snd_enabled(int value);
@@ -53,6 +55,8 @@ extern "C" {
   extern void  sim_set_display_lr(int value);
   extern void  sim_set_speed_limiter(int value);
   extern void  sim_set_frame_skip(int value);
+  extern void  sim_set_warp_skip(int value);
+  extern void  sim_set_warp_disk(int value);
   extern void  sim_set_psp_cpu_clock(int value);
 
   extern int   sim_state_load(char *filename, int zip_format);
@@ -61,6 +65,7 @@ extern "C" {
   extern int   sim_save_configuration(void);
   extern void  sim_audio_resume(void);
   extern void  sim_audio_pause(void);
+  extern void  sim_display_redraw(void);
 
   extern int   sim_is_save_used(int slot_id);
   extern int   sim_snapshot_load_slot(int slot_id);